@@ -0,0 +1,91 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+//对数分桶的延迟直方图,思路同HdrHistogram:每个2的幂区间再线性切成64份,相对误差不超过1/64
+//记录和查询都是O(1)/O(桶数),不分配内存,适合在压测线程里每个请求记录一次
+class latency_histogram{
+public:
+    //前128个桶为[0,128)的精确值,之后每个2的幂区间64个桶,覆盖完整的uint64范围
+    static const int SUB_BUCKETS = 128;
+    static const int HALF_BUCKETS = 64;
+    static const int BUCKET_COUNT = SUB_BUCKETS + 57 * HALF_BUCKETS;
+
+    latency_histogram(){
+        reset();
+    }
+
+    void reset(){
+        memset(m_counts,0,sizeof(m_counts));
+        m_total=0;
+        m_sum=0;
+        m_min=UINT64_MAX;
+        m_max=0;
+    }
+
+    void record(uint64_t value){
+        ++m_counts[index_of(value)];
+        ++m_total;
+        m_sum+=value;
+        if(value<m_min) m_min=value;
+        if(value>m_max) m_max=value;
+    }
+
+    //合并其他线程的直方图
+    void merge(const latency_histogram &other){
+        for(int i=0;i<BUCKET_COUNT;++i){
+            m_counts[i]+=other.m_counts[i];
+        }
+        m_total+=other.m_total;
+        m_sum+=other.m_sum;
+        if(other.m_min<m_min) m_min=other.m_min;
+        if(other.m_max>m_max) m_max=other.m_max;
+    }
+
+    //返回第p百分位(0~100)所在桶的上界,保证不低估
+    uint64_t percentile(double p) const{
+        if(m_total==0) return 0;
+        uint64_t target=(uint64_t)(p/100.0*m_total+0.5);
+        if(target==0) target=1;
+        uint64_t seen=0;
+        for(int i=0;i<BUCKET_COUNT;++i){
+            seen+=m_counts[i];
+            if(seen>=target){
+                uint64_t upper=upper_of(i);
+                return upper<m_max?upper:m_max;
+            }
+        }
+        return m_max;
+    }
+
+    uint64_t count() const { return m_total; }
+    uint64_t min() const { return m_total?m_min:0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_total?(double)m_sum/m_total:0.0; }
+
+private:
+    static int index_of(uint64_t v){
+        if(v<SUB_BUCKETS) return (int)v;
+        int msb=63-__builtin_clzll(v);
+        int shift=msb-6;
+        return SUB_BUCKETS+(shift-1)*HALF_BUCKETS+(int)((v>>shift)-HALF_BUCKETS);
+    }
+
+    static uint64_t upper_of(int index){
+        if(index<SUB_BUCKETS) return (uint64_t)index;
+        int shift=(index-SUB_BUCKETS)/HALF_BUCKETS+1;
+        uint64_t sub=(uint64_t)((index-SUB_BUCKETS)%HALF_BUCKETS+HALF_BUCKETS);
+        return ((sub+1)<<shift)-1;
+    }
+
+private:
+    uint64_t m_counts[BUCKET_COUNT];
+    uint64_t m_total;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+#endif
@@ -0,0 +1,872 @@
+//HTTP压测工具,用于在回环地址上验证http_conn、threadpool、Log等模块的性能改动
+//
+//编译: g++ -O2 -std=c++11 -pthread bench/loadgen.cpp -o loadgen -lssl -lcrypto
+//用法: ./loadgen -f bench/scenarios/small_file.conf [-h 127.0.0.1] [-p 9006]
+//              [-c 连接数] [-t 线程数] [-d 秒] [-R 总请求速率] [-o report.json]
+//
+//闭环模式(R=0):每个连接收到响应后立即发下一个请求,测的是饱和吞吐
+//开环模式(R>0):按固定速率排定每个请求的发送时刻,延迟从排定时刻开始计算,
+//              服务器卡顿时迟发的请求也从排定时刻算起,不会因为客户端"等着"而少算延迟(避免协调遗漏)
+//命令行参数会覆盖场景文件中的同名设置,报告以JSON输出到stdout或-o指定的文件
+//tls=1时通过HTTPS端口压测,keepalive=0时每个请求都是一次完整握手,报告中tls.handshakes_per_sec即握手速率;
+//resume=1时每个连接重连时带上自己上一次的会话,衡量会话复用省下的握手开销
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include "histogram.h"
+
+using namespace std;
+
+static const int MAX_EVENTS = 1024;
+static const int RESPONSE_BUF_SIZE = 64 * 1024;
+
+//场景配置,对应场景文件中的key=value
+struct scenario
+{
+    string name;
+    string host;
+    int port;
+    string method;
+    vector<string> paths;    //多个path按轮询方式使用
+    vector<string> bodies;   //POST请求体,多个时轮询使用
+    bool keepalive;
+    int connections;
+    int threads;
+    int duration;            //秒
+    double rate;             //总请求速率,0表示闭环
+    int idle_connections;    //慢速攻击连接数
+    int idle_interval_ms;    //慢速连接每隔多久发一个字节
+    bool tls;                //使用HTTPS
+    bool resume;             //重连时复用上一次的TLS会话
+    string report;
+};
+
+//单个压测连接的状态
+struct bench_conn
+{
+    int fd;
+    int state;               //0未连接 1正在连接 2发送中 3接收中 4等待下次排定时刻 5TLS握手中
+    SSL *ssl;                //HTTPS连接的SSL对象
+    SSL_SESSION *session;    //上一次连接的会话,resume=1时重连使用
+    string request;
+    string header;           //尚未读完的响应头
+    size_t sent;
+    uint64_t intended_ns;    //开环模式下本次请求的排定发送时刻
+    uint64_t start_ns;       //实际开始时刻(闭环模式以此计算延迟)
+    uint64_t interval_ns;    //开环模式下该连接的请求间隔
+    size_t header_len;       //响应头长度,0表示尚未读完头部
+    long long body_len;      //Content-Length,-1表示读到连接关闭为止
+    size_t received;
+    bool server_close;
+    unsigned seq;
+};
+
+//慢速连接:只发送部分请求头,然后每隔一段时间挤一个字节,模拟slowloris
+struct idle_conn
+{
+    int fd;
+    uint64_t next_ns;
+    bool sent_prefix;        //是否已发送请求行和部分头部
+    bool closed;
+};
+
+//线程局部的统计结果,结束后合并
+struct thread_stats
+{
+    latency_histogram hist;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t non_2xx;
+    uint64_t bytes;
+    uint64_t connects;
+    uint64_t idle_opened;
+    uint64_t idle_closed;
+    uint64_t handshakes;
+    uint64_t resumed;
+    uint64_t handshake_ns;   //从发起连接到握手完成的总耗时
+
+    thread_stats() : requests(0), errors(0), non_2xx(0), bytes(0), connects(0), idle_opened(0), idle_closed(0),
+                     handshakes(0), resumed(0), handshake_ns(0) {}
+};
+
+struct worker_arg
+{
+    const scenario *sc;
+    int conn_count;
+    int idle_count;
+    double rate;
+    unsigned seed;
+    thread_stats stats;
+    pthread_t tid;
+};
+
+static sockaddr_in g_address;
+static SSL_CTX *g_ssl_ctx = NULL;
+static volatile bool g_stop = false;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trim(string &s)
+{
+    size_t b = s.find_first_not_of(" \t\r\n");
+    size_t e = s.find_last_not_of(" \t\r\n");
+    if (b == string::npos)
+        s.clear();
+    else
+        s = s.substr(b, e - b + 1);
+}
+
+//读取用户文件,每行"用户名 密码",生成登录表单请求体
+static bool load_users(const string &file, vector<string> &bodies)
+{
+    FILE *fp = fopen(file.c_str(), "r");
+    if (!fp)
+        return false;
+    char name[128], passwd[128];
+    while (fscanf(fp, "%127s %127s", name, passwd) == 2)
+    {
+        bodies.push_back(string("user=") + name + "&passwd=" + passwd);
+    }
+    fclose(fp);
+    return !bodies.empty();
+}
+
+//解析场景文件,#开头为注释,相对路径的users文件以场景文件所在目录为基准
+static bool load_scenario(const char *file, scenario &sc)
+{
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open scenario %s\n", file);
+        return false;
+    }
+    string dir(file);
+    size_t slash = dir.rfind('/');
+    dir = (slash == string::npos) ? "" : dir.substr(0, slash + 1);
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        string text(line);
+        size_t hash = text.find('#');
+        if (hash != string::npos)
+            text.erase(hash);
+        size_t eq = text.find('=');
+        if (eq == string::npos)
+            continue;
+        string key = text.substr(0, eq), value = text.substr(eq + 1);
+        trim(key);
+        trim(value);
+
+        if (key == "name")
+            sc.name = value;
+        else if (key == "host")
+            sc.host = value;
+        else if (key == "port")
+            sc.port = atoi(value.c_str());
+        else if (key == "method")
+            sc.method = value;
+        else if (key == "path")
+            sc.paths.push_back(value);
+        else if (key == "body")
+            sc.bodies.push_back(value);
+        else if (key == "users")
+        {
+            string path = (value[0] == '/') ? value : dir + value;
+            if (!load_users(path, sc.bodies))
+            {
+                fprintf(stderr, "cannot load users from %s\n", path.c_str());
+                fclose(fp);
+                return false;
+            }
+        }
+        else if (key == "keepalive")
+            sc.keepalive = atoi(value.c_str()) != 0;
+        else if (key == "connections")
+            sc.connections = atoi(value.c_str());
+        else if (key == "threads")
+            sc.threads = atoi(value.c_str());
+        else if (key == "duration")
+            sc.duration = atoi(value.c_str());
+        else if (key == "rate")
+            sc.rate = atof(value.c_str());
+        else if (key == "idle_connections")
+            sc.idle_connections = atoi(value.c_str());
+        else if (key == "idle_interval_ms")
+            sc.idle_interval_ms = atoi(value.c_str());
+        else if (key == "tls")
+            sc.tls = atoi(value.c_str()) != 0;
+        else if (key == "resume")
+            sc.resume = atoi(value.c_str()) != 0;
+        else
+            fprintf(stderr, "unknown scenario key: %s\n", key.c_str());
+    }
+    fclose(fp);
+    return true;
+}
+
+static void build_request(const scenario &sc, unsigned seq, string &out)
+{
+    const string &path = sc.paths[seq % sc.paths.size()];
+    out.clear();
+    out += sc.method;
+    out += " ";
+    out += path;
+    out += " HTTP/1.1\r\nHost: ";
+    out += sc.host;
+    out += "\r\nConnection: ";
+    out += sc.keepalive ? "keep-alive" : "close";
+    out += "\r\n";
+    if (!sc.bodies.empty())
+    {
+        const string &body = sc.bodies[seq % sc.bodies.size()];
+        char len[64];
+        snprintf(len, sizeof(len), "Content-Length: %zu\r\n", body.size());
+        out += "Content-Type: application/x-www-form-urlencoded\r\n";
+        out += len;
+        out += "\r\n";
+        out += body;
+    }
+    else
+    {
+        out += "\r\n";
+    }
+}
+
+static int open_socket(int epollfd, void *ptr, uint32_t events)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (sockaddr *)&g_address, sizeof(g_address)) < 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+    epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = ptr;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+    return fd;
+}
+
+//关闭前保存会话并发出close_notify,没有close_notify的会话会被OpenSSL标记为不可复用
+static void close_conn(int epollfd, const scenario &sc, bench_conn *c)
+{
+    if (c->ssl)
+    {
+        if (sc.resume)
+        {
+            SSL_SESSION *session = SSL_get1_session(c->ssl);
+            if (session && SSL_SESSION_is_resumable(session))
+            {
+                if (c->session)
+                    SSL_SESSION_free(c->session);
+                c->session = session;
+            }
+            else if (session)
+                SSL_SESSION_free(session);
+        }
+        SSL_shutdown(c->ssl);
+        SSL_free(c->ssl);
+        ERR_clear_error();
+        c->ssl = NULL;
+    }
+    if (c->fd >= 0)
+    {
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, c->fd, 0);
+        close(c->fd);
+    }
+    c->fd = -1;
+    c->state = 0;
+}
+
+static void set_events(int epollfd, bench_conn *c, uint32_t events)
+{
+    epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(epollfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+//开始一次请求:必要时建立连接,然后发送
+static void start_request(int epollfd, const scenario &sc, bench_conn *c, thread_stats &st)
+{
+    build_request(sc, c->seq++, c->request);
+    c->sent = 0;
+    c->header.clear();
+    c->header_len = 0;
+    c->body_len = -1;
+    c->received = 0;
+    c->server_close = false;
+    c->start_ns = now_ns();
+    if (c->fd < 0)
+    {
+        c->fd = open_socket(epollfd, c, EPOLLOUT);
+        if (c->fd < 0)
+        {
+            ++st.errors;
+            c->state = 4;
+            return;
+        }
+        ++st.connects;
+        c->state = 1;
+        return;
+    }
+    c->state = 2;
+    set_events(epollfd, c, EPOLLOUT);
+}
+
+//一次请求结束(成功或失败)后的处理:记录延迟并安排下一次请求
+static void finish_request(int epollfd, const scenario &sc, bench_conn *c, thread_stats &st, bool ok)
+{
+    uint64_t now = now_ns();
+    if (ok)
+    {
+        ++st.requests;
+        //开环模式从排定时刻算起,排定时刻按计划推进,迟发的请求已经带上了排队等待的时间,
+        //不再补记虚拟样本,否则协调遗漏被算了两次
+        if (c->interval_ns)
+        {
+            st.hist.record((now - c->intended_ns) / 1000);
+        }
+        else
+        {
+            st.hist.record((now - c->start_ns) / 1000);
+        }
+    }
+    else
+    {
+        ++st.errors;
+    }
+    if (!ok || !sc.keepalive || c->server_close)
+        close_conn(epollfd, sc, c);
+
+    if (c->interval_ns)
+    {
+        c->intended_ns += c->interval_ns;
+        c->state = 4;
+        if (c->fd >= 0)
+            set_events(epollfd, c, 0);
+    }
+    else if (!g_stop)
+    {
+        start_request(epollfd, sc, c, st);
+    }
+}
+
+//解析响应头,取得状态码、Content-Length以及服务器是否要求关闭连接
+static bool parse_response_header(bench_conn *c, const char *buf, size_t len, thread_stats &st)
+{
+    const char *end = NULL;
+    for (size_t i = 0; i + 3 < len; ++i)
+    {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n')
+        {
+            end = buf + i + 4;
+            break;
+        }
+    }
+    if (!end)
+        return false;
+    c->header_len = end - buf;
+
+    int status = 0;
+    if (len > 12)
+        status = atoi(buf + 9);
+    if (status < 200 || status >= 300)
+        ++st.non_2xx;
+
+    const char *p = buf;
+    while (p < end)
+    {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol)
+            break;
+        if (strncasecmp(p, "Content-Length:", 15) == 0)
+            c->body_len = atoll(p + 15);
+        else if (strncasecmp(p, "Connection:", 11) == 0)
+        {
+            const char *v = p + 11;
+            while (*v == ' ' || *v == '\t')
+                ++v;
+            if (strncasecmp(v, "close", 5) == 0)
+                c->server_close = true;
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+//HTTPS连接上的收发,返回值和errno的含义同recv/send,对方发来close_notify时返回0
+static ssize_t conn_recv(bench_conn *c, char *buf, size_t len)
+{
+    if (!c->ssl)
+        return recv(c->fd, buf, len, 0);
+    ERR_clear_error();
+    int n = SSL_read(c->ssl, buf, (int)len);
+    if (n > 0)
+        return n;
+    int err = SSL_get_error(c->ssl, n);
+    if (err == SSL_ERROR_ZERO_RETURN)
+        return 0;
+    errno = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? EAGAIN : EIO;
+    return -1;
+}
+
+static ssize_t conn_send(bench_conn *c, const char *data, size_t len)
+{
+    if (!c->ssl)
+        return send(c->fd, data, len, MSG_NOSIGNAL);
+    ERR_clear_error();
+    int n = SSL_write(c->ssl, data, (int)len);
+    if (n > 0)
+        return n;
+    int err = SSL_get_error(c->ssl, n);
+    errno = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? EAGAIN : EIO;
+    return -1;
+}
+
+static void handle_read(int epollfd, const scenario &sc, bench_conn *c, thread_stats &st, char *buf)
+{
+    while (true)
+    {
+        ssize_t n = conn_recv(c, buf, RESPONSE_BUF_SIZE);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            finish_request(epollfd, sc, c, st, false);
+            return;
+        }
+        if (n == 0)
+        {
+            //没有Content-Length时以连接关闭作为响应结束
+            bool ok = c->header_len != 0 && c->body_len < 0;
+            c->server_close = true;
+            finish_request(epollfd, sc, c, st, ok);
+            return;
+        }
+        st.bytes += n;
+        c->received += n;
+        //响应头缓存在连接自己的header中,响应体只计数不保存
+        if (c->header_len == 0)
+        {
+            c->header.append(buf, n);
+            if (!parse_response_header(c, c->header.data(), c->header.size(), st))
+            {
+                if (c->header.size() >= (size_t)RESPONSE_BUF_SIZE)
+                {
+                    finish_request(epollfd, sc, c, st, false);
+                    return;
+                }
+                continue;
+            }
+        }
+        if (c->body_len >= 0 && c->received >= c->header_len + (size_t)c->body_len)
+        {
+            finish_request(epollfd, sc, c, st, true);
+            return;
+        }
+    }
+}
+
+static void handle_write(int epollfd, const scenario &sc, bench_conn *c, thread_stats &st);
+
+//推进TLS握手,完成后接着发送请求
+static void handle_handshake(int epollfd, const scenario &sc, bench_conn *c, thread_stats &st)
+{
+    ERR_clear_error();
+    int ret = SSL_do_handshake(c->ssl);
+    if (ret == 1)
+    {
+        ++st.handshakes;
+        if (SSL_session_reused(c->ssl))
+            ++st.resumed;
+        st.handshake_ns += now_ns() - c->start_ns;
+        c->state = 2;
+        handle_write(epollfd, sc, c, st);
+        return;
+    }
+    int err = SSL_get_error(c->ssl, ret);
+    if (err == SSL_ERROR_WANT_READ)
+        set_events(epollfd, c, EPOLLIN);
+    else if (err == SSL_ERROR_WANT_WRITE)
+        set_events(epollfd, c, EPOLLOUT);
+    else
+        finish_request(epollfd, sc, c, st, false);
+}
+
+static void handle_write(int epollfd, const scenario &sc, bench_conn *c, thread_stats &st)
+{
+    if (c->state == 1)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err)
+        {
+            finish_request(epollfd, sc, c, st, false);
+            return;
+        }
+        c->state = 2;
+        if (sc.tls)
+        {
+            c->ssl = SSL_new(g_ssl_ctx);
+            SSL_set_fd(c->ssl, c->fd);
+            SSL_set_connect_state(c->ssl);
+            if (c->session)
+                SSL_set_session(c->ssl, c->session);
+            c->state = 5;
+            handle_handshake(epollfd, sc, c, st);
+            return;
+        }
+    }
+    while (c->sent < c->request.size())
+    {
+        ssize_t n = conn_send(c, c->request.data() + c->sent, c->request.size() - c->sent);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            finish_request(epollfd, sc, c, st, false);
+            return;
+        }
+        c->sent += n;
+    }
+    c->state = 3;
+    set_events(epollfd, c, EPOLLIN | EPOLLRDHUP);
+}
+
+//维护慢速连接:被服务器关闭的计数后重新建立,保持攻击压力
+static void tick_idle(int epollfd, vector<idle_conn> &idles, const scenario &sc, thread_stats &st, uint64_t now)
+{
+    static const char prefix[] = "GET / HTTP/1.1\r\nHost: bench\r\nX-Slow: ";
+    for (size_t i = 0; i < idles.size(); ++i)
+    {
+        idle_conn &ic = idles[i];
+        if (ic.closed || ic.fd < 0)
+        {
+            ic.fd = open_socket(epollfd, NULL, 0);
+            ic.closed = false;
+            ic.sent_prefix = false;
+            ic.next_ns = now;
+            if (ic.fd >= 0)
+                ++st.idle_opened;
+            continue;
+        }
+        if (now < ic.next_ns)
+            continue;
+        const char *data = ic.sent_prefix ? "a" : prefix;
+        size_t len = ic.sent_prefix ? 1 : sizeof(prefix) - 1;
+        ssize_t n = send(ic.fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != ENOTCONN)
+        {
+            //服务器已经关闭了这个慢速连接,计数后下一轮重新建立
+            ++st.idle_closed;
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, ic.fd, 0);
+            close(ic.fd);
+            ic.fd = -1;
+            ic.closed = true;
+            continue;
+        }
+        //连接尚未建立完成时send返回ENOTCONN,留到下一轮再发
+        if (n > 0)
+        {
+            ic.sent_prefix = true;
+            ic.next_ns = now + (uint64_t)sc.idle_interval_ms * 1000000ull;
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    worker_arg *wa = (worker_arg *)arg;
+    const scenario &sc = *wa->sc;
+    thread_stats &st = wa->stats;
+    char *buf = new char[RESPONSE_BUF_SIZE];
+    int epollfd = epoll_create(5);
+
+    vector<bench_conn> conns(wa->conn_count);
+    uint64_t start = now_ns();
+    uint64_t interval = 0;
+    if (wa->rate > 0 && wa->conn_count > 0)
+        interval = (uint64_t)(1e9 * wa->conn_count / wa->rate);
+    for (int i = 0; i < wa->conn_count; ++i)
+    {
+        bench_conn &c = conns[i];
+        c.fd = -1;
+        c.state = 4;
+        c.ssl = NULL;
+        c.session = NULL;
+        c.seq = wa->seed + i;
+        c.interval_ns = interval;
+        //开环模式下把各连接的起始时刻均匀错开,避免同时突发
+        c.intended_ns = start + (interval ? interval * i / wa->conn_count : 0);
+    }
+
+    vector<idle_conn> idles(wa->idle_count);
+    for (size_t i = 0; i < idles.size(); ++i)
+    {
+        idles[i].fd = -1;
+        idles[i].closed = false;
+        idles[i].sent_prefix = false;
+        idles[i].next_ns = 0;
+    }
+
+    epoll_event events[MAX_EVENTS];
+    uint64_t next_idle = 0;
+    while (!g_stop)
+    {
+        uint64_t now = now_ns();
+        int timeout = 100;
+        //开环:到点的连接发起请求,并计算到下一个排定时刻的等待时间
+        //闭环:只有建立连接失败的连接会停在状态4,这里重新发起
+        uint64_t next = UINT64_MAX;
+        for (size_t i = 0; i < conns.size(); ++i)
+        {
+            bench_conn &c = conns[i];
+            if (c.state != 4)
+                continue;
+            if (!interval || c.intended_ns <= now)
+                start_request(epollfd, sc, &c, st);
+            else if (c.intended_ns < next)
+                next = c.intended_ns;
+        }
+        if (next != UINT64_MAX && (next - now) / 1000000 < (uint64_t)timeout)
+            timeout = (int)((next - now) / 1000000);
+        if (!idles.empty() && now >= next_idle)
+        {
+            tick_idle(epollfd, idles, sc, st, now);
+            next_idle = now + 10 * 1000000ull;
+        }
+
+        int number = epoll_wait(epollfd, events, MAX_EVENTS, timeout);
+        if (number < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < number; ++i)
+        {
+            bench_conn *c = (bench_conn *)events[i].data.ptr;
+            if (!c)
+                continue;
+            if (c->state == 1 || c->state == 2)
+                handle_write(epollfd, sc, c, st);
+            else if (c->state == 3)
+                handle_read(epollfd, sc, c, st, buf);
+            else if (c->state == 5)
+                handle_handshake(epollfd, sc, c, st);
+        }
+    }
+
+    for (size_t i = 0; i < conns.size(); ++i)
+    {
+        if (conns[i].ssl)
+            SSL_free(conns[i].ssl);
+        if (conns[i].session)
+            SSL_SESSION_free(conns[i].session);
+        if (conns[i].fd >= 0)
+            close(conns[i].fd);
+    }
+    for (size_t i = 0; i < idles.size(); ++i)
+    {
+        if (idles[i].fd >= 0)
+            close(idles[i].fd);
+    }
+    close(epollfd);
+    delete[] buf;
+    return NULL;
+}
+
+static void write_report(FILE *fp, const scenario &sc, const thread_stats &total, double elapsed)
+{
+    const latency_histogram &h = total.hist;
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"scenario\": \"%s\",\n", sc.name.c_str());
+    fprintf(fp, "  \"mode\": \"%s\",\n", sc.rate > 0 ? "open" : "closed");
+    fprintf(fp, "  \"target_rate\": %.1f,\n", sc.rate);
+    fprintf(fp, "  \"connections\": %d,\n", sc.connections);
+    fprintf(fp, "  \"threads\": %d,\n", sc.threads);
+    fprintf(fp, "  \"keepalive\": %s,\n", sc.keepalive ? "true" : "false");
+    fprintf(fp, "  \"duration_s\": %.3f,\n", elapsed);
+    fprintf(fp, "  \"requests\": %llu,\n", (unsigned long long)total.requests);
+    fprintf(fp, "  \"errors\": %llu,\n", (unsigned long long)total.errors);
+    fprintf(fp, "  \"non_2xx\": %llu,\n", (unsigned long long)total.non_2xx);
+    fprintf(fp, "  \"connects\": %llu,\n", (unsigned long long)total.connects);
+    fprintf(fp, "  \"bytes\": %llu,\n", (unsigned long long)total.bytes);
+    fprintf(fp, "  \"requests_per_sec\": %.1f,\n", elapsed > 0 ? total.requests / elapsed : 0.0);
+    fprintf(fp, "  \"mbytes_per_sec\": %.3f,\n", elapsed > 0 ? total.bytes / elapsed / 1048576.0 : 0.0);
+    fprintf(fp, "  \"latency_us\": {\"samples\": %llu, \"min\": %llu, \"mean\": %.1f, \"p50\": %llu, "
+                "\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu},\n",
+            (unsigned long long)h.count(), (unsigned long long)h.min(), h.mean(),
+            (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+            (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+            (unsigned long long)h.max());
+    fprintf(fp, "  \"idle\": {\"connections\": %d, \"opened\": %llu, \"closed_by_server\": %llu},\n",
+            sc.idle_connections, (unsigned long long)total.idle_opened, (unsigned long long)total.idle_closed);
+    fprintf(fp, "  \"tls\": {\"enabled\": %s, \"resume\": %s, \"handshakes\": %llu, \"resumed\": %llu, "
+                "\"handshakes_per_sec\": %.1f, \"handshake_us_mean\": %.1f}\n",
+            sc.tls ? "true" : "false", sc.resume ? "true" : "false", (unsigned long long)total.handshakes,
+            (unsigned long long)total.resumed, elapsed > 0 ? total.handshakes / elapsed : 0.0,
+            total.handshakes ? total.handshake_ns / 1000.0 / total.handshakes : 0.0);
+    fprintf(fp, "}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -f scenario [-h host] [-p port] [-c conns] [-t threads] "
+                    "[-d seconds] [-R rate] [-o report]\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    scenario sc;
+    sc.name = "default";
+    sc.host = "127.0.0.1";
+    sc.port = 9006;
+    sc.method = "GET";
+    sc.keepalive = true;
+    sc.connections = 64;
+    sc.threads = 2;
+    sc.duration = 10;
+    sc.rate = 0;
+    sc.idle_connections = 0;
+    sc.idle_interval_ms = 1000;
+    sc.tls = false;
+    sc.resume = false;
+
+    //先找出场景文件,命令行其余参数再覆盖它
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (strcmp(argv[i], "-f") == 0 && !load_scenario(argv[i + 1], sc))
+            return 1;
+    }
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char *v = argv[i + 1];
+        if (strcmp(argv[i], "-f") == 0)
+            continue;
+        else if (strcmp(argv[i], "-h") == 0)
+            sc.host = v;
+        else if (strcmp(argv[i], "-p") == 0)
+            sc.port = atoi(v);
+        else if (strcmp(argv[i], "-c") == 0)
+            sc.connections = atoi(v);
+        else if (strcmp(argv[i], "-t") == 0)
+            sc.threads = atoi(v);
+        else if (strcmp(argv[i], "-d") == 0)
+            sc.duration = atoi(v);
+        else if (strcmp(argv[i], "-R") == 0)
+            sc.rate = atof(v);
+        else if (strcmp(argv[i], "-o") == 0)
+            sc.report = v;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (sc.paths.empty())
+        sc.paths.push_back("/");
+    if (sc.threads <= 0)
+        sc.threads = 1;
+    if (sc.connections < sc.threads)
+        sc.threads = sc.connections > 0 ? sc.connections : 1;
+
+    memset(&g_address, 0, sizeof(g_address));
+    g_address.sin_family = AF_INET;
+    g_address.sin_port = htons(sc.port);
+    if (inet_pton(AF_INET, sc.host.c_str(), &g_address.sin_addr) != 1)
+    {
+        fprintf(stderr, "invalid host %s\n", sc.host.c_str());
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (sc.tls)
+    {
+        //压测只关心服务器的开销,不校验证书;服务器未发close_notify就关闭时按正常结束处理
+        g_ssl_ctx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_verify(g_ssl_ctx, SSL_VERIFY_NONE, NULL);
+        SSL_CTX_set_options(g_ssl_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+        SSL_CTX_set_session_cache_mode(g_ssl_ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    vector<worker_arg> args(sc.threads);
+    for (int i = 0; i < sc.threads; ++i)
+    {
+        worker_arg &wa = args[i];
+        wa.sc = &sc;
+        wa.conn_count = sc.connections / sc.threads + (i < sc.connections % sc.threads ? 1 : 0);
+        wa.idle_count = sc.idle_connections / sc.threads + (i < sc.idle_connections % sc.threads ? 1 : 0);
+        wa.rate = sc.rate * wa.conn_count / (sc.connections > 0 ? sc.connections : 1);
+        wa.seed = i * 100003u;
+    }
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < sc.threads; ++i)
+        pthread_create(&args[i].tid, NULL, worker, &args[i]);
+    sleep(sc.duration);
+    g_stop = true;
+    for (int i = 0; i < sc.threads; ++i)
+        pthread_join(args[i].tid, NULL);
+    double elapsed = (now_ns() - begin) / 1e9;
+
+    thread_stats total;
+    for (int i = 0; i < sc.threads; ++i)
+    {
+        const thread_stats &st = args[i].stats;
+        total.hist.merge(st.hist);
+        total.requests += st.requests;
+        total.errors += st.errors;
+        total.non_2xx += st.non_2xx;
+        total.bytes += st.bytes;
+        total.connects += st.connects;
+        total.idle_opened += st.idle_opened;
+        total.idle_closed += st.idle_closed;
+        total.handshakes += st.handshakes;
+        total.resumed += st.resumed;
+        total.handshake_ns += st.handshake_ns;
+    }
+
+    FILE *out = stdout;
+    if (!sc.report.empty())
+    {
+        out = fopen(sc.report.c_str(), "w");
+        if (!out)
+        {
+            fprintf(stderr, "cannot write report %s\n", sc.report.c_str());
+            out = stdout;
+        }
+    }
+    write_report(out, sc, total, elapsed);
+    if (out != stdout)
+        fclose(out);
+    if (g_ssl_ctx)
+        SSL_CTX_free(g_ssl_ctx);
+    return 0;
+}
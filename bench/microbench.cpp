@@ -0,0 +1,670 @@
+//核心组件的微基准测试,不需要socket和MySQL服务,几分钟内就能看出热点路径的性能回退
+//
+//编译: g++ -O2 -std=c++14 -Wall -pthread -I. bench/microbench.cpp http/*.cpp process/*.cpp log/log.cpp
+//          <连接池> -lmysqlclient -lz -lbrotlienc -lssl -lcrypto -o microbench
+//      连接池(connection_pool、connectionRAII)的实现不在这棵目录树里,换成服务器链接的同一份源文件或目标文件
+//用法: ./microbench [过滤子串...] [--async-log]
+//      只运行名字包含任一过滤子串的用例,例如 ./microbench timer parse
+//
+//覆盖的路径:
+//  http_conn::parse_line / process_read  对录制的请求报文反复解析
+//  sort_timer_lst add / adjust / tick    在不同定时器数量下测量
+//  threadpool append -> process          单个任务的派发往返延迟和批量吞吐
+//  block_queue push / pop                多生产者多消费者竞争
+//  Log::write_log                        单次调用开销
+//  请求路径上的内存分配                    process_read+process_write稳定后每个请求调用全局分配器的次数
+//  html_template::render                 渲染含两个变量的页面模板,只生成iovec,不拷贝静态部分
+//  websocket unmask / broadcast          帧去掉掩码的吞吐,向N个socketpair订阅者广播的消息速率和每个空闲连接的内存
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <malloc.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <new>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include "../http/http_conn.h"
+#include "../http/reactor_queue.h"
+#include "../timer/lst_timer.h"
+#include "../threadpool/threadpool.h"
+#include "../log/log.h"
+#include "../log/block_queue.h"
+
+using namespace std;
+
+static vector<string> g_filters;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool selected(const char *name)
+{
+    if (g_filters.empty())
+        return true;
+    for (size_t i = 0; i < g_filters.size(); ++i)
+    {
+        if (strstr(name, g_filters[i].c_str()))
+            return true;
+    }
+    return false;
+}
+
+static void report(const char *name, uint64_t ops, uint64_t elapsed_ns)
+{
+    double ns_per_op = ops ? (double)elapsed_ns / ops : 0.0;
+    double ops_per_sec = elapsed_ns ? ops * 1e9 / elapsed_ns : 0.0;
+    printf("%-44s %12llu ops %12.1f ns/op %14.0f ops/s\n", name, (unsigned long long)ops, ns_per_op, ops_per_sec);
+    fflush(stdout);
+}
+
+//阻止编译器把结果优化掉
+static volatile uint64_t g_sink;
+
+//统计全局分配器的调用次数.new和new[]、各种delete成对替换,都经过counted_alloc/counted_free;
+//两者不内联,编译器在调用处看不到malloc/free,不会误报new与free不匹配(-Wmismatched-new-delete)
+static std::atomic<unsigned long long> g_allocs(0);
+
+__attribute__((noinline)) static void *counted_alloc(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) static void counted_free(void *p)
+{
+    free(p);
+}
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    return counted_alloc(size);
+}
+
+__attribute__((noinline)) void *operator new[](size_t size)
+{
+    return counted_alloc(size);
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    counted_free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept
+{
+    counted_free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    counted_free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept
+{
+    counted_free(p);
+}
+
+//---------------------------------------------------------------------------
+//http_conn解析
+//---------------------------------------------------------------------------
+
+//录制的典型请求报文
+static const char *recorded_get =
+    "GET /judge.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static const char *recorded_browser_get =
+    "GET /xxx.jpg HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/80.0 Safari/537.36\r\n"
+    "Accept: image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+    "Referer: http://127.0.0.1:9006/5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "\r\n";
+
+static const char *recorded_login =
+    "POST /2CGISQL.cgi HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 24\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "\r\n"
+    "user=bench1&passwd=pw791";
+
+//通过友元直接驱动http_conn的解析状态机,不经过socket
+class http_conn_bench
+{
+public:
+    //把报文放进读缓冲区,模拟read_once读完一个请求
+    static void load(http_conn &conn, const char *request)
+    {
+        conn.init();
+        size_t len = strlen(request);
+        memcpy(conn.m_read_buf, request, len);
+        conn.m_read_idx = (int)len;
+    }
+
+    //只测从状态机:把缓冲区切成行
+    static uint64_t parse_lines(http_conn &conn, const char *request)
+    {
+        load(conn, request);
+        uint64_t lines = 0;
+        while (conn.parse_line() == http_conn::LINE_OK)
+        {
+            conn.m_start_line = conn.m_checked_idx;
+            ++lines;
+        }
+        return lines;
+    }
+
+    //完整的主状态机,包括do_request里的路径拼接和stat
+    static int process_read(http_conn &conn, const char *request)
+    {
+        load(conn, request);
+        int ret = conn.process_read();
+        conn.unmap();
+        return ret;
+    }
+
+    //解析并生成完整响应,模拟工作线程处理一个请求
+    static int respond(http_conn &conn, const char *request)
+    {
+        load(conn, request);
+        http_conn::HTTP_CODE ret = conn.process_read();
+        conn.process_write(ret);
+        conn.unmap();
+        return ret + conn.m_write_idx;
+    }
+
+    //把连接直接置为握手完成的WebSocket连接并加入广播表
+    static void attach_websocket(http_conn &conn, int fd)
+    {
+        conn.m_sockfd = fd;
+        conn.m_ws_state = http_conn::WS_OPEN;
+        ws_hub::get_instance()->subscribe(&conn);
+    }
+
+    static size_t queue_capacity(http_conn &conn)
+    {
+        return conn.m_ws_queue.capacity() * sizeof(shared_body);
+    }
+};
+
+static void bench_http(const char *name, const char *request, bool full)
+{
+    if (!selected(name))
+        return;
+    static http_conn conn;
+    const uint64_t iters = full ? 100000 : 1000000;
+    uint64_t sink = 0;
+    uint64_t begin = now_ns();
+    for (uint64_t i = 0; i < iters; ++i)
+    {
+        if (full)
+            sink += http_conn_bench::process_read(conn, request);
+        else
+            sink += http_conn_bench::parse_lines(conn, request);
+    }
+    uint64_t elapsed = now_ns() - begin;
+    g_sink = sink;
+    report(name, iters, elapsed);
+}
+
+//预热后统计每个请求调用全局分配器的次数,以及请求内存池申请新内存块的次数,稳定运行时都应为0
+extern map<string, string> users;
+
+static void bench_allocs(const char *name, const char *request)
+{
+    if (!selected(name))
+        return;
+    static http_conn conn;
+    users["bench1"] = "pw791";
+    uint64_t sink = 0;
+    for (int i = 0; i < 100; ++i)
+        sink += http_conn_bench::respond(conn, request);
+
+    const uint64_t iters = 100000;
+    unsigned long long allocs = g_allocs.load();
+    unsigned long long blocks = arena::block_allocs().load();
+    uint64_t begin = now_ns();
+    for (uint64_t i = 0; i < iters; ++i)
+        sink += http_conn_bench::respond(conn, request);
+    uint64_t elapsed = now_ns() - begin;
+    allocs = g_allocs.load() - allocs;
+    blocks = arena::block_allocs().load() - blocks;
+    g_sink = sink;
+    report(name, iters, elapsed);
+    printf("%-44s %12.3f allocs/req %8llu arena blocks\n", "", (double)allocs / iters, blocks);
+}
+
+//---------------------------------------------------------------------------
+//页面模板
+//---------------------------------------------------------------------------
+
+static void bench_template()
+{
+    const char *name = "template/render";
+    if (!selected(name))
+        return;
+    string text = "<html><head><title>welcome</title></head><body>\n";
+    text += string(1500, 'x');
+    text += "<p>欢迎 {{ user }}</p><p>共有{{fans}}位粉丝</p>\n";
+    text += string(500, 'y');
+    text += "</body></html>\n";
+    html_template page;
+    if (!page.compile(text.data(), text.size()))
+    {
+        printf("%-44s compile failed\n", name);
+        return;
+    }
+    const char user[] = "bench<1>";
+    char escaped[sizeof(user) * 6];
+    struct iovec iov[html_template::MAX_SEGMENTS];
+    const uint64_t iters = 1000000;
+    uint64_t sink = 0;
+    uint64_t begin = now_ns();
+    for (uint64_t i = 0; i < iters; ++i)
+    {
+        const char *values[html_template::VAR_COUNT];
+        size_t lens[html_template::VAR_COUNT];
+        values[html_template::VAR_USER] = escaped;
+        lens[html_template::VAR_USER] = html_template::escape(user, sizeof(user) - 1, escaped);
+        values[html_template::VAR_FANS] = "12345";
+        lens[html_template::VAR_FANS] = 5;
+        size_t length;
+        sink += page.render(values, lens, iov, length) + length;
+    }
+    uint64_t elapsed = now_ns() - begin;
+    g_sink = sink;
+    report(name, iters, elapsed);
+}
+
+//---------------------------------------------------------------------------
+//WebSocket
+//---------------------------------------------------------------------------
+
+static void bench_ws_unmask(size_t len)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "websocket/unmask/%zu", len);
+    if (!selected(name))
+        return;
+    vector<char> payload(len, 'x');
+    const unsigned char key[4] = {0x12, 0x34, 0x56, 0x78};
+    const uint64_t iters = 1000000;
+    uint64_t begin = now_ns();
+    for (uint64_t i = 0; i < iters; ++i)
+        websocket::unmask(payload.data(), len, key);
+    uint64_t elapsed = now_ns() - begin;
+    g_sink = payload[len / 2];
+    report(name, iters, elapsed);
+    printf("%-44s %12.2f GB/s\n", "", elapsed ? (double)len * iters / elapsed : 0.0);
+}
+
+static void drain_clients(const vector<int> &clients)
+{
+    char buf[65536];
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        while (recv(clients[i], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        {
+        }
+    }
+}
+
+//N个订阅者各连一对socketpair,消息经publish和主线程的drain写到每个订阅者;
+//每轮发ROUND条后在计时之外读空客户端一侧,避免发送队列积压到上限
+static void bench_ws_broadcast(int subscribers)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "websocket/broadcast/subscribers=%d", subscribers);
+    if (!selected(name))
+        return;
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < (rlim_t)subscribers * 2 + 64)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < (rlim_t)subscribers * 2 + 64)
+        {
+            printf("%-44s skipped: RLIMIT_NOFILE %llu\n", name, (unsigned long long)limit.rlim_cur);
+            return;
+        }
+    }
+
+    reactor_queue *reactor = reactor_queue::get_instance();
+    ws_hub *hub = ws_hub::get_instance();
+    //eventfd在第一次取fd时创建,之前post会失败
+    reactor->fd();
+    //连接对象由服务器启动时一次分配,不计入每个WebSocket连接的内存
+    http_conn *conns = new http_conn[subscribers];
+    vector<int> servers(subscribers), clients(subscribers);
+    size_t heap_before = mallinfo2().uordblks;
+    for (int i = 0; i < subscribers; ++i)
+    {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        fcntl(sv[0], F_SETFL, O_NONBLOCK);
+        servers[i] = sv[0];
+        clients[i] = sv[1];
+        http_conn_bench::attach_websocket(conns[i], sv[0]);
+    }
+
+    const char message[] = "{\"event\":\"fan\",\"fans\":12345}";
+    const int ROUND = 50, rounds = subscribers >= 8000 ? 4 : 20;
+    uint64_t elapsed = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        uint64_t begin = now_ns();
+        for (int i = 0; i < ROUND; ++i)
+        {
+            hub->publish(message, sizeof(message) - 1);
+            reactor->drain();
+        }
+        elapsed += now_ns() - begin;
+        drain_clients(clients);
+    }
+    uint64_t deliveries = (uint64_t)subscribers * ROUND * rounds;
+    report(name, deliveries, elapsed);
+    printf("%-44s %12.0f messages/s %8llu dropped\n", "", elapsed ? ROUND * rounds * 1e9 / elapsed : 0.0,
+           hub->dropped());
+
+    //空闲连接:广播都已发完,只剩订阅者表的一项和保留的队列容量
+    size_t heap_after = mallinfo2().uordblks;
+    size_t queue_bytes = 0;
+    for (int i = 0; i < subscribers; ++i)
+        queue_bytes += http_conn_bench::queue_capacity(conns[i]);
+    printf("%-44s %12.1f heap bytes/idle websocket (%zu in queues), http_conn %zu bytes\n", "",
+           (double)(heap_after - heap_before) / subscribers, queue_bytes / subscribers, sizeof(http_conn));
+
+    for (int i = 0; i < subscribers; ++i)
+    {
+        conns[i].release();
+        close(servers[i]);
+        close(clients[i]);
+    }
+    delete[] conns;
+}
+
+//---------------------------------------------------------------------------
+//定时器链表
+//---------------------------------------------------------------------------
+
+static void noop_cb(client_data *) {}
+
+static void bench_timer(int size)
+{
+    char name[64];
+    vector<util_timer *> timers(size);
+    srand(size);
+
+    //add:随机超时时间插入,升序链表需要逐个比较
+    snprintf(name, sizeof(name), "timer/add/n=%d", size);
+    if (selected(name))
+    {
+        sort_timer_lst lst;
+        uint64_t begin = now_ns();
+        for (int i = 0; i < size; ++i)
+        {
+            util_timer *t = new util_timer;
+            t->expire = timer_now_ms() + 1000000 + rand() % 1000000;
+            t->cb_func = noop_cb;
+            t->user_data = NULL;
+            lst.add_timer(t);
+        }
+        report(name, size, now_ns() - begin);
+    }
+
+    //adjust:服务器每收到一次数据就把连接的超时时间延后3*TIMESLOT
+    snprintf(name, sizeof(name), "timer/adjust/n=%d", size);
+    if (selected(name))
+    {
+        sort_timer_lst lst;
+        long long base = timer_now_ms() + 1000000;
+        for (int i = 0; i < size; ++i)
+        {
+            util_timer *t = new util_timer;
+            t->expire = base + i;
+            t->cb_func = noop_cb;
+            t->user_data = NULL;
+            lst.add_timer(t);
+            timers[i] = t;
+        }
+        const int rounds = size < 10000 ? 100000 : 10000;
+        long long next = base + size;
+        uint64_t begin = now_ns();
+        for (int i = 0; i < rounds; ++i)
+        {
+            util_timer *t = timers[rand() % size];
+            t->expire = next++;
+            lst.adjust_timer(t);
+        }
+        report(name, rounds, now_ns() - begin);
+    }
+
+    //tick:全部到期,测量逐个回调并删除的开销
+    snprintf(name, sizeof(name), "timer/tick-expire-all/n=%d", size);
+    if (selected(name))
+    {
+        sort_timer_lst lst;
+        long long past = timer_now_ms() - 10;
+        for (int i = 0; i < size; ++i)
+        {
+            util_timer *t = new util_timer;
+            t->expire = past;
+            t->cb_func = noop_cb;
+            t->user_data = NULL;
+            lst.add_timer(t);
+        }
+        uint64_t begin = now_ns();
+        lst.tick();
+        report(name, size, now_ns() - begin);
+    }
+}
+
+//---------------------------------------------------------------------------
+//线程池
+//---------------------------------------------------------------------------
+
+//线程池要求任务类型提供process()
+struct round_trip_job
+{
+    sem_t *done;
+    void process()
+    {
+        sem_post(done);
+    }
+};
+
+static void bench_threadpool(int threads)
+{
+    char name[64];
+    sem_t done;
+    sem_init(&done, 0, 0);
+    //工作线程是detach的且一直阻塞在线程池的信号量上,线程池对象不能析构,故意不释放
+    threadpool<round_trip_job> &pool = *new threadpool<round_trip_job>(threads, 100000);
+
+    //单任务往返:append后等待工作线程处理完,体现信号量唤醒和跨核延迟
+    snprintf(name, sizeof(name), "threadpool/round-trip/threads=%d", threads);
+    if (selected(name))
+    {
+        round_trip_job job;
+        job.done = &done;
+        const int iters = 100000;
+        uint64_t begin = now_ns();
+        for (int i = 0; i < iters; ++i)
+        {
+            pool.append(&job);
+            sem_wait(&done);
+        }
+        report(name, iters, now_ns() - begin);
+    }
+
+    //批量派发:一次append一批再全部等完,体现队列锁的竞争
+    snprintf(name, sizeof(name), "threadpool/batch-dispatch/threads=%d", threads);
+    if (selected(name))
+    {
+        const int batch = 1000, rounds = 200;
+        vector<round_trip_job> jobs(batch);
+        for (int i = 0; i < batch; ++i)
+            jobs[i].done = &done;
+        uint64_t begin = now_ns();
+        for (int r = 0; r < rounds; ++r)
+        {
+            for (int i = 0; i < batch; ++i)
+            {
+                while (!pool.append(&jobs[i]))
+                    ;
+            }
+            for (int i = 0; i < batch; ++i)
+                sem_wait(&done);
+        }
+        report(name, (uint64_t)batch * rounds, now_ns() - begin);
+    }
+}
+
+//---------------------------------------------------------------------------
+//阻塞队列
+//---------------------------------------------------------------------------
+
+struct queue_arg
+{
+    block_queue<string> *queue;
+    int items;
+};
+
+static void *queue_producer(void *arg)
+{
+    queue_arg *qa = (queue_arg *)arg;
+    string item("2020-01-01 00:00:00.000000 [info]: GET /judge.html HTTP/1.1\n");
+    for (int i = 0; i < qa->items; ++i)
+    {
+        while (!qa->queue->push(item))
+            ;
+    }
+    return NULL;
+}
+
+static void *queue_consumer(void *arg)
+{
+    queue_arg *qa = (queue_arg *)arg;
+    string item;
+    for (int i = 0; i < qa->items; ++i)
+        qa->queue->pop(item);
+    return NULL;
+}
+
+static void bench_block_queue(int producers, int consumers)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "block_queue/push-pop/p=%d,c=%d", producers, consumers);
+    if (!selected(name))
+        return;
+
+    const int total = 1000000 / (producers * consumers) * (producers * consumers);
+    block_queue<string> queue(1000);
+    queue_arg pa = {&queue, total / producers};
+    queue_arg ca = {&queue, total / consumers};
+    vector<pthread_t> tids(producers + consumers);
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < consumers; ++i)
+        pthread_create(&tids[i], NULL, queue_consumer, &ca);
+    for (int i = 0; i < producers; ++i)
+        pthread_create(&tids[consumers + i], NULL, queue_producer, &pa);
+    for (size_t i = 0; i < tids.size(); ++i)
+        pthread_join(tids[i], NULL);
+    report(name, total, now_ns() - begin);
+}
+
+//---------------------------------------------------------------------------
+//日志
+//---------------------------------------------------------------------------
+
+static void bench_log(bool async_log)
+{
+    const char *name = async_log ? "log/write_log/async" : "log/write_log/sync";
+    if (!selected(name))
+        return;
+    const int iters = 200000;
+    uint64_t begin = now_ns();
+    for (int i = 0; i < iters; ++i)
+    {
+        LOG_INFO("%s %d", "GET /judge.html HTTP/1.1 from 127.0.0.1 port", i);
+    }
+    uint64_t elapsed = now_ns() - begin;
+    Log::get_instance()->flush();
+    report(name, iters, elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    bool async_log = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--async-log") == 0)
+            async_log = true;
+        else
+            g_filters.push_back(argv[i]);
+    }
+
+    //日志写到临时目录,不影响服务器日志;Log是单例,同一进程只能选一种模式
+    if (!Log::get_instance()->init("/tmp/microbench.log", 8192, 5000000, async_log ? 8192 : 0))
+    {
+        fprintf(stderr, "cannot open /tmp/microbench.log\n");
+        return 1;
+    }
+
+    bench_http("http_conn/parse_line/get", recorded_get, false);
+    bench_http("http_conn/parse_line/browser-get", recorded_browser_get, false);
+    bench_http("http_conn/parse_line/login-post", recorded_login, false);
+    bench_http("http_conn/process_read/get", recorded_get, true);
+    bench_http("http_conn/process_read/browser-get", recorded_browser_get, true);
+    bench_allocs("alloc/get", recorded_get);
+    bench_allocs("alloc/browser-get", recorded_browser_get);
+    bench_allocs("alloc/login-post", recorded_login);
+
+    bench_template();
+
+    bench_ws_unmask(64);
+    bench_ws_unmask(1024);
+    int ws_sizes[] = {1000, 8000, 50000};
+    for (size_t i = 0; i < sizeof(ws_sizes) / sizeof(ws_sizes[0]); ++i)
+        bench_ws_broadcast(ws_sizes[i]);
+
+    int timer_sizes[] = {100, 1000, 10000};
+    for (size_t i = 0; i < sizeof(timer_sizes) / sizeof(timer_sizes[0]); ++i)
+        bench_timer(timer_sizes[i]);
+
+    bench_threadpool(1);
+    bench_threadpool(8);
+
+    bench_block_queue(1, 1);
+    bench_block_queue(4, 1);
+    bench_block_queue(4, 4);
+
+    bench_log(async_log);
+
+    printf("# sink %llu\n", (unsigned long long)g_sink);
+    return 0;
+}
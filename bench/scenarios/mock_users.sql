@@ -0,0 +1,202 @@
+-- login.conf使用的压测用户,与users.txt一一对应
+INSERT IGNORE INTO user(username, passwd) VALUES
+('bench0', 'pw0000'),
+('bench1', 'pw7919'),
+('bench2', 'pw5838'),
+('bench3', 'pw3757'),
+('bench4', 'pw1676'),
+('bench5', 'pw9595'),
+('bench6', 'pw7514'),
+('bench7', 'pw5433'),
+('bench8', 'pw3352'),
+('bench9', 'pw1271'),
+('bench10', 'pw9190'),
+('bench11', 'pw7109'),
+('bench12', 'pw5028'),
+('bench13', 'pw2947'),
+('bench14', 'pw0866'),
+('bench15', 'pw8785'),
+('bench16', 'pw6704'),
+('bench17', 'pw4623'),
+('bench18', 'pw2542'),
+('bench19', 'pw0461'),
+('bench20', 'pw8380'),
+('bench21', 'pw6299'),
+('bench22', 'pw4218'),
+('bench23', 'pw2137'),
+('bench24', 'pw0056'),
+('bench25', 'pw7975'),
+('bench26', 'pw5894'),
+('bench27', 'pw3813'),
+('bench28', 'pw1732'),
+('bench29', 'pw9651'),
+('bench30', 'pw7570'),
+('bench31', 'pw5489'),
+('bench32', 'pw3408'),
+('bench33', 'pw1327'),
+('bench34', 'pw9246'),
+('bench35', 'pw7165'),
+('bench36', 'pw5084'),
+('bench37', 'pw3003'),
+('bench38', 'pw0922'),
+('bench39', 'pw8841'),
+('bench40', 'pw6760'),
+('bench41', 'pw4679'),
+('bench42', 'pw2598'),
+('bench43', 'pw0517'),
+('bench44', 'pw8436'),
+('bench45', 'pw6355'),
+('bench46', 'pw4274'),
+('bench47', 'pw2193'),
+('bench48', 'pw0112'),
+('bench49', 'pw8031'),
+('bench50', 'pw5950'),
+('bench51', 'pw3869'),
+('bench52', 'pw1788'),
+('bench53', 'pw9707'),
+('bench54', 'pw7626'),
+('bench55', 'pw5545'),
+('bench56', 'pw3464'),
+('bench57', 'pw1383'),
+('bench58', 'pw9302'),
+('bench59', 'pw7221'),
+('bench60', 'pw5140'),
+('bench61', 'pw3059'),
+('bench62', 'pw0978'),
+('bench63', 'pw8897'),
+('bench64', 'pw6816'),
+('bench65', 'pw4735'),
+('bench66', 'pw2654'),
+('bench67', 'pw0573'),
+('bench68', 'pw8492'),
+('bench69', 'pw6411'),
+('bench70', 'pw4330'),
+('bench71', 'pw2249'),
+('bench72', 'pw0168'),
+('bench73', 'pw8087'),
+('bench74', 'pw6006'),
+('bench75', 'pw3925'),
+('bench76', 'pw1844'),
+('bench77', 'pw9763'),
+('bench78', 'pw7682'),
+('bench79', 'pw5601'),
+('bench80', 'pw3520'),
+('bench81', 'pw1439'),
+('bench82', 'pw9358'),
+('bench83', 'pw7277'),
+('bench84', 'pw5196'),
+('bench85', 'pw3115'),
+('bench86', 'pw1034'),
+('bench87', 'pw8953'),
+('bench88', 'pw6872'),
+('bench89', 'pw4791'),
+('bench90', 'pw2710'),
+('bench91', 'pw0629'),
+('bench92', 'pw8548'),
+('bench93', 'pw6467'),
+('bench94', 'pw4386'),
+('bench95', 'pw2305'),
+('bench96', 'pw0224'),
+('bench97', 'pw8143'),
+('bench98', 'pw6062'),
+('bench99', 'pw3981'),
+('bench100', 'pw1900'),
+('bench101', 'pw9819'),
+('bench102', 'pw7738'),
+('bench103', 'pw5657'),
+('bench104', 'pw3576'),
+('bench105', 'pw1495'),
+('bench106', 'pw9414'),
+('bench107', 'pw7333'),
+('bench108', 'pw5252'),
+('bench109', 'pw3171'),
+('bench110', 'pw1090'),
+('bench111', 'pw9009'),
+('bench112', 'pw6928'),
+('bench113', 'pw4847'),
+('bench114', 'pw2766'),
+('bench115', 'pw0685'),
+('bench116', 'pw8604'),
+('bench117', 'pw6523'),
+('bench118', 'pw4442'),
+('bench119', 'pw2361'),
+('bench120', 'pw0280'),
+('bench121', 'pw8199'),
+('bench122', 'pw6118'),
+('bench123', 'pw4037'),
+('bench124', 'pw1956'),
+('bench125', 'pw9875'),
+('bench126', 'pw7794'),
+('bench127', 'pw5713'),
+('bench128', 'pw3632'),
+('bench129', 'pw1551'),
+('bench130', 'pw9470'),
+('bench131', 'pw7389'),
+('bench132', 'pw5308'),
+('bench133', 'pw3227'),
+('bench134', 'pw1146'),
+('bench135', 'pw9065'),
+('bench136', 'pw6984'),
+('bench137', 'pw4903'),
+('bench138', 'pw2822'),
+('bench139', 'pw0741'),
+('bench140', 'pw8660'),
+('bench141', 'pw6579'),
+('bench142', 'pw4498'),
+('bench143', 'pw2417'),
+('bench144', 'pw0336'),
+('bench145', 'pw8255'),
+('bench146', 'pw6174'),
+('bench147', 'pw4093'),
+('bench148', 'pw2012'),
+('bench149', 'pw9931'),
+('bench150', 'pw7850'),
+('bench151', 'pw5769'),
+('bench152', 'pw3688'),
+('bench153', 'pw1607'),
+('bench154', 'pw9526'),
+('bench155', 'pw7445'),
+('bench156', 'pw5364'),
+('bench157', 'pw3283'),
+('bench158', 'pw1202'),
+('bench159', 'pw9121'),
+('bench160', 'pw7040'),
+('bench161', 'pw4959'),
+('bench162', 'pw2878'),
+('bench163', 'pw0797'),
+('bench164', 'pw8716'),
+('bench165', 'pw6635'),
+('bench166', 'pw4554'),
+('bench167', 'pw2473'),
+('bench168', 'pw0392'),
+('bench169', 'pw8311'),
+('bench170', 'pw6230'),
+('bench171', 'pw4149'),
+('bench172', 'pw2068'),
+('bench173', 'pw9987'),
+('bench174', 'pw7906'),
+('bench175', 'pw5825'),
+('bench176', 'pw3744'),
+('bench177', 'pw1663'),
+('bench178', 'pw9582'),
+('bench179', 'pw7501'),
+('bench180', 'pw5420'),
+('bench181', 'pw3339'),
+('bench182', 'pw1258'),
+('bench183', 'pw9177'),
+('bench184', 'pw7096'),
+('bench185', 'pw5015'),
+('bench186', 'pw2934'),
+('bench187', 'pw0853'),
+('bench188', 'pw8772'),
+('bench189', 'pw6691'),
+('bench190', 'pw4610'),
+('bench191', 'pw2529'),
+('bench192', 'pw0448'),
+('bench193', 'pw8367'),
+('bench194', 'pw6286'),
+('bench195', 'pw4205'),
+('bench196', 'pw2124'),
+('bench197', 'pw0043'),
+('bench198', 'pw7962'),
+('bench199', 'pw5881');
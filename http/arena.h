@@ -0,0 +1,145 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <atomic>
+
+//请求级的内存池:按指针递增分配,不逐个释放,请求结束时reset一次性回收.
+//内存块在reset后保留给下一个请求,稳定运行时不再调用全局分配器;
+//只有单个请求用量超过已有内存块时才申请新块,次数记在counters中
+class arena{
+public:
+    static const size_t BLOCK_SIZE=4096;
+
+    arena():m_head(NULL),m_cur(NULL),m_pos(0),m_used(0),m_peak(0){}
+    ~arena(){
+        while(m_head){
+            block *next=m_head->next;
+            free(m_head);
+            m_head=next;
+        }
+    }
+
+    //分配size字节,按align对齐,内存不足时返回NULL
+    void *alloc(size_t size,size_t align=sizeof(void *)){
+        if(m_cur){
+            size_t pos=(m_pos+align-1)&~(align-1);
+            if(pos+size<=m_cur->size){
+                m_pos=pos+size;
+                m_used+=size;
+                return m_cur->data()+pos;
+            }
+        }
+        if(!next_block(size+align)) return NULL;
+        return alloc(size,align);
+    }
+
+    //复制一个字符串
+    char *strdup(const char *s,size_t len){
+        char *p=(char *)alloc(len+1,1);
+        if(!p) return NULL;
+        memcpy(p,s,len);
+        p[len]='\0';
+        return p;
+    }
+    char *strdup(const char *s){
+        return strdup(s,strlen(s));
+    }
+
+    //格式化到池中,先尝试写进当前块的剩余空间,放不下再按实际长度分配
+    char *printf(const char *format,...){
+        va_list ap;
+        va_start(ap,format);
+        char *p=vprintf(format,ap);
+        va_end(ap);
+        return p;
+    }
+    char *vprintf(const char *format,va_list ap){
+        va_list copy;
+        va_copy(copy,ap);
+        size_t room=m_cur?m_cur->size-m_pos:0;
+        int n=vsnprintf(room?m_cur->data()+m_pos:NULL,room,format,copy);
+        va_end(copy);
+        if(n<0) return NULL;
+        if((size_t)n<room){
+            char *p=m_cur->data()+m_pos;
+            m_pos+=n+1;
+            m_used+=n+1;
+            return p;
+        }
+        char *p=(char *)alloc(n+1,1);
+        if(!p) return NULL;
+        vsnprintf(p,n+1,format,ap);
+        return p;
+    }
+
+    //回收本次请求的全部分配,内存块留给下一次
+    void reset(){
+        if(m_used>m_peak) m_peak=m_used;
+        m_cur=m_head;
+        m_pos=0;
+        m_used=0;
+    }
+
+    //统计信息
+    size_t used() const { return m_used; }
+    size_t peak() const { return m_used>m_peak?m_used:m_peak; }
+    size_t capacity() const {
+        size_t n=0;
+        for(block *b=m_head;b;b=b->next) n+=b->size;
+        return n;
+    }
+
+    //所有arena向全局分配器申请内存块的次数,稳定运行时应当不再增长
+    static std::atomic<unsigned long long> &block_allocs(){
+        static std::atomic<unsigned long long> count(0);
+        return count;
+    }
+
+private:
+    struct block{
+        block *next;
+        size_t size;
+        char *data() { return (char *)(this+1); }
+    };
+
+    //切换到下一个能容纳need字节的块,后面的块都不够大时新申请一块插在当前块之后
+    bool next_block(size_t need){
+        block *b=m_cur?m_cur->next:m_head;
+        while(b&&b->size<need) b=b->next;
+        if(!b){
+            size_t size=need>BLOCK_SIZE?need:BLOCK_SIZE;
+            b=(block *)malloc(sizeof(block)+size);
+            if(!b) return false;
+            b->size=size;
+            block_allocs().fetch_add(1,std::memory_order_relaxed);
+            if(m_cur){
+                b->next=m_cur->next;
+                m_cur->next=b;
+            }
+            else{
+                b->next=m_head;
+                m_head=b;
+            }
+        }
+        m_cur=b;
+        m_pos=0;
+        return true;
+    }
+
+    arena(const arena &);
+    arena &operator=(const arena &);
+
+private:
+    block *m_head;      //第一个内存块
+    block *m_cur;       //当前分配的内存块
+    size_t m_pos;       //当前块中已用的字节数
+    size_t m_used;      //本次请求分配的字节数
+    size_t m_peak;      //单个请求用量的最大值
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "http_conn.h"
+
+//协程风格的路由处理器,只在-std=c++20下编译
+#ifdef COROUTINE_HANDLERS
+#include <map>
+#include <string>
+#include "coroutine.h"
+
+using namespace std;
+
+extern map<string, string> users;
+extern locker m_lock;
+
+//协程版的登录:内存表未命中时的数据库查询交给阻塞执行器,
+//挂起期间工作线程去处理别的请求,恢复后在主线程上继续.
+//执行器上的函数只使用拷贝的用户名,不访问连接,连接在等待期间被关闭也不受影响
+http_conn::HTTP_CODE http_conn::do_co_login(const char *){
+    if(cgi!=1) return do_file(m_url);
+    //HTTP/2的流在会话中依次分派,不能挂起,按同步方式校验
+    if(m_h2) return do_login(NULL);
+    return login_flow().start();
+}
+
+handler_task http_conn::login_flow(){
+    const char *name_arg, *password_arg;
+    if(!parse_user(m_string,m_content_length,name_arg,password_arg)) co_return do_file("/logError.html");
+    //两者都指向读缓冲区,连接关闭或换人后内容就变了,挂起前拷贝到协程帧中
+    string name(name_arg), password(password_arg);
+
+    m_lock.lock();
+    map<string, string>::iterator it=users.find(name);
+    bool found=(it!=users.end());
+    bool ok=(found&&it->second==password);
+    m_lock.unlock();
+    //第一次挂起之前仍在工作线程上,可以直接取文件
+    if(found){
+        if(ok) start_session(name.c_str());
+        co_return do_file(ok?"/welcome.html":"/logError.html");
+    }
+
+    //只捕获指向帧内name的指针:co_await表达式里的临时对象会被按位搬进协程帧,带堆/SSO指针的成员析构时会出错
+    const char *key=name.c_str();
+    if(co_await offload([key](){ return load_user(key); })){
+        m_lock.lock();
+        it=users.find(name);
+        ok=(it!=users.end()&&it->second==password);
+        m_lock.unlock();
+    }
+
+    //能恢复到这里说明连接还是挂起前的那个,见handler_task::resume
+    if(ok) start_session(name.c_str());
+    //已回到主线程:按I/O线程的方式只查最近校验过的缓存,不做文件I/O.
+    //未命中时把请求改成对结果页面的普通请求,由finish_async交回线程池从do_request继续
+    const char *page=ok?"/welcome.html":"/logError.html";
+    m_inline=true;
+    HTTP_CODE ret=do_file(page);
+    m_inline=false;
+    if(ret==DEFER_REQUEST){
+        unmap();
+        m_url=(char *)page;
+        cgi=0;
+    }
+    co_return ret;
+}
+#endif
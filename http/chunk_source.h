@@ -0,0 +1,22 @@
+#ifndef CHUNK_SOURCE_H
+#define CHUNK_SOURCE_H
+
+#include <stddef.h>
+#include <string>
+
+//分块响应(Transfer-Encoding:chunked)的内容生成器.
+//处理器返回http_conn::stream(source)后先发送报头,之后每发完一块,write再调用一次next取下一块,
+//套接字写不动时停在EPOLLOUT上,生成器不会跑在网络前面,内存中最多只有一块.
+//next在主线程上调用,不能阻塞,每块不要超过MAX_CHUNK
+class chunk_source
+{
+public:
+    static const size_t MAX_CHUNK = 16 * 1024;
+
+    virtual ~chunk_source() {}
+
+    //把下一块内容追加到out,返回false表示这是最后一块(本次可以不追加任何内容)
+    virtual bool next(std::string &out) = 0;
+};
+
+#endif
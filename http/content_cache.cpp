@@ -0,0 +1,150 @@
+#include "content_cache.h"
+#include "fnv.h"
+#include <string.h>
+#include <stdio.h>
+#include <zlib.h>
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+using namespace std;
+
+content_cache::content_cache()
+    : m_cache(64 * 1024 * 1024), m_hits(0), m_misses(0)
+{
+}
+
+void content_cache::init(size_t max_bytes)
+{
+    m_lock.lock();
+    m_cache.set_capacity(max_bytes);
+    m_lock.unlock();
+}
+
+const char *content_cache::encoding_name(CONTENT_ENCODING encoding)
+{
+    switch (encoding)
+    {
+    case ENCODING_GZIP:
+        return "gzip";
+    case ENCODING_BR:
+        return "br";
+    default:
+        return "identity";
+    }
+}
+
+//gzip使用zlib的deflate并带gzip头(windowBits=15+16),brotli使用中等质量兼顾压缩时间
+bool content_cache::compress(CONTENT_ENCODING encoding, const char *data, size_t len, string &out)
+{
+    if (encoding == ENCODING_GZIP)
+    {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        out.resize(deflateBound(&zs, len));
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = len;
+        zs.next_out = (Bytef *)&out[0];
+        zs.avail_out = out.size();
+        int ret = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return ret == Z_STREAM_END;
+    }
+#ifdef USE_BROTLI
+    if (encoding == ENCODING_BR)
+    {
+        size_t out_len = BrotliEncoderMaxCompressedSize(len);
+        if (out_len == 0)
+            return false;
+        out.resize(out_len);
+        if (!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t *)data,
+                                   &out_len, (uint8_t *)&out[0]))
+            return false;
+        out.resize(out_len);
+        return true;
+    }
+#endif
+    return false;
+}
+
+//FNV-1a,编码作为最后一个字节接着哈希
+uint64_t content_cache::hash(const char *path, size_t len, CONTENT_ENCODING encoding)
+{
+    char tail = (char)encoding;
+    return fnv1a(&tail, 1, fnv1a(path, len));
+}
+
+content_cache::cache_type::iterator content_cache::find(const char *path, size_t len, CONTENT_ENCODING encoding, uint64_t h)
+{
+    return m_cache.find(h, [path, len, encoding](const entry &e) {
+        return e.encoding == encoding && e.path.size() == len && memcmp(e.path.data(), path, len) == 0;
+    });
+}
+
+shared_body content_cache::get(const char *path, time_t mtime, off_t size, CONTENT_ENCODING encoding)
+{
+    size_t len = strlen(path);
+    uint64_t h = hash(path, len, encoding);
+
+    m_lock.lock();
+    cache_type::iterator it = find(path, len, encoding, h);
+    if (it == m_cache.end() || it->value.mtime != mtime || it->value.size != size)
+    {
+        ++m_misses;
+        m_lock.unlock();
+        return shared_body();
+    }
+    m_cache.touch(it);
+    shared_body body = it->value.body;
+    ++m_hits;
+    m_lock.unlock();
+    return body;
+}
+
+shared_body content_cache::put(const char *path, time_t mtime, off_t size, CONTENT_ENCODING encoding, const char *data)
+{
+    //同一版本、同一编码的并发未命中只压缩一次,其余请求等待并共享结果
+    char version[64];
+    snprintf(version, sizeof(version), "|%d|%lld|%lld", (int)encoding, (long long)mtime, (long long)size);
+    string key(path);
+    key += version;
+    return m_flight.run(key, [&]() { return fill(path, mtime, size, encoding, data); });
+}
+
+//压缩并放入缓存
+shared_body content_cache::fill(const char *path, time_t mtime, off_t size, CONTENT_ENCODING encoding, const char *data)
+{
+    //压缩在锁外进行
+    std::shared_ptr<string> out(new string);
+    if (!compress(encoding, data, size, *out) || out->size() >= (size_t)size)
+    {
+        //压缩失败或不划算时缓存一个空结果,下次直接发原文件
+        out->clear();
+    }
+    else
+    {
+        out->shrink_to_fit();
+    }
+    shared_body body = out;
+
+    size_t len = strlen(path);
+    entry e;
+    e.path.assign(path, len);
+    e.encoding = encoding;
+    e.mtime = mtime;
+    e.size = size;
+    e.body = body;
+
+    uint64_t h = hash(path, len, encoding);
+
+    m_lock.lock();
+    cache_type::iterator it = find(path, len, encoding, h);
+    if (it != m_cache.end())
+        m_cache.erase(it);
+    m_cache.insert(h, body->size(), e);
+    m_lock.unlock();
+    return body;
+}
@@ -0,0 +1,87 @@
+#ifndef CONTENT_CACHE_H
+#define CONTENT_CACHE_H
+
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <memory>
+#include "../lock/locker.h"
+#include "../lock/single_flight.h"
+#include "lru_cache.h"
+
+//启用brotli压缩,需要链接libbrotlienc
+#define USE_BROTLI
+
+//内容编码,数值同时作为Accept-Encoding解析结果的位标志
+enum CONTENT_ENCODING
+{
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP = 1,
+    ENCODING_BR = 2
+};
+
+//编码后的响应体,多个连接可以同时持有同一份
+typedef std::shared_ptr<const std::string> shared_body;
+
+//压缩结果缓存:以路径+编码为键,记录源文件的mtime和大小,文件改动后旧结果自动失效
+//按字节数限制总大小,超出时按LRU淘汰
+class content_cache
+{
+public:
+    //单个文件超过这个大小就不做即时压缩,避免一次请求压缩过久
+    static const size_t MAX_FILE_SIZE = 1024 * 1024;
+
+    static content_cache *get_instance()
+    {
+        static content_cache instance;
+        return &instance;
+    }
+
+    //设置缓存容量,默认64MB
+    void init(size_t max_bytes);
+
+    //查找file在mtime/size版本下按encoding压缩的结果
+    //命中且值得压缩时返回压缩后的内容;命中但压缩后不比原文件小时返回空内容的body;未命中返回NULL
+    shared_body get(const char *path, time_t mtime, off_t size, CONTENT_ENCODING encoding);
+
+    //压缩data并放入缓存,返回值含义同get
+    shared_body put(const char *path, time_t mtime, off_t size, CONTENT_ENCODING encoding, const char *data);
+
+    //统计信息
+    size_t bytes() const { return m_cache.bytes(); }
+    unsigned long long hits() const { return m_hits; }
+    unsigned long long misses() const { return m_misses; }
+    unsigned long long coalesced() const { return m_flight.coalesced(); }
+
+    static const char *encoding_name(CONTENT_ENCODING encoding);
+    static bool compress(CONTENT_ENCODING encoding, const char *data, size_t len, std::string &out);
+
+private:
+    content_cache();
+    ~content_cache() {}
+
+    struct entry
+    {
+        std::string path;
+        CONTENT_ENCODING encoding;
+        time_t mtime;
+        off_t size;
+        shared_body body;
+    };
+    typedef lru_cache<entry> cache_type;
+
+    //按路径和编码的哈希查找,调用者需持有m_lock
+    static uint64_t hash(const char *path, size_t len, CONTENT_ENCODING encoding);
+    cache_type::iterator find(const char *path, size_t len, CONTENT_ENCODING encoding, uint64_t h);
+    shared_body fill(const char *path, time_t mtime, off_t size, CONTENT_ENCODING encoding, const char *data);
+
+private:
+    locker m_lock;
+    cache_type m_cache;         //路径和编码的哈希 -> 压缩结果,按压缩后大小计入容量
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    single_flight<shared_body> m_flight;   //合并同一文件并发的压缩
+};
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef HTTP_COROUTINE_H
+#define HTTP_COROUTINE_H
+
+//协程风格的路由处理器,需要-std=c++20.
+//处理器是http_conn的成员协程,返回handler_task,可以co_await:
+//  offload(fn)         在阻塞执行器上运行fn(如数据库查询、读文件),返回fn的结果
+//  load_file(mapping,addr,len) 由file_loader把mmap的区间读入内存
+//  read_more(conn)     等待socket上的新数据,返回是否读到
+//等待结束后统一通过reactor_queue回到主线程恢复,工作线程不会为等待而阻塞.
+//处理器co_return的HTTP_CODE若在第一次挂起前得到,由start直接返回给do_request;
+//否则在主线程上调用finish_async填写响应.协程帧从frame_pool分配
+#include <stddef.h>
+#include <coroutine>
+#include <utility>
+#include "http_conn.h"
+#include "reactor_queue.h"
+#include "file_loader.h"
+#include "../threadpool/threadpool.h"
+
+//协程帧的内存池:按256字节分级的空闲链表,帧在工作线程分配、在主线程释放,因此加锁
+class frame_pool
+{
+public:
+    static const size_t GRANULE = 256;
+    static const size_t CLASSES = 16;   //最大4KB,更大的帧直接用全局分配器
+
+    static void *allocate(size_t size)
+    {
+        size_t c = (size + GRANULE - 1) / GRANULE;
+        if (c == 0 || c > CLASSES)
+            return ::operator new(size);
+        frame_pool &p = instance();
+        p.m_lock.lock();
+        node *n = p.m_free[c - 1];
+        if (n)
+        {
+            p.m_free[c - 1] = n->next;
+            ++p.m_reused;
+            p.m_lock.unlock();
+            return n;
+        }
+        ++p.m_fresh;
+        p.m_lock.unlock();
+        return ::operator new(c * GRANULE);
+    }
+
+    static void deallocate(void *ptr, size_t size)
+    {
+        size_t c = (size + GRANULE - 1) / GRANULE;
+        if (c == 0 || c > CLASSES)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        frame_pool &p = instance();
+        node *n = (node *)ptr;
+        p.m_lock.lock();
+        n->next = p.m_free[c - 1];
+        p.m_free[c - 1] = n;
+        p.m_lock.unlock();
+    }
+
+    //统计信息:向全局分配器申请的次数和复用的次数
+    static unsigned long long fresh() { return instance().m_fresh; }
+    static unsigned long long reused() { return instance().m_reused; }
+
+private:
+    struct node
+    {
+        node *next;
+    };
+
+    frame_pool() : m_fresh(0), m_reused(0)
+    {
+        for (size_t i = 0; i < CLASSES; ++i)
+            m_free[i] = NULL;
+    }
+
+    static frame_pool &instance()
+    {
+        static frame_pool pool;
+        return pool;
+    }
+
+private:
+    locker m_lock;
+    node *m_free[CLASSES];
+    unsigned long long m_fresh;
+    unsigned long long m_reused;
+};
+
+class handler_task
+{
+public:
+    struct promise_type
+    {
+        http_conn *conn;
+        http_conn::HTTP_CODE result;
+        bool suspended;                 //是否挂起过,挂起后结果交给finish_async
+        unsigned generation;            //挂起时连接的代号
+        http_conn::HTTP_CODE *sync_out; //没有挂起时结果写到这里
+
+        //成员协程的第一个参数是对象本身
+        template<typename... Args>
+        promise_type(http_conn &c, Args &&...)
+            : conn(&c), result(http_conn::INTERNAL_ERROR), suspended(false), generation(0), sync_out(NULL)
+        {
+        }
+
+        static void *operator new(size_t size) { return frame_pool::allocate(size); }
+        static void operator delete(void *ptr, size_t size) { frame_pool::deallocate(ptr, size); }
+
+        handler_task get_return_object()
+        {
+            return handler_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        //结束时交出结果并销毁协程帧
+        struct final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                promise_type &p = h.promise();
+                http_conn *conn = p.conn;
+                http_conn::HTTP_CODE result = p.result;
+                bool suspended = p.suspended;
+                http_conn::HTTP_CODE *out = p.sync_out;
+                h.destroy();
+                if (suspended)
+                    conn->finish_async(result);
+                else
+                    *out = result;
+            }
+            void await_resume() noexcept {}
+        };
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(http_conn::HTTP_CODE code) { result = code; }
+        void unhandled_exception() { result = http_conn::INTERNAL_ERROR; }
+    };
+
+    typedef std::coroutine_handle<promise_type> handle;
+
+    handler_task(handler_task &&other) : m_handle(other.m_handle) { other.m_handle = handle(); }
+    ~handler_task()
+    {
+        //没有start的协程由这里销毁
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    //运行到第一次挂起或结束;结束时返回结果,挂起时返回ASYNC_REQUEST
+    http_conn::HTTP_CODE start()
+    {
+        http_conn::HTTP_CODE out = http_conn::ASYNC_REQUEST;
+        handle h = m_handle;
+        m_handle = handle();
+        h.promise().sync_out = &out;
+        h.resume();
+        return out;
+    }
+
+    //在主线程上恢复挂起的协程.等待期间连接被关闭(可能已经换成了新的连接)时
+    //只销毁协程帧,不再碰这个连接;帧中引用连接的只有this,局部变量都是拷贝
+    static void resume(void *address)
+    {
+        handle h = handle::from_address(address);
+        if (h.promise().conn->generation() != h.promise().generation)
+        {
+            h.destroy();
+            return;
+        }
+        h.resume();
+    }
+
+    //等待体挂起前调用,此后协程可能在其他线程恢复
+    static void mark_suspended(handle h)
+    {
+        h.promise().suspended = true;
+        h.promise().generation = h.promise().conn->generation();
+    }
+
+private:
+    explicit handler_task(handle h) : m_handle(h) {}
+    handler_task(const handler_task &);
+    handler_task &operator=(const handler_task &);
+
+    handle m_handle;
+};
+
+//执行阻塞操作的线程池,与处理请求的工作线程分开
+struct async_job
+{
+    virtual void process() = 0;
+    virtual ~async_job() {}
+};
+
+inline threadpool<async_job> &blocking_executor()
+{
+    static threadpool<async_job> *pool = new threadpool<async_job>(4, 10000, 64);
+    return *pool;
+}
+
+template<typename F>
+class offload_awaiter : public async_job
+{
+public:
+    typedef decltype(std::declval<F &>()()) result_type;
+
+    explicit offload_awaiter(F fn) : m_fn(std::move(fn)) {}
+
+    bool await_ready() { return false; }
+
+    //执行器拒绝时就地执行,不挂起
+    bool await_suspend(handler_task::handle h)
+    {
+        m_handle = h;
+        handler_task::mark_suspended(h);
+        if (blocking_executor().append(this))
+            return true;
+        m_result = m_fn();
+        return false;
+    }
+
+    result_type await_resume() { return std::move(m_result); }
+
+    //在执行器线程上运行,完成后回到主线程恢复
+    void process()
+    {
+        m_result = m_fn();
+        reactor_queue::get_instance()->post(handler_task::resume, m_handle.address());
+    }
+
+private:
+    F m_fn;
+    result_type m_result;
+    handler_task::handle m_handle;
+};
+
+template<typename F>
+offload_awaiter<F> offload(F fn)
+{
+    return offload_awaiter<F>(std::move(fn));
+}
+
+//通过映射的文件描述符把区间读入页缓存,已驻留时不挂起;区间在mapping之内,加载期间映射由任务持有
+class load_file_awaiter
+{
+public:
+    load_file_awaiter(const file_mapping &mapping, const void *addr, size_t len)
+        : m_mapping(mapping), m_addr(addr), m_len(len) {}
+
+    bool await_ready() { return file_loader::resident(m_addr, m_len); }
+
+    bool await_suspend(handler_task::handle h)
+    {
+        handler_task::mark_suspended(h);
+        return file_loader::get_instance()->submit(m_mapping, m_addr, m_len, loaded, h.address(), 0);
+    }
+
+    void await_resume() {}
+
+private:
+    static void loaded(void *address, unsigned)
+    {
+        reactor_queue::get_instance()->post(handler_task::resume, address);
+    }
+
+    file_mapping m_mapping;
+    const void *m_addr;
+    size_t m_len;
+};
+
+inline load_file_awaiter load_file(const file_mapping &mapping, const void *addr, size_t len)
+{
+    return load_file_awaiter(mapping, addr, len);
+}
+
+//等待socket上的新数据,主线程read_once后恢复,返回false表示连接已关闭
+class read_more_awaiter
+{
+public:
+    explicit read_more_awaiter(http_conn &conn) : m_conn(conn) {}
+
+    bool await_ready() { return false; }
+
+    void await_suspend(handler_task::handle h)
+    {
+        handler_task::mark_suspended(h);
+        m_conn.wait_readable(handler_task::resume, h.address());
+    }
+
+    bool await_resume() { return m_conn.reader_ok(); }
+
+private:
+    http_conn &m_conn;
+};
+
+inline read_more_awaiter read_more(http_conn &conn)
+{
+    return read_more_awaiter(conn);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "file_cache.h"
+#include "fnv.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+using namespace std;
+
+file_cache::file_cache()
+    : m_cache(32 * 1024 * 1024), m_revalidate_ms(1000), m_hits(0), m_misses(0)
+{
+}
+
+void file_cache::init(size_t max_bytes, int revalidate_ms)
+{
+    m_lock.lock();
+    m_cache.set_capacity(max_bytes);
+    m_revalidate_ms = revalidate_ms;
+    m_lock.unlock();
+}
+
+long long file_cache::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//把整个文件读入out,文件在读取过程中变短视为失败
+bool file_cache::read_file(const char *path, size_t size, string &out)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    out.resize(size);
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = pread(fd, &out[done], size - done, done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    return done == size;
+}
+
+file_cache::cache_type::iterator file_cache::find(const char *path, size_t len, uint64_t h)
+{
+    return m_cache.find(h, [path, len](const node &n) {
+        return n.path.size() == len && memcmp(n.path.data(), path, len) == 0;
+    });
+}
+
+bool file_cache::get_fresh(const char *path, file_entry &out)
+{
+    size_t len = strlen(path);
+    uint64_t h = fnv1a(path, len);
+    long long now = now_ms();
+
+    m_lock.lock();
+    cache_type::iterator it = find(path, len, h);
+    if (it == m_cache.end() || now - it->value.checked_ms > m_revalidate_ms)
+    {
+        m_lock.unlock();
+        return false;
+    }
+    m_cache.touch(it);
+    out = it->value.entry;
+    ++m_hits;
+    m_lock.unlock();
+    return true;
+}
+
+bool file_cache::load(const char *path, const struct stat &st, const mime_type *mime, file_entry &out)
+{
+    if ((size_t)st.st_size > MAX_FILE_SIZE)
+        return false;
+    size_t len = strlen(path);
+    uint64_t h = fnv1a(path, len);
+
+    m_lock.lock();
+    cache_type::iterator it = find(path, len, h);
+    if (it != m_cache.end() && it->value.entry.mtime == st.st_mtime && it->value.entry.size == st.st_size)
+    {
+        it->value.checked_ms = now_ms();
+        m_cache.touch(it);
+        out = it->value.entry;
+        ++m_hits;
+        m_lock.unlock();
+        return true;
+    }
+    ++m_misses;
+    m_lock.unlock();
+
+    //同一版本的文件并发未命中时只读一次,其余请求等待并共享结果
+    char version[48];
+    snprintf(version, sizeof(version), "|%lld|%lld", (long long)st.st_mtime, (long long)st.st_size);
+    string key(path, len);
+    key += version;
+    shared_body data = m_flight.run(key, [&]() { return fill(path, len, h, st, mime); });
+    if (!data)
+        return false;
+    out.data = data;
+    out.mtime = st.st_mtime;
+    out.size = st.st_size;
+    out.mime = mime;
+    return true;
+}
+
+//读入文件并放入缓存,失败返回NULL
+shared_body file_cache::fill(const char *path, size_t len, uint64_t h, const struct stat &st, const mime_type *mime)
+{
+    //读文件在锁外进行
+    std::shared_ptr<string> data(new string);
+    if (!read_file(path, st.st_size, *data))
+        return shared_body();
+
+    node n;
+    n.path.assign(path, len);
+    n.entry.data = data;
+    n.entry.mtime = st.st_mtime;
+    n.entry.size = st.st_size;
+    n.entry.mime = mime;
+    n.checked_ms = now_ms();
+
+    m_lock.lock();
+    cache_type::iterator it = find(path, len, h);
+    if (it != m_cache.end())
+        m_cache.erase(it);
+    m_cache.insert(h, st.st_size, n);
+    m_lock.unlock();
+    return data;
+}
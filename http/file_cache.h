@@ -0,0 +1,82 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include "../lock/locker.h"
+#include "../lock/single_flight.h"
+#include "content_cache.h"
+#include "lru_cache.h"
+#include "mime.h"
+
+//缓存的静态文件
+struct file_entry
+{
+    shared_body data;           //文件内容,多个连接可同时持有
+    time_t mtime;               //源文件的修改时间
+    off_t size;                 //源文件大小
+    const mime_type *mime;      //文件类型,含预先拼好的Content-Type报头
+};
+
+//小文件内容缓存:文件内容读入内存后,后续请求不再open/mmap,也不会在发送时触发缺页.
+//工作线程每次stat后调用load校验并刷新;I/O线程调用get_fresh,只使用最近校验过的项,
+//不做任何系统调用,因此可以在I/O线程上直接应答.按字节数限制总大小,超出时按LRU淘汰
+class file_cache
+{
+public:
+    //超过这个大小的文件不缓存,仍然mmap发送
+    static const size_t MAX_FILE_SIZE = 256 * 1024;
+
+    static file_cache *get_instance()
+    {
+        static file_cache instance;
+        return &instance;
+    }
+
+    //设置容量和I/O线程可信任一次校验结果的时长,默认32MB、1秒
+    void init(size_t max_bytes, int revalidate_ms);
+
+    //不做系统调用的查找,只返回revalidate_ms内校验过的项
+    bool get_fresh(const char *path, file_entry &out);
+
+    //path已经stat过,内容未变时返回缓存项并刷新校验时间,否则读入文件放入缓存
+    bool load(const char *path, const struct stat &st, const mime_type *mime, file_entry &out);
+
+    //统计信息
+    size_t bytes() const { return m_cache.bytes(); }
+    unsigned long long hits() const { return m_hits; }
+    unsigned long long misses() const { return m_misses; }
+    unsigned long long coalesced() const { return m_flight.coalesced(); }
+
+    static long long now_ms();
+    static bool read_file(const char *path, size_t size, std::string &out);
+
+private:
+    file_cache();
+    ~file_cache() {}
+
+    struct node
+    {
+        std::string path;
+        file_entry entry;
+        long long checked_ms;   //上次校验的时刻
+    };
+    typedef lru_cache<node> cache_type;
+
+    //按路径哈希查找,调用者需持有m_lock
+    cache_type::iterator find(const char *path, size_t len, uint64_t h);
+    shared_body fill(const char *path, size_t len, uint64_t h, const struct stat &st, const mime_type *mime);
+
+private:
+    locker m_lock;
+    cache_type m_cache;         //路径哈希 -> 缓存项,按文件大小计入容量
+    int m_revalidate_ms;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    single_flight<shared_body> m_flight;   //合并同一文件并发的读取
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "file_loader.h"
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+mapped_file::~mapped_file()
+{
+    munmap(m_addr, m_len);
+    close(m_fd);
+}
+
+static size_t page_size()
+{
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+bool file_loader::init(int thread_number, int max_jobs)
+{
+    if (thread_number <= 0 || max_jobs <= 0 || m_threads > 0)
+        return false;
+    m_jobs.resize(max_jobs);
+    for (int i = 0; i < thread_number; ++i)
+    {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, this) != 0)
+            return false;
+        pthread_detach(tid);
+        ++m_threads;
+    }
+    return true;
+}
+
+bool file_loader::resident(const void *addr, size_t len)
+{
+    if (len == 0)
+        return true;
+    size_t page = page_size();
+    uintptr_t begin = (uintptr_t)addr & ~(page - 1);
+    uintptr_t end = (uintptr_t)addr + len;
+    //按最小的4K页计算,一次最多检查WINDOW加首尾两页
+    unsigned char vec[WINDOW / 4096 + 2];
+    size_t pages = (end - begin + page - 1) / page;
+    if (pages > sizeof(vec))
+        pages = sizeof(vec);
+    if (mincore((void *)begin, pages * page, vec) < 0)
+        return true;
+    for (size_t i = 0; i < pages; ++i)
+    {
+        if (!(vec[i] & 1))
+            return false;
+    }
+    return true;
+}
+
+bool file_loader::submit(const file_mapping &mapping, const void *addr, size_t len, callback done, void *arg, unsigned id)
+{
+    m_lock.lock();
+    if (m_threads == 0 || !mapping || m_queued >= m_jobs.size())
+    {
+        ++m_rejected;
+        m_lock.unlock();
+        return false;
+    }
+    job &j = m_jobs[(m_front + m_queued) % m_jobs.size()];
+    j.mapping = mapping;
+    j.addr = addr;
+    j.len = len;
+    j.done = done;
+    j.arg = arg;
+    j.id = id;
+    ++m_queued;
+    ++m_submitted;
+    m_lock.unlock();
+    m_jobstat.post();
+    return true;
+}
+
+void *file_loader::worker(void *arg)
+{
+    ((file_loader *)arg)->run();
+    return NULL;
+}
+
+void file_loader::run()
+{
+    while (m_jobstat.wait())
+    {
+        m_lock.lock();
+        if (m_queued == 0)
+        {
+            m_lock.unlock();
+            continue;
+        }
+        //取走映射的引用,槽位不再让映射多活一轮
+        job j = m_jobs[m_front];
+        m_jobs[m_front].mapping.reset();
+        m_front = (m_front + 1) % m_jobs.size();
+        --m_queued;
+        m_lock.unlock();
+
+        load(*j.mapping, j.addr, j.len);
+        j.done(j.arg, j.id);
+        //连接已经关闭时这里才真正munmap
+        j.mapping.reset();
+    }
+}
+
+//通过文件描述符把区间读入页缓存,阻塞的是I/O线程.不访问映射本身:文件在排队期间被截断时
+//访问映射会收到SIGBUS,读描述符只是读不到数据,之后writev照常返回EFAULT
+void file_loader::load(const mapped_file &mapping, const void *addr, size_t len)
+{
+    off_t offset = (const char *)addr - mapping.data();
+    readahead(mapping.fd(), offset, len);
+    if (resident(addr, len))
+        return;
+    //readahead受预读上限等限制可能没有读全,剩下的用pread读一遍,内容丢弃
+    char buf[64 * 1024];
+    for (size_t done = 0; done < len;)
+    {
+        size_t want = len - done < sizeof(buf) ? len - done : sizeof(buf);
+        ssize_t n = pread(mapping.fd(), buf, want, offset + done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+}
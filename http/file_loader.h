@@ -0,0 +1,93 @@
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include "../lock/locker.h"
+
+//mmap得到的一段文件映射和映射它的文件描述符,最后一个持有者释放时才munmap并关闭.
+//连接和排队中的加载任务各持有一份,连接关闭或换了文件时映射保留到I/O线程用完为止;
+//预读通过描述符进行,见file_loader::load
+class mapped_file
+{
+public:
+    mapped_file(void *addr, size_t len, int fd) : m_addr((char *)addr), m_len(len), m_fd(fd) {}
+    ~mapped_file();
+
+    char *data() const { return m_addr; }
+    size_t size() const { return m_len; }
+    int fd() const { return m_fd; }
+
+private:
+    mapped_file(const mapped_file &);
+    mapped_file &operator=(const mapped_file &);
+
+    char *m_addr;
+    size_t m_len;
+    int m_fd;
+};
+typedef std::shared_ptr<const mapped_file> file_mapping;
+
+//冷文件的异步加载:mmap的文件不在页缓存中时,缺页会发生在writev里,阻塞发送它的线程.
+//发送前先用mincore检查下一段是否已驻留,没有驻留就交给专门的I/O线程通过文件描述符预读,
+//完成后通过回调恢复发送,工作线程和I/O线程都不会被一次慢的磁盘读卡住
+class file_loader
+{
+public:
+    //每次检查和预读的范围
+    static const size_t WINDOW = 1024 * 1024;
+
+    //加载完成的回调,id由提交者传入,用于识别连接是否已经换了主人
+    typedef void (*callback)(void *arg, unsigned id);
+
+    static file_loader *get_instance()
+    {
+        static file_loader instance;
+        return &instance;
+    }
+
+    //启动thread_number个I/O线程,max_jobs为排队上限;未初始化时submit总是失败,调用者同步发送
+    bool init(int thread_number, int max_jobs = 1024);
+
+    //[addr,addr+len)的页是否都在内存中,addr为mmap得到的地址
+    static bool resident(const void *addr, size_t len);
+
+    //在I/O线程上把[addr,addr+len)读入页缓存,完成后在该线程上调用done(arg,id);队列已满时返回false.
+    //[addr,addr+len)在mapping之内,任务持有mapping直到读完
+    bool submit(const file_mapping &mapping, const void *addr, size_t len, callback done, void *arg, unsigned id);
+
+    //统计信息
+    unsigned long long submitted() const { return m_submitted; }
+    unsigned long long rejected() const { return m_rejected; }
+
+private:
+    file_loader() : m_front(0), m_queued(0), m_threads(0), m_submitted(0), m_rejected(0) {}
+    ~file_loader() {}
+
+    struct job
+    {
+        file_mapping mapping;
+        const void *addr;
+        size_t len;
+        callback done;
+        void *arg;
+        unsigned id;
+    };
+
+    static void *worker(void *arg);
+    void run();
+    static void load(const mapped_file &mapping, const void *addr, size_t len);
+
+private:
+    locker m_lock;
+    sem m_jobstat;
+    std::vector<job> m_jobs;    //环形队列
+    size_t m_front;
+    size_t m_queued;
+    int m_threads;
+    unsigned long long m_submitted;
+    unsigned long long m_rejected;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef FNV_H
+#define FNV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//FNV-1a哈希,缓存、路由表、MIME表、资源包索引和路径过滤器共用.
+//h为初始值,传入上一段的结果可以接着哈希后面的字节;都是constexpr,MIME表在编译期建表时也用它
+const uint64_t FNV64_OFFSET = 14695981039346656037ull;
+const uint64_t FNV64_PRIME = 1099511628211ull;
+const uint32_t FNV32_OFFSET = 2166136261u;
+const uint32_t FNV32_PRIME = 16777619u;
+
+constexpr uint64_t fnv1a(const char *s, size_t len, uint64_t h = FNV64_OFFSET)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= FNV64_PRIME;
+    }
+    return h;
+}
+
+//32位版本,ignore_case时按ASCII小写计算
+constexpr uint32_t fnv1a32(const char *s, size_t len, uint32_t h = FNV32_OFFSET, bool ignore_case = false)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = s[i];
+        if (ignore_case && c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        h ^= c;
+        h *= FNV32_PRIME;
+    }
+    return h;
+}
+
+#endif
@@ -0,0 +1,343 @@
+#include "hpack.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace std;
+
+#define ENTRY(name, value) {name, sizeof(name) - 1, value, sizeof(value) - 1}
+
+//RFC 7541附录A
+static const hpack_decoder::field STATIC_TABLE[hpack_decoder::STATIC_COUNT] = {
+    ENTRY(":authority", ""), ENTRY(":method", "GET"), ENTRY(":method", "POST"), ENTRY(":path", "/"),
+    ENTRY(":path", "/index.html"), ENTRY(":scheme", "http"), ENTRY(":scheme", "https"), ENTRY(":status", "200"),
+    ENTRY(":status", "204"), ENTRY(":status", "206"), ENTRY(":status", "304"), ENTRY(":status", "400"),
+    ENTRY(":status", "404"), ENTRY(":status", "500"), ENTRY("accept-charset", ""),
+    ENTRY("accept-encoding", "gzip, deflate"), ENTRY("accept-language", ""), ENTRY("accept-ranges", ""),
+    ENTRY("accept", ""), ENTRY("access-control-allow-origin", ""), ENTRY("age", ""), ENTRY("allow", ""),
+    ENTRY("authorization", ""), ENTRY("cache-control", ""), ENTRY("content-disposition", ""),
+    ENTRY("content-encoding", ""), ENTRY("content-language", ""), ENTRY("content-length", ""),
+    ENTRY("content-location", ""), ENTRY("content-range", ""), ENTRY("content-type", ""), ENTRY("cookie", ""),
+    ENTRY("date", ""), ENTRY("etag", ""), ENTRY("expect", ""), ENTRY("expires", ""), ENTRY("from", ""),
+    ENTRY("host", ""), ENTRY("if-match", ""), ENTRY("if-modified-since", ""), ENTRY("if-none-match", ""),
+    ENTRY("if-range", ""), ENTRY("if-unmodified-since", ""), ENTRY("last-modified", ""), ENTRY("link", ""),
+    ENTRY("location", ""), ENTRY("max-forwards", ""), ENTRY("proxy-authenticate", ""),
+    ENTRY("proxy-authorization", ""), ENTRY("range", ""), ENTRY("referer", ""), ENTRY("refresh", ""),
+    ENTRY("retry-after", ""), ENTRY("server", ""), ENTRY("set-cookie", ""), ENTRY("strict-transport-security", ""),
+    ENTRY("transfer-encoding", ""), ENTRY("user-agent", ""), ENTRY("vary", ""), ENTRY("via", ""),
+    ENTRY("www-authenticate", ""),
+};
+
+#undef ENTRY
+
+//RFC 7541附录B中每个符号(256为EOS)的码长.这是规范(canonical)Huffman码,码字可以由码长还原
+static const unsigned char HUFFMAN_LENS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+//规范Huffman码的解码表:同一码长的码字连续,first[n]为长n的第一个码字,对应symbols[offset[n]]
+struct huffman_table
+{
+    static const int MAX_LEN = 30;
+    uint32_t first[MAX_LEN + 2];
+    uint32_t count[MAX_LEN + 2];
+    uint32_t offset[MAX_LEN + 2];
+    uint16_t symbols[257];
+
+    huffman_table()
+    {
+        memset(count, 0, sizeof(count));
+        for (int s = 0; s < 257; ++s)
+            ++count[HUFFMAN_LENS[s]];
+        uint32_t code = 0, pos = 0;
+        for (int n = 1; n <= MAX_LEN; ++n)
+        {
+            first[n] = code;
+            offset[n] = pos;
+            code = (code + count[n]) << 1;
+            pos += count[n];
+        }
+        //码长相同时按符号排列
+        uint32_t fill[MAX_LEN + 2];
+        memcpy(fill, offset, sizeof(fill));
+        for (int s = 0; s < 257; ++s)
+            symbols[fill[HUFFMAN_LENS[s]]++] = s;
+    }
+};
+
+const hpack_decoder::field *hpack_decoder::static_entry(size_t index)
+{
+    return index >= 1 && index <= STATIC_COUNT ? &STATIC_TABLE[index - 1] : NULL;
+}
+
+bool hpack_decoder::read_int(const unsigned char *&p, const unsigned char *end, int prefix, size_t &value)
+{
+    if (p >= end)
+        return false;
+    size_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if (value < max)
+        return true;
+    for (int shift = 0; shift <= 28; shift += 7)
+    {
+        if (p >= end)
+            return false;
+        unsigned char b = *p++;
+        value += (size_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+//Huffman解码,结果追加到out;末尾不足一字节的填充必须是EOS的前缀(全1)且不超过7位
+bool hpack_decoder::huffman_decode(const unsigned char *p, size_t len, string &out)
+{
+    static const huffman_table table;
+    uint32_t code = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int b = 7; b >= 0; --b)
+        {
+            code = (code << 1) | ((p[i] >> b) & 1);
+            ++bits;
+            uint32_t k = code - table.first[bits];
+            if (table.count[bits] && code >= table.first[bits] && k < table.count[bits])
+            {
+                uint16_t sym = table.symbols[table.offset[bits] + k];
+                if (sym == 256)
+                    return false;
+                out.push_back((char)sym);
+                code = 0;
+                bits = 0;
+            }
+            else if (bits >= huffman_table::MAX_LEN)
+                return false;
+        }
+    }
+    return bits <= 7 && code == (1u << bits) - 1;
+}
+
+bool hpack_decoder::read_string(const unsigned char *&p, const unsigned char *end, size_t &off, size_t &len)
+{
+    if (p >= end)
+        return false;
+    bool huffman = *p & 0x80;
+    size_t n;
+    if (!read_int(p, end, 7, n) || n > (size_t)(end - p))
+        return false;
+    off = m_scratch.size();
+    if (huffman)
+    {
+        if (!huffman_decode(p, n, m_scratch))
+            return false;
+    }
+    else
+        m_scratch.append((const char *)p, n);
+    p += n;
+    len = m_scratch.size() - off;
+    return m_scratch.size() <= MAX_DECODED;
+}
+
+//静态表的项直接引用,动态表的项拷贝到m_scratch(同一报头块中后面的插入可能把它淘汰)
+bool hpack_decoder::lookup(size_t index, pending &f)
+{
+    if (index == 0)
+        return false;
+    if (index <= STATIC_COUNT)
+    {
+        const field &e = STATIC_TABLE[index - 1];
+        f.name = e.name;
+        f.name_len = e.name_len;
+        f.value = e.value;
+        f.value_len = e.value_len;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= m_entries.size())
+        return false;
+    const entry &e = m_entries[index];
+    f.name = NULL;
+    f.name_off = m_scratch.size();
+    f.name_len = e.name.size();
+    m_scratch += e.name;
+    f.value = NULL;
+    f.value_off = m_scratch.size();
+    f.value_len = e.value.size();
+    m_scratch += e.value;
+    return m_scratch.size() <= MAX_DECODED;
+}
+
+void hpack_decoder::evict(size_t limit)
+{
+    while (m_size > limit && !m_entries.empty())
+    {
+        const entry &e = m_entries.back();
+        m_size -= e.name.size() + e.value.size() + 32;
+        m_entries.pop_back();
+    }
+}
+
+//比整个动态表还大的项清空动态表且不插入
+void hpack_decoder::insert(const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    size_t size = name_len + value_len + 32;
+    if (size > m_max_size)
+    {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    m_entries.push_front(entry());
+    m_entries.front().name.assign(name, name_len);
+    m_entries.front().value.assign(value, value_len);
+    m_size += size;
+}
+
+bool hpack_decoder::decode(const unsigned char *data, size_t len, vector<field> &fields)
+{
+    m_scratch.clear();
+    m_pending.clear();
+    fields.clear();
+    const unsigned char *p = data;
+    const unsigned char *end = data + len;
+    while (p < end)
+    {
+        unsigned char b = *p;
+        size_t index;
+        pending f;
+        //索引表示
+        if (b & 0x80)
+        {
+            if (!read_int(p, end, 7, index) || !lookup(index, f))
+                return false;
+            m_pending.push_back(f);
+            continue;
+        }
+        //动态表大小更新,只能出现在报头块开头
+        if ((b & 0xe0) == 0x20)
+        {
+            size_t size;
+            if (!m_pending.empty() || !read_int(p, end, 5, size) || size > TABLE_SIZE)
+                return false;
+            m_max_size = size;
+            evict(size);
+            continue;
+        }
+        //字面表示:带索引(01)、不索引(0000)、永不索引(0001),名字可以引用表中的项
+        bool indexing = (b & 0xc0) == 0x40;
+        if (!read_int(p, end, indexing ? 6 : 4, index))
+            return false;
+        if (index)
+        {
+            if (!lookup(index, f))
+                return false;
+        }
+        else
+        {
+            f.name = NULL;
+            if (!read_string(p, end, f.name_off, f.name_len))
+                return false;
+        }
+        f.value = NULL;
+        if (!read_string(p, end, f.value_off, f.value_len))
+            return false;
+        if (indexing)
+        {
+            const char *name = f.name ? f.name : m_scratch.data() + f.name_off;
+            insert(name, f.name_len, m_scratch.data() + f.value_off, f.value_len);
+        }
+        m_pending.push_back(f);
+    }
+
+    //m_scratch不再增长,偏移换成指针
+    fields.resize(m_pending.size());
+    for (size_t i = 0; i < m_pending.size(); ++i)
+    {
+        const pending &f = m_pending[i];
+        fields[i].name = f.name ? f.name : m_scratch.data() + f.name_off;
+        fields[i].name_len = f.name_len;
+        fields[i].value = f.value ? f.value : m_scratch.data() + f.value_off;
+        fields[i].value_len = f.value_len;
+    }
+    return true;
+}
+
+void hpack_encoder::write_int(string &out, unsigned char first, int prefix, size_t value)
+{
+    size_t max = (1u << prefix) - 1;
+    if (value < max)
+    {
+        out.push_back((char)(first | value));
+        return;
+    }
+    out.push_back((char)(first | max));
+    value -= max;
+    while (value >= 0x80)
+    {
+        out.push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+void hpack_encoder::write_string(string &out, const char *data, size_t len)
+{
+    write_int(out, 0x00, 7, len);
+    out.append(data, len);
+}
+
+void hpack_encoder::status(string &out, int code)
+{
+    //静态表8~14
+    static const int CODES[] = {200, 204, 206, 304, 400, 404, 500};
+    for (size_t i = 0; i < sizeof(CODES) / sizeof(CODES[0]); ++i)
+    {
+        if (CODES[i] == code)
+        {
+            out.push_back((char)(0x80 | (8 + i)));
+            return;
+        }
+    }
+    char text[16];
+    int n = snprintf(text, sizeof(text), "%d", code);
+    write_int(out, 0x00, 4, 8);
+    write_string(out, text, n);
+}
+
+void hpack_encoder::header(string &out, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    size_t index = 0;
+    for (size_t i = 15; i <= hpack_decoder::STATIC_COUNT; ++i)
+    {
+        const hpack_decoder::field &e = STATIC_TABLE[i - 1];
+        if (e.name_len == name_len && memcmp(e.name, name, name_len) == 0)
+        {
+            index = i;
+            break;
+        }
+    }
+    //静态表55为set-cookie
+    unsigned char first = index == 55 ? 0x10 : 0x00;
+    write_int(out, first, 4, index);
+    if (!index)
+        write_string(out, name, name_len);
+    write_string(out, value, value_len);
+}
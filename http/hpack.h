@@ -0,0 +1,83 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+//HPACK(RFC 7541)报头压缩.
+//解码器完整支持静态表、动态表和Huffman编码,每个HTTP/2连接一个,动态表是连接的状态.
+//只引用静态表的报头(如":method: GET"、":scheme: http"、":path: /")解码时直接指向静态表,不拷贝
+class hpack_decoder
+{
+public:
+    //我们在SETTINGS中没有修改SETTINGS_HEADER_TABLE_SIZE,动态表最大为默认的4096字节
+    static const size_t TABLE_SIZE = 4096;
+    //一个报头块解码后的总长度上限,防止很短的报头块引用动态表展开成大量数据
+    static const size_t MAX_DECODED = 32 * 1024;
+
+    //解码得到的一个报头,在下一次decode之前有效
+    struct field
+    {
+        const char *name;
+        size_t name_len;
+        const char *value;
+        size_t value_len;
+    };
+
+    hpack_decoder() : m_size(0), m_max_size(TABLE_SIZE) {}
+
+    //解码一个完整的报头块,出错(COMPRESSION_ERROR)时返回false,之后整个连接都不可用
+    bool decode(const unsigned char *data, size_t len, std::vector<field> &fields);
+
+    //静态表,下标从1开始
+    static const size_t STATIC_COUNT = 61;
+    static const field *static_entry(size_t index);
+
+private:
+    struct entry
+    {
+        std::string name;
+        std::string value;
+    };
+    //解码中的报头:name/value非空时指向静态表,否则是m_scratch中的偏移,全部解码完再换成指针
+    struct pending
+    {
+        const char *name;
+        size_t name_off, name_len;
+        const char *value;
+        size_t value_off, value_len;
+    };
+
+    static bool read_int(const unsigned char *&p, const unsigned char *end, int prefix, size_t &value);
+    bool read_string(const unsigned char *&p, const unsigned char *end, size_t &off, size_t &len);
+    static bool huffman_decode(const unsigned char *p, size_t len, std::string &out);
+    bool lookup(size_t index, pending &f);
+    void insert(const char *name, size_t name_len, const char *value, size_t value_len);
+    void evict(size_t limit);
+
+private:
+    std::deque<entry> m_entries;    //最新的在前面,下标62对应m_entries[0]
+    size_t m_size;                  //按RFC计算的动态表大小,每项为名字和值的长度加32
+    size_t m_max_size;
+    std::string m_scratch;          //本次解码的名字和值
+    std::vector<pending> m_pending;
+};
+
+//响应报头的编码.不使用动态表也不做Huffman编码,编码不依赖连接状态,每个响应的报头块可以在任意线程上独立生成:
+//常见状态码是静态表的一个字节,名字在静态表中的报头引用其下标,值按字面发送
+class hpack_encoder
+{
+public:
+    static void status(std::string &out, int code);
+    //name须为小写;set-cookie按"永不索引"发送,中间代理也不会把它放进动态表
+    static void header(std::string &out, const char *name, size_t name_len, const char *value, size_t value_len);
+
+private:
+    static void write_int(std::string &out, unsigned char first, int prefix, size_t value);
+    static void write_string(std::string &out, const char *data, size_t len);
+};
+
+#endif
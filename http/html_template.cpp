@@ -0,0 +1,176 @@
+#include "html_template.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../log/log.h"
+
+using namespace std;
+
+static const char *const VARIABLE_NAMES[html_template::VAR_COUNT] = {"user", "fans"};
+
+bool html_template::compile(const char *text, size_t len)
+{
+    m_text.assign(text, len);
+    m_segments.clear();
+    m_uses = 0;
+    const char *base = m_text.data();
+    size_t pos = 0;
+    while (pos < len)
+    {
+        const char *open = (const char *)memmem(base + pos, len - pos, "{{", 2);
+        size_t start = open ? open - base : len;
+        if (start > pos)
+        {
+            segment s = {pos, start - pos, -1};
+            m_segments.push_back(s);
+        }
+        if (!open)
+            break;
+        const char *close = (const char *)memmem(open + 2, len - start - 2, "}}", 2);
+        if (!close)
+            return false;
+        //去掉名字两边的空白
+        const char *name = open + 2;
+        const char *name_end = close;
+        while (name < name_end && (*name == ' ' || *name == '\t'))
+            ++name;
+        while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t'))
+            --name_end;
+        int var = -1;
+        for (int i = 0; i < VAR_COUNT; ++i)
+        {
+            if (strlen(VARIABLE_NAMES[i]) == (size_t)(name_end - name) && memcmp(VARIABLE_NAMES[i], name, name_end - name) == 0)
+                var = i;
+        }
+        if (var < 0)
+            return false;
+        segment s = {0, 0, var};
+        m_segments.push_back(s);
+        m_uses |= 1u << var;
+        pos = close + 2 - base;
+    }
+    return m_segments.size() <= MAX_SEGMENTS;
+}
+
+int html_template::render(const char *const values[VAR_COUNT], const size_t lens[VAR_COUNT], struct iovec *iov, size_t &length) const
+{
+    int count = 0;
+    length = 0;
+    for (size_t i = 0; i < m_segments.size(); ++i)
+    {
+        const segment &s = m_segments[i];
+        const char *data = s.var < 0 ? m_text.data() + s.offset : values[s.var];
+        size_t len = s.var < 0 ? s.len : lens[s.var];
+        //空的变量不占iovec
+        if (len == 0)
+            continue;
+        iov[count].iov_base = (char *)data;
+        iov[count].iov_len = len;
+        ++count;
+        length += len;
+    }
+    return count;
+}
+
+size_t html_template::escape(const char *src, size_t len, char *dst)
+{
+    char *out = dst;
+    for (size_t i = 0; i < len; ++i)
+    {
+        const char *entity;
+        switch (src[i])
+        {
+        case '&':
+            entity = "&amp;";
+            break;
+        case '<':
+            entity = "&lt;";
+            break;
+        case '>':
+            entity = "&gt;";
+            break;
+        case '"':
+            entity = "&quot;";
+            break;
+        case '\'':
+            entity = "&#39;";
+            break;
+        default:
+            *out++ = src[i];
+            continue;
+        }
+        size_t n = strlen(entity);
+        memcpy(out, entity, n);
+        out += n;
+    }
+    return out - dst;
+}
+
+int template_cache::init(const char *root)
+{
+    DIR *d = opendir(root);
+    if (!d)
+        return -1;
+    closedir(d);
+    //url由去掉root前缀的路径得到,root结尾的'/'要去掉
+    string base(root);
+    while (base.size() > 1 && base[base.size() - 1] == '/')
+        base.erase(base.size() - 1);
+    scan(base, base, 0);
+    m_routes.build();
+    return (int)m_templates.size();
+}
+
+void template_cache::scan(const string &root, const string &dir, int depth)
+{
+    if (depth > MAX_DEPTH)
+        return;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+    {
+        if (e->d_name[0] == '.')
+            continue;
+        string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            scan(root, path, depth + 1);
+        else if (S_ISREG(st.st_mode) && (size_t)st.st_size <= MAX_FILE_SIZE
+                 && path.size() > 5 && path.compare(path.size() - 5, 5, ".html") == 0)
+            load(root, path);
+    }
+    closedir(d);
+}
+
+//只有含占位符的页面才编译成模板,其余的照常作为静态文件发送
+bool template_cache::load(const string &root, const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    string text;
+    char buf[16384];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        text.append(buf, n);
+    close(fd);
+    if (n < 0 || text.find("{{") == string::npos)
+        return false;
+
+    unique_ptr<html_template> t(new html_template);
+    if (!t->compile(text.data(), text.size()))
+    {
+        LOG_WARN("template %s: bad placeholder, served as a static file", path.c_str());
+        return false;
+    }
+    string url = path.substr(root.size());
+    m_routes.add(url.c_str(), t.get());
+    m_templates.push_back(std::move(t));
+    return true;
+}
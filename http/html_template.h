@@ -0,0 +1,91 @@
+#ifndef HTML_TEMPLATE_H
+#define HTML_TEMPLATE_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "router.h"
+
+//页面模板.启动时把页面编译成静态片段和变量槽的序列,静态片段是模板正文中的一段,
+//渲染时不再解析、也不拷贝,只把变量的值(已做HTML转义)作为额外的片段插进去,整个响应体是一组iovec.
+//占位符写作{{user}}或{{ user }},可用的变量见VARIABLE
+class html_template
+{
+public:
+    //模板中可以使用的变量
+    enum VARIABLE
+    {
+        VAR_USER = 0,   //当前登录的用户名
+        VAR_FANS,       //注册用户数
+        VAR_COUNT
+    };
+    //片段数的上限,渲染结果连同报头要能放进一次writev
+    static const size_t MAX_SEGMENTS = 256;
+
+    //编译text,出现未知变量、未闭合的{{或片段过多时返回false
+    bool compile(const char *text, size_t len);
+
+    //iov至少segments()个;values[i]为变量i的值,长度为lens[i].返回使用的iovec数,响应体总长度写入length
+    int render(const char *const values[VAR_COUNT], const size_t lens[VAR_COUNT], struct iovec *iov, size_t &length) const;
+
+    size_t segments() const { return m_segments.size(); }
+    //模板用到了哪些变量,没用到的不必计算
+    bool uses(VARIABLE var) const { return (m_uses >> var) & 1; }
+
+    //HTML转义,dst至少6*len字节,返回写入的长度
+    static size_t escape(const char *src, size_t len, char *dst);
+
+private:
+    //var<0时是正文中[offset,offset+len)的静态内容,否则是变量
+    struct segment
+    {
+        size_t offset;
+        size_t len;
+        int var;
+    };
+
+    std::string m_text;
+    std::vector<segment> m_segments;
+    unsigned m_uses;
+};
+
+//doc_root下所有含占位符的.html文件编译成的模板,按url查找.
+//只在启动时建立,之后只读,多个线程查找不加锁;运行中修改的模板文件要重启才生效
+class template_cache
+{
+public:
+    static template_cache *get_instance()
+    {
+        static template_cache instance;
+        return &instance;
+    }
+
+    //扫描root编译模板,返回编译成功的个数,目录不可读时返回-1
+    int init(const char *root);
+
+    //url如"/welcome.html",不是模板时返回NULL
+    const html_template *find(const char *url) const
+    {
+        const html_template *const *t = m_routes.match(url);
+        return t ? *t : NULL;
+    }
+
+private:
+    template_cache() {}
+    ~template_cache() {}
+
+    static const int MAX_DEPTH = 8;
+    //模板文件的大小上限
+    static const size_t MAX_FILE_SIZE = 1024 * 1024;
+
+    void scan(const std::string &root, const std::string &dir, int depth);
+    bool load(const std::string &root, const std::string &path);
+
+private:
+    std::vector<std::unique_ptr<html_template> > m_templates;
+    router<const html_template *> m_routes;
+};
+
+#endif
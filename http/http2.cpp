@@ -0,0 +1,842 @@
+#include "http2.h"
+#include "http_conn.h"
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+
+static const char CLIENT_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const char UPGRADE_RESPONSE[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+
+//帧标志
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+//SETTINGS参数
+static const uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+static const uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+static const uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+static const uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+static const uint32_t MAX_FRAME_SIZE_LIMIT = 0xffffff;
+
+static std::atomic<unsigned long long> s_sessions(0);
+static std::atomic<unsigned long long> s_streams(0);
+
+static uint32_t get32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void frame_header(unsigned char *h, size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    h[0] = len >> 16;
+    h[1] = len >> 8;
+    h[2] = len;
+    h[3] = type;
+    h[4] = flags;
+    put32(h + 5, id);
+}
+
+static bool field_is(const hpack_decoder::field &f, const char *name)
+{
+    size_t len = strlen(name);
+    return f.name_len == len && memcmp(f.name, name, len) == 0;
+}
+
+static bool value_is(const hpack_decoder::field &f, const char *value)
+{
+    size_t len = strlen(value);
+    return f.value_len == len && memcmp(f.value, value, len) == 0;
+}
+
+//HTTP2-Settings是不带填充的base64url
+static bool base64url_decode(const char *text, size_t len, std::string &out)
+{
+    unsigned int bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = text[i];
+        int v;
+        if (c >= 'A' && c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            v = c - '0' + 52;
+        else if (c == '-' || c == '+')
+            v = 62;
+        else if (c == '_' || c == '/')
+            v = 63;
+        else if (c == '=')
+            break;
+        else
+            return false;
+        bits = (bits << 6) | v;
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            out += (char)((bits >> count) & 0xff);
+        }
+    }
+    return true;
+}
+
+h2_stream::h2_stream(uint32_t stream_id)
+    : id(stream_id), end_request(false), data(NULL), len(0), source(NULL), responded(false),
+      headers_sent(false), sent(0), finished(false), reset(false), send_window(0)
+{
+}
+
+h2_stream::~h2_stream()
+{
+    delete source;
+}
+
+h2_session::h2_session(http_conn *conn)
+    : m_conn(conn), m_preface(false), m_server_preface(false), m_settings(false), m_last_stream(0), m_continuation(0),
+      m_continuation_end(false), m_rr(0), m_initial_window(DEFAULT_WINDOW), m_peer_max_frame(MAX_FRAME_SIZE),
+      m_send_window(DEFAULT_WINDOW), m_head(0), m_head_offset(0), m_goaway_sent(false), m_goaway_received(false)
+{
+    s_sessions.fetch_add(1, std::memory_order_relaxed);
+}
+
+h2_session::~h2_session()
+{
+    for (std::map<uint32_t, h2_stream *>::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+        delete it->second;
+}
+
+unsigned long long h2_session::sessions()
+{
+    return s_sessions.load(std::memory_order_relaxed);
+}
+
+unsigned long long h2_session::streams()
+{
+    return s_streams.load(std::memory_order_relaxed);
+}
+
+bool h2_session::upgrade(const char *settings, size_t len, h2_stream *stream)
+{
+    std::string payload;
+    if (!base64url_decode(settings, len, payload) || payload.size() % 6 != 0)
+        return false;
+    if (apply_settings((const unsigned char *)payload.data(), payload.size()) != NO_ERROR)
+        return false;
+    //HTTP2-Settings相当于客户端的第一个SETTINGS,不需要确认
+    m_settings = true;
+
+    size_t off = m_out.size();
+    m_out.append(UPGRADE_RESPONSE, sizeof(UPGRADE_RESPONSE) - 1);
+    queue_segment(NULL, off, sizeof(UPGRADE_RESPONSE) - 1);
+    queue_settings();
+
+    stream->id = 1;
+    stream->end_request = true;
+    stream->send_window = m_initial_window;
+    m_streams[1] = stream;
+    m_last_stream = 1;
+    s_streams.fetch_add(1, std::memory_order_relaxed);
+    m_ready.push_back(stream);
+    return true;
+}
+
+bool h2_session::feed(const char *data, size_t len)
+{
+    //发出GOAWAY之后不再处理任何输入,等待发送队列写完后关闭
+    if (m_goaway_sent)
+        return false;
+    m_in.append(data, len);
+
+    size_t pos = 0;
+    if (!m_preface)
+    {
+        size_t n = m_in.size() < PREFACE_LEN ? m_in.size() : PREFACE_LEN;
+        if (memcmp(m_in.data(), CLIENT_PREFACE, n) != 0)
+            return go_away(PROTOCOL_ERROR);
+        //升级请求(流1)不等连接前言,先行分派
+        if (n < PREFACE_LEN)
+        {
+            dispatch();
+            return true;
+        }
+        m_preface = true;
+        pos = PREFACE_LEN;
+        if (!m_server_preface)
+            queue_settings();
+    }
+
+    bool ok = true;
+    while (ok && m_in.size() - pos >= FRAME_HEADER_LEN)
+    {
+        const unsigned char *h = (const unsigned char *)m_in.data() + pos;
+        size_t frame_len = ((size_t)h[0] << 16) | ((size_t)h[1] << 8) | h[2];
+        if (frame_len > MAX_FRAME_SIZE)
+        {
+            ok = go_away(FRAME_SIZE_ERROR);
+            break;
+        }
+        if (m_in.size() - pos < FRAME_HEADER_LEN + frame_len)
+            break;
+        ok = on_frame(h[3], h[4], get32(h + 5) & 0x7fffffff, h + FRAME_HEADER_LEN, frame_len);
+        pos += FRAME_HEADER_LEN + frame_len;
+    }
+    m_in.erase(0, pos);
+
+    if (!ok)
+    {
+        m_ready.clear();
+        return false;
+    }
+    dispatch();
+    return true;
+}
+
+bool h2_session::on_frame(uint8_t type, uint8_t flags, uint32_t id, const unsigned char *payload, size_t len)
+{
+    //连接前言之后的第一个帧必须是SETTINGS
+    if (!m_settings)
+    {
+        if (type != FRAME_SETTINGS || (flags & FLAG_ACK))
+            return go_away(PROTOCOL_ERROR);
+        m_settings = true;
+    }
+    //报头块没有结束时只能是同一个流的CONTINUATION
+    if (m_continuation && (type != FRAME_CONTINUATION || id != m_continuation))
+        return go_away(PROTOCOL_ERROR);
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        return on_data(flags, id, payload, len);
+    case FRAME_HEADERS:
+        return on_headers(flags, id, payload, len);
+    case FRAME_PRIORITY:
+        //不按优先级调度,各流轮流发送
+        if (id == 0)
+            return go_away(PROTOCOL_ERROR);
+        if (len != 5)
+            reset_stream(id, FRAME_SIZE_ERROR);
+        return true;
+    case FRAME_RST_STREAM:
+    {
+        if (id == 0)
+            return go_away(PROTOCOL_ERROR);
+        if (len != 4)
+            return go_away(FRAME_SIZE_ERROR);
+        if (id > m_last_stream)
+            return go_away(PROTOCOL_ERROR);
+        h2_stream *s = find(id);
+        if (s)
+            s->reset = true;
+        return true;
+    }
+    case FRAME_SETTINGS:
+        return on_settings(flags, id, payload, len);
+    case FRAME_PUSH_PROMISE:
+        //客户端不能推送
+        return go_away(PROTOCOL_ERROR);
+    case FRAME_PING:
+        if (id != 0)
+            return go_away(PROTOCOL_ERROR);
+        if (len != 8)
+            return go_away(FRAME_SIZE_ERROR);
+        if (!(flags & FLAG_ACK))
+            queue_frame(FRAME_PING, FLAG_ACK, 0, payload, len);
+        return true;
+    case FRAME_GOAWAY:
+        if (id != 0)
+            return go_away(PROTOCOL_ERROR);
+        m_goaway_received = true;
+        return true;
+    case FRAME_WINDOW_UPDATE:
+        return on_window_update(id, payload, len);
+    case FRAME_CONTINUATION:
+        if (!m_continuation)
+            return go_away(PROTOCOL_ERROR);
+        m_header_block.append((const char *)payload, len);
+        if (m_header_block.size() > MAX_HEADER_BLOCK)
+            return go_away(ENHANCE_YOUR_CALM);
+        if (flags & FLAG_END_HEADERS)
+        {
+            m_continuation = 0;
+            return on_header_block(id, m_continuation_end);
+        }
+        return true;
+    default:
+        //未知类型的帧忽略
+        return true;
+    }
+}
+
+bool h2_session::on_headers(uint8_t flags, uint32_t id, const unsigned char *payload, size_t len)
+{
+    if (id == 0 || !(id & 1))
+        return go_away(PROTOCOL_ERROR);
+
+    size_t pad = 0;
+    if (flags & FLAG_PADDED)
+    {
+        if (len < 1)
+            return go_away(FRAME_SIZE_ERROR);
+        pad = payload[0];
+        ++payload;
+        --len;
+    }
+    if (flags & FLAG_PRIORITY)
+    {
+        if (len < 5)
+            return go_away(FRAME_SIZE_ERROR);
+        payload += 5;
+        len -= 5;
+    }
+    if (pad > len)
+        return go_away(PROTOCOL_ERROR);
+    len -= pad;
+
+    m_header_block.assign((const char *)payload, len);
+    bool end_stream = flags & FLAG_END_STREAM;
+    if (!(flags & FLAG_END_HEADERS))
+    {
+        m_continuation = id;
+        m_continuation_end = end_stream;
+        return true;
+    }
+    return on_header_block(id, end_stream);
+}
+
+bool h2_session::on_header_block(uint32_t id, bool end_stream)
+{
+    //即使流会被拒绝也要解码,否则我们的动态表和对方的不一致
+    if (!m_decoder.decode((const unsigned char *)m_header_block.data(), m_header_block.size(), m_fields))
+        return go_away(COMPRESSION_ERROR);
+
+    h2_stream *s = find(id);
+    if (s)
+    {
+        //已打开的流上的第二个报头块是trailer,必须结束请求,内容忽略
+        if (s->end_request || s->reset)
+        {
+            reset_stream(id, STREAM_CLOSED);
+            return true;
+        }
+        if (!end_stream)
+        {
+            reset_stream(id, PROTOCOL_ERROR);
+            return true;
+        }
+        s->end_request = true;
+        m_ready.push_back(s);
+        return true;
+    }
+    //流ID只能递增
+    if (id <= m_last_stream)
+        return go_away(PROTOCOL_ERROR);
+    m_last_stream = id;
+
+    if (active_streams() >= MAX_CONCURRENT_STREAMS)
+    {
+        reset_stream(id, REFUSED_STREAM);
+        return true;
+    }
+    s = new h2_stream(id);
+    if (!decode_request(s))
+    {
+        delete s;
+        reset_stream(id, PROTOCOL_ERROR);
+        return true;
+    }
+    s->send_window = m_initial_window;
+    m_streams[id] = s;
+    s_streams.fetch_add(1, std::memory_order_relaxed);
+    if (end_stream)
+    {
+        s->end_request = true;
+        m_ready.push_back(s);
+    }
+    return true;
+}
+
+//把解码的报头填进流,报头不合法(RFC 7540 8.1.2)时返回false
+bool h2_session::decode_request(h2_stream *s)
+{
+    bool regular = false;
+    for (size_t i = 0; i < m_fields.size(); ++i)
+    {
+        const hpack_decoder::field &f = m_fields[i];
+        if (f.name_len == 0)
+            return false;
+        if (f.name[0] == ':')
+        {
+            //伪报头必须在普通报头之前
+            if (regular)
+                return false;
+            if (field_is(f, ":method"))
+                s->method.assign(f.value, f.value_len);
+            else if (field_is(f, ":path"))
+                s->path.assign(f.value, f.value_len);
+            else if (field_is(f, ":authority"))
+                s->authority.assign(f.value, f.value_len);
+            else if (!field_is(f, ":scheme"))
+                return false;
+            continue;
+        }
+        regular = true;
+        for (size_t j = 0; j < f.name_len; ++j)
+            if (f.name[j] >= 'A' && f.name[j] <= 'Z')
+                return false;
+        //HTTP/2中不允许逐跳的报头
+        if (field_is(f, "connection") || field_is(f, "keep-alive") || field_is(f, "proxy-connection")
+            || field_is(f, "transfer-encoding") || field_is(f, "upgrade"))
+            return false;
+        if (field_is(f, "te") && !value_is(f, "trailers"))
+            return false;
+        if (field_is(f, "cookie"))
+        {
+            if (!s->cookie.empty())
+                s->cookie += "; ";
+            s->cookie.append(f.value, f.value_len);
+        }
+        else if (field_is(f, "if-none-match"))
+            s->if_none_match.assign(f.value, f.value_len);
+        else if (field_is(f, "accept-encoding"))
+            s->accept_encoding.assign(f.value, f.value_len);
+        else if (field_is(f, "host") && s->authority.empty())
+            s->authority.assign(f.value, f.value_len);
+    }
+    return !s->method.empty() && !s->path.empty();
+}
+
+bool h2_session::on_data(uint8_t flags, uint32_t id, const unsigned char *payload, size_t len)
+{
+    if (id == 0)
+        return go_away(PROTOCOL_ERROR);
+    //整个帧(含填充)都计入流量控制,收到后立即归还连接窗口
+    size_t frame_len = len;
+    if (frame_len)
+        queue_window_update(0, frame_len);
+
+    if (flags & FLAG_PADDED)
+    {
+        if (len < 1)
+            return go_away(FRAME_SIZE_ERROR);
+        size_t pad = payload[0];
+        ++payload;
+        --len;
+        if (pad > len)
+            return go_away(PROTOCOL_ERROR);
+        len -= pad;
+    }
+
+    h2_stream *s = find(id);
+    if (!s || s->end_request || s->reset)
+    {
+        if (id > m_last_stream)
+            return go_away(PROTOCOL_ERROR);
+        reset_stream(id, STREAM_CLOSED);
+        return true;
+    }
+    if (s->body.size() + len > MAX_REQUEST_BODY)
+    {
+        reset_stream(id, CANCEL);
+        return true;
+    }
+    s->body.append((const char *)payload, len);
+    if (flags & FLAG_END_STREAM)
+    {
+        s->end_request = true;
+        m_ready.push_back(s);
+    }
+    else if (frame_len)
+        queue_window_update(id, frame_len);
+    return true;
+}
+
+bool h2_session::on_settings(uint8_t flags, uint32_t id, const unsigned char *payload, size_t len)
+{
+    if (id != 0)
+        return go_away(PROTOCOL_ERROR);
+    if (flags & FLAG_ACK)
+    {
+        if (len != 0)
+            return go_away(FRAME_SIZE_ERROR);
+        return true;
+    }
+    if (len % 6 != 0)
+        return go_away(FRAME_SIZE_ERROR);
+    ERROR_CODE code = apply_settings(payload, len);
+    if (code != NO_ERROR)
+        return go_away(code);
+    queue_frame(FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+    return true;
+}
+
+h2_session::ERROR_CODE h2_session::apply_settings(const unsigned char *payload, size_t len)
+{
+    for (size_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t key = ((uint16_t)payload[i] << 8) | payload[i + 1];
+        uint32_t value = get32(payload + i + 2);
+        switch (key)
+        {
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return PROTOCOL_ERROR;
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+                return FLOW_CONTROL_ERROR;
+            //初始窗口的变化作用于所有已打开的流
+            int64_t delta = (int64_t)value - m_initial_window;
+            for (std::map<uint32_t, h2_stream *>::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+            {
+                it->second->send_window += delta;
+                if (it->second->send_window > MAX_WINDOW)
+                    return FLOW_CONTROL_ERROR;
+            }
+            m_initial_window = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < MAX_FRAME_SIZE || value > MAX_FRAME_SIZE_LIMIT)
+                return PROTOCOL_ERROR;
+            m_peer_max_frame = value;
+            break;
+        default:
+            //报头表大小不影响我们的编码器(不使用动态表);不推送,不关心对方的并发流上限
+            break;
+        }
+    }
+    return NO_ERROR;
+}
+
+bool h2_session::on_window_update(uint32_t id, const unsigned char *payload, size_t len)
+{
+    if (len != 4)
+        return go_away(FRAME_SIZE_ERROR);
+    uint32_t increment = get32(payload) & 0x7fffffff;
+    if (id == 0)
+    {
+        if (increment == 0)
+            return go_away(PROTOCOL_ERROR);
+        m_send_window += increment;
+        if (m_send_window > MAX_WINDOW)
+            return go_away(FLOW_CONTROL_ERROR);
+        return true;
+    }
+    h2_stream *s = find(id);
+    if (!s)
+    {
+        //已关闭的流上的WINDOW_UPDATE忽略
+        if (id > m_last_stream)
+            return go_away(PROTOCOL_ERROR);
+        return true;
+    }
+    if (increment == 0)
+    {
+        reset_stream(id, PROTOCOL_ERROR);
+        return true;
+    }
+    s->send_window += increment;
+    if (s->send_window > MAX_WINDOW)
+        reset_stream(id, FLOW_CONTROL_ERROR);
+    return true;
+}
+
+//分派在整个输入解析完之后进行:h2_dispatch借用http_conn的读缓冲区和请求状态生成响应
+void h2_session::dispatch()
+{
+    for (size_t i = 0; i < m_ready.size(); ++i)
+    {
+        h2_stream *s = m_ready[i];
+        if (s->reset)
+            continue;
+        m_conn->h2_dispatch(*s);
+        s->responded = true;
+    }
+    m_ready.clear();
+}
+
+h2_stream *h2_session::find(uint32_t id)
+{
+    std::map<uint32_t, h2_stream *>::iterator it = m_streams.find(id);
+    return it == m_streams.end() ? NULL : it->second;
+}
+
+size_t h2_session::active_streams() const
+{
+    size_t count = 0;
+    for (std::map<uint32_t, h2_stream *>::const_iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+        if (!it->second->reset && !it->second->finished)
+            ++count;
+    return count;
+}
+
+int h2_session::pending(struct iovec *iov, int max)
+{
+    if (m_head == m_queue.size())
+    {
+        //上一批帧已经全部发出,它们引用的响应体可以释放了
+        m_queue.clear();
+        m_out.clear();
+        m_head = 0;
+        m_head_offset = 0;
+        reap();
+        if (!fill())
+            return 0;
+    }
+    int count = 0;
+    for (size_t i = m_head; i < m_queue.size() && count < max; ++i, ++count)
+    {
+        const segment &g = m_queue[i];
+        const char *p = g.ptr ? g.ptr : m_out.data() + g.off;
+        size_t skip = i == m_head ? m_head_offset : 0;
+        iov[count].iov_base = (void *)(p + skip);
+        iov[count].iov_len = g.len - skip;
+    }
+    return count;
+}
+
+void h2_session::sent(size_t n)
+{
+    while (n > 0 && m_head < m_queue.size())
+    {
+        size_t left = m_queue[m_head].len - m_head_offset;
+        if (n < left)
+        {
+            m_head_offset += n;
+            return;
+        }
+        n -= left;
+        ++m_head;
+        m_head_offset = 0;
+    }
+}
+
+bool h2_session::done() const
+{
+    if (m_head < m_queue.size())
+        return false;
+    if (m_goaway_sent)
+        return true;
+    if (!m_goaway_received)
+        return false;
+    //对方发了GOAWAY:把已经开始处理的流发完再关闭
+    for (std::map<uint32_t, h2_stream *>::const_iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+        if (!it->second->reset && !it->second->finished)
+            return false;
+    return true;
+}
+
+//为各流生成一批帧:先发新响应的报头,再轮流为每个流发一个DATA帧,直到窗口用完、没有数据或达到FILL_LIMIT
+bool h2_session::fill()
+{
+    if (m_goaway_sent)
+        return false;
+    std::map<uint32_t, h2_stream *>::iterator it;
+    for (it = m_streams.begin(); it != m_streams.end(); ++it)
+    {
+        h2_stream *s = it->second;
+        if (s->reset || !s->responded || s->headers_sent)
+            continue;
+        queue_headers(s, s->len == 0 && !s->source);
+    }
+    for (it = m_streams.begin(); it != m_streams.end(); ++it)
+    {
+        h2_stream *s = it->second;
+        if (!s->reset && s->headers_sent && !s->finished && s->source && s->sent == s->len)
+            pull_chunk(s);
+    }
+
+    size_t bytes = 0;
+    bool progress = true;
+    while (progress && bytes < FILL_LIMIT && m_send_window > 0)
+    {
+        progress = false;
+        it = m_streams.upper_bound(m_rr);
+        for (size_t k = 0, total = m_streams.size(); k < total; ++k)
+        {
+            if (it == m_streams.end())
+                it = m_streams.begin();
+            h2_stream *s = (it++)->second;
+            if (s->reset || !s->headers_sent || s->finished)
+                continue;
+            size_t left = s->len - s->sent;
+            if (left == 0)
+            {
+                //分块生成的响应体在最后一块之后用空的DATA帧结束
+                if (!s->source)
+                {
+                    queue_data(s, 0, true);
+                    progress = true;
+                }
+                continue;
+            }
+            int64_t window = std::min(m_send_window, s->send_window);
+            if (window <= 0)
+                continue;
+            size_t n = std::min(left, std::min(m_peer_max_frame, (size_t)window));
+            queue_data(s, n, n == left && !s->source);
+            bytes += n;
+            m_rr = s->id;
+            progress = true;
+            if (bytes >= FILL_LIMIT || m_send_window <= 0)
+                break;
+        }
+    }
+    return m_head < m_queue.size();
+}
+
+//取分块生成器的下一块,放在owned中直到它的DATA帧发完
+void h2_session::pull_chunk(h2_stream *s)
+{
+    std::string *chunk = new std::string;
+    bool more;
+    do
+        more = s->source->next(*chunk);
+    while (more && chunk->empty());
+    s->owned.reset(chunk);
+    s->data = chunk->data();
+    s->len = chunk->size();
+    s->sent = 0;
+    if (!more)
+    {
+        delete s->source;
+        s->source = NULL;
+    }
+}
+
+void h2_session::queue_segment(const char *ptr, size_t off, size_t len)
+{
+    //m_out中相邻的段合并成一个iovec
+    if (!ptr && !m_queue.empty())
+    {
+        segment &last = m_queue.back();
+        if (!last.ptr && last.off + last.len == off)
+        {
+            last.len += len;
+            return;
+        }
+    }
+    segment g = {ptr, off, len};
+    m_queue.push_back(g);
+}
+
+void h2_session::queue_frame(uint8_t type, uint8_t flags, uint32_t id, const void *payload, size_t len)
+{
+    unsigned char h[FRAME_HEADER_LEN];
+    frame_header(h, len, type, flags, id);
+    size_t off = m_out.size();
+    m_out.append((const char *)h, FRAME_HEADER_LEN);
+    if (len)
+        m_out.append((const char *)payload, len);
+    queue_segment(NULL, off, FRAME_HEADER_LEN + len);
+}
+
+//服务器的连接前言:限制并发流数,其余设置用默认值
+void h2_session::queue_settings()
+{
+    unsigned char payload[6];
+    payload[0] = SETTINGS_MAX_CONCURRENT_STREAMS >> 8;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS & 0xff;
+    put32(payload + 2, MAX_CONCURRENT_STREAMS);
+    queue_frame(FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+    m_server_preface = true;
+}
+
+void h2_session::queue_window_update(uint32_t id, uint32_t increment)
+{
+    unsigned char payload[4];
+    put32(payload, increment);
+    queue_frame(FRAME_WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+}
+
+void h2_session::queue_headers(h2_stream *s, bool end_stream)
+{
+    //超过对方帧长度上限的报头块拆成HEADERS和若干CONTINUATION
+    size_t total = s->headers.size(), pos = 0;
+    bool first = true;
+    do
+    {
+        size_t n = std::min(total - pos, m_peer_max_frame);
+        uint8_t flags = pos + n == total ? FLAG_END_HEADERS : 0;
+        if (first && end_stream)
+            flags |= FLAG_END_STREAM;
+        queue_frame(first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, s->id, s->headers.data() + pos, n);
+        pos += n;
+        first = false;
+    } while (pos < total);
+    s->headers_sent = true;
+    if (end_stream)
+        s->finished = true;
+}
+
+//DATA帧的帧头放在m_out,载荷直接引用响应体
+void h2_session::queue_data(h2_stream *s, size_t len, bool end_stream)
+{
+    unsigned char h[FRAME_HEADER_LEN];
+    frame_header(h, len, FRAME_DATA, end_stream ? FLAG_END_STREAM : 0, s->id);
+    size_t off = m_out.size();
+    m_out.append((const char *)h, FRAME_HEADER_LEN);
+    queue_segment(NULL, off, FRAME_HEADER_LEN);
+    if (len)
+        queue_segment(s->data + s->sent, 0, len);
+    s->sent += len;
+    s->send_window -= len;
+    m_send_window -= len;
+    if (end_stream)
+        s->finished = true;
+}
+
+void h2_session::reset_stream(uint32_t id, ERROR_CODE code)
+{
+    unsigned char payload[4];
+    put32(payload, code);
+    queue_frame(FRAME_RST_STREAM, 0, id, payload, sizeof(payload));
+    h2_stream *s = find(id);
+    if (s)
+        s->reset = true;
+}
+
+bool h2_session::go_away(ERROR_CODE code)
+{
+    if (!m_goaway_sent)
+    {
+        unsigned char payload[8];
+        put32(payload, m_last_stream);
+        put32(payload + 4, code);
+        queue_frame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+        m_goaway_sent = true;
+    }
+    return false;
+}
+
+//释放已经结束的流,只在发送队列为空时调用
+void h2_session::reap()
+{
+    std::map<uint32_t, h2_stream *>::iterator it = m_streams.begin();
+    while (it != m_streams.end())
+    {
+        h2_stream *s = it->second;
+        if (s->reset || s->finished)
+        {
+            delete s;
+            m_streams.erase(it++);
+        }
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,198 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "hpack.h"
+#include "content_cache.h"
+#include "chunk_source.h"
+#include "file_loader.h"
+
+class http_conn;
+
+//HTTP/2流上的一个请求及其响应
+struct h2_stream
+{
+    explicit h2_stream(uint32_t stream_id);
+    ~h2_stream();
+
+    uint32_t id;
+
+    //请求,由h2_session解码报头和DATA帧得到
+    std::string method;
+    std::string path;
+    std::string authority;
+    std::string cookie;             //多个cookie报头按"; "拼接
+    std::string if_none_match;
+    std::string accept_encoding;
+    std::string body;
+    bool end_request;               //已收到END_STREAM
+
+    //响应,由http_conn::h2_dispatch填写:报头块已经HPACK编码;
+    //响应体是[data,data+len),它属于owned(缓存、压缩结果或拷贝的内容)、map(mmap的文件)或资源包,
+    //source非空时响应体由分块生成器逐块生成,每块放在owned中
+    std::string headers;
+    shared_body owned;
+    const char *data;
+    size_t len;
+    file_mapping map;
+    chunk_source *source;
+    bool responded;
+
+    //发送状态
+    bool headers_sent;
+    size_t sent;                    //响应体已经分帧的字节数
+    bool finished;                  //END_STREAM已经分帧
+    bool reset;                     //收到或发出了RST_STREAM
+    int64_t send_window;            //流的发送窗口,对方缩小初始窗口时可以为负
+
+private:
+    h2_stream(const h2_stream &);
+    h2_stream &operator=(const h2_stream &);
+};
+
+//一个HTTP/2(h2c)连接:连接前言、帧的解析和生成、流表、流量控制和DATA帧的调度.
+//不做I/O:http_conn把读到的数据交给feed,请求完整的流由http_conn::h2_dispatch按HTTP/1.1的同一套处理器生成响应;
+//发送时pending给出待发送的iovec,http_conn写出后调用sent.
+//DATA帧直接引用流的响应体,与HTTP/1.1一样writev发送,不拷贝.
+//各流的DATA帧轮流发送,每轮每个流最多一帧,大文件不会堵住同一页面上的小资源.
+//连接上的调用由EPOLLONESHOT保证同一时刻只有一个线程,不加锁
+class h2_session
+{
+public:
+    enum FRAME_TYPE
+    {
+        FRAME_DATA = 0,
+        FRAME_HEADERS,
+        FRAME_PRIORITY,
+        FRAME_RST_STREAM,
+        FRAME_SETTINGS,
+        FRAME_PUSH_PROMISE,
+        FRAME_PING,
+        FRAME_GOAWAY,
+        FRAME_WINDOW_UPDATE,
+        FRAME_CONTINUATION
+    };
+    enum ERROR_CODE
+    {
+        NO_ERROR = 0,
+        PROTOCOL_ERROR,
+        INTERNAL_ERROR,
+        FLOW_CONTROL_ERROR,
+        SETTINGS_TIMEOUT,
+        STREAM_CLOSED,
+        FRAME_SIZE_ERROR,
+        REFUSED_STREAM,
+        CANCEL,
+        COMPRESSION_ERROR,
+        CONNECT_ERROR,
+        ENHANCE_YOUR_CALM,
+        INADEQUATE_SECURITY,
+        HTTP_1_1_REQUIRED
+    };
+
+    //客户端连接前言"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"的长度
+    static const size_t PREFACE_LEN = 24;
+    static const size_t FRAME_HEADER_LEN = 9;
+    //我们接受的帧长度上限,即SETTINGS_MAX_FRAME_SIZE的默认值
+    static const size_t MAX_FRAME_SIZE = 16384;
+    static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static const int64_t DEFAULT_WINDOW = 65535;
+    static const int64_t MAX_WINDOW = 0x7fffffff;
+    //报头块(含CONTINUATION)和请求体的上限
+    static const size_t MAX_HEADER_BLOCK = 16 * 1024;
+    static const size_t MAX_REQUEST_BODY = 64 * 1024;
+    //pending一次最多生成这么多字节的帧,之后等它们发完再生成,各流的响应体在发完之前一直有效
+    static const size_t FILL_LIMIT = 256 * 1024;
+
+    explicit h2_session(http_conn *conn);
+    ~h2_session();
+
+    //h2c升级:settings为HTTP2-Settings的值(base64url编码的SETTINGS载荷),升级请求本身成为流1.
+    //发送队列以101响应开头,之后是服务器的SETTINGS;失败时返回false,stream由调用者释放
+    bool upgrade(const char *settings, size_t len, h2_stream *stream);
+
+    //处理读到的数据,解析完后分派其中请求完整的流.返回false表示连接出错,GOAWAY已放入发送队列
+    bool feed(const char *data, size_t len);
+
+    //待发送的数据,最多max个iovec;发送队列空时先为各流生成新的帧,没有可发送的数据时返回0
+    int pending(struct iovec *iov, int max);
+    //pending给出的数据中前n字节已发送
+    void sent(size_t n);
+
+    //发出或收到GOAWAY且已无待发送的数据,连接应当关闭
+    bool done() const;
+
+    //统计信息:建立的HTTP/2连接数和处理的流数
+    static unsigned long long sessions();
+    static unsigned long long streams();
+
+private:
+    //发送队列中的一段:ptr为空时是m_out中从off开始的len字节,否则是流的响应体
+    struct segment
+    {
+        const char *ptr;
+        size_t off;
+        size_t len;
+    };
+
+    bool on_frame(uint8_t type, uint8_t flags, uint32_t id, const unsigned char *payload, size_t len);
+    bool on_headers(uint8_t flags, uint32_t id, const unsigned char *payload, size_t len);
+    bool on_header_block(uint32_t id, bool end_stream);
+    bool on_data(uint8_t flags, uint32_t id, const unsigned char *payload, size_t len);
+    bool on_settings(uint8_t flags, uint32_t id, const unsigned char *payload, size_t len);
+    bool on_window_update(uint32_t id, const unsigned char *payload, size_t len);
+    ERROR_CODE apply_settings(const unsigned char *payload, size_t len);
+    bool decode_request(h2_stream *s);
+    void dispatch();
+    h2_stream *find(uint32_t id);
+    size_t active_streams() const;
+
+    bool fill();
+    void pull_chunk(h2_stream *s);
+    void queue_segment(const char *ptr, size_t off, size_t len);
+    void queue_frame(uint8_t type, uint8_t flags, uint32_t id, const void *payload, size_t len);
+    void queue_settings();
+    void queue_window_update(uint32_t id, uint32_t increment);
+    void queue_headers(h2_stream *s, bool end_stream);
+    void queue_data(h2_stream *s, size_t len, bool end_stream);
+    void reset_stream(uint32_t id, ERROR_CODE code);
+    bool go_away(ERROR_CODE code);
+    void reap();
+
+private:
+    http_conn *m_conn;
+    hpack_decoder m_decoder;
+    std::string m_in;                       //未解析的输入,最多一个不完整的帧
+    bool m_preface;                         //已收到客户端连接前言
+    bool m_server_preface;                  //已发出服务器的SETTINGS
+    bool m_settings;                        //已收到客户端的第一个SETTINGS
+    uint32_t m_last_stream;                 //客户端发起的最大流ID
+    uint32_t m_continuation;                //正在接收CONTINUATION的流,0表示没有
+    bool m_continuation_end;                //该报头块所在的HEADERS带有END_STREAM
+    std::string m_header_block;
+    std::vector<hpack_decoder::field> m_fields;
+
+    std::map<uint32_t, h2_stream *> m_streams;
+    std::vector<h2_stream *> m_ready;       //请求完整、等待分派的流
+    uint32_t m_rr;                          //DATA帧轮转的位置:上次最后发送的流ID
+
+    //对方的设置和连接级发送窗口
+    int64_t m_initial_window;
+    size_t m_peer_max_frame;
+    int64_t m_send_window;
+
+    std::string m_out;                      //帧头、控制帧和报头块
+    std::vector<segment> m_queue;
+    size_t m_head;                          //m_queue中第一个未发完的段
+    size_t m_head_offset;                   //该段已发送的字节数
+
+    bool m_goaway_sent;
+    bool m_goaway_received;
+};
+
+#endif
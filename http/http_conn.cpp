@@ -1,8 +1,19 @@
 #include "http_conn.h"
 #include "../log/log.h"
+#include "../threadpool/blocking.h"
+#include "../threadpool/threadpool.h"
+#include "../lock/single_flight.h"
+#include "user_db.h"
+#include "url_form.h"
 #include <map>
+#include <set>
 #include <mysql/mysql.h>
+#include <openssl/err.h>
 #include <fstream>
+#include <limits.h>
+#include <ctype.h>
+
+using namespace std;
 
 //同步校验
 #define SYNSQL
@@ -17,9 +28,31 @@ const char *error_400_form = "Your request has bad syntax or is inherently impos
 const char *error_403_title = "Forbidden";
 const char *error_403_form = "You do not have permission to get file form this server.\n";
 const char *error_404_title = "Not Found";
-const char *error_404_form = "The requested file was not found on this server.\n";
+#define ERROR_404_FORM "The requested file was not found on this server.\n"
+const char *error_404_form = ERROR_404_FORM;
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
+//过载时直接发送的完整响应,不经过解析和process_write
+const char error_503_response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                  "Content-Length:0\r\n"
+                                  "Retry-After:1\r\n"
+                                  "Connection:close\r\n\r\n";
+//扫描器大量请求不存在的路径,404的完整响应预先拼好,按是否长连接选一份直接拷贝
+static_assert(sizeof(ERROR_404_FORM) - 1 == 49, "Content-Length of 404 response");
+const char error_404_keepalive[] = "HTTP/1.1 404 Not Found\r\n"
+                                   "Content-Length:49\r\n"
+                                   "Connection:keep-alive\r\n\r\n" ERROR_404_FORM;
+const char error_404_close[] = "HTTP/1.1 404 Not Found\r\n"
+                               "Content-Length:49\r\n"
+                               "Connection:close\r\n\r\n" ERROR_404_FORM;
+
+//内存中的用户表,用户名->密码
+map<string, string> users;
+//正在写入用户存储的用户名
+static set<string> registering;
+locker m_lock;
+//用户存储后端,默认MySQL
+static user_store *user_backend=user_db::get_instance();
 
 //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
 const char *doc_root = "/home/zhanghao/TinyWebServer/root";
@@ -73,20 +106,55 @@ void modfd(int epollfd,int fd,int ev){
 
 int http_conn::m_user_count = 0;
 int http_conn::m_epollfd = -1;
+threadpool<http_conn> *http_conn::m_pool = NULL;
 
 //关闭连接，关闭一个连接，客户总量减一
 void http_conn::close_conn(bool real_conn){
     if(real_conn&&(m_sockfd!=-1)){
+        release();
         removefd(m_epollfd,m_sockfd);
         m_sockfd=-1;
         --m_user_count;
     }
 }
 
+//WebSocket连接退出广播表,丢掉未发送的帧;分块响应的生成器、HTTP/2会话和SSL对象一并释放
+void http_conn::release(){
+    //之后到达的加载完成通知和恢复的协程都不再属于这个连接
+    ++m_load_id;
+    unmap();
+    if(m_ws_slot>=0) ws_hub::get_instance()->unsubscribe(this);
+    std::vector<shared_body>().swap(m_ws_queue);
+    m_ws_head=0;
+    m_ws_offset=0;
+    m_ws_state=WS_NONE;
+    delete m_stream;
+    m_stream=NULL;
+    delete m_h2;
+    m_h2=NULL;
+    if(m_ssl){
+        //握手完成的连接尽量发出close_notify,不等待对方回应
+        if(m_tls_state==TLS_OPEN) SSL_shutdown(m_ssl);
+        SSL_free(m_ssl);
+        ERR_clear_error();
+        m_ssl=NULL;
+    }
+    m_tls_state=TLS_NONE;
+}
+
+//服务器过载时拒绝请求:非阻塞地发送预先生成的503,随后由调用者关闭连接
+void http_conn::reject(int sockfd){
+    ssize_t ret=send(sockfd,error_503_response,sizeof(error_503_response)-1,MSG_NOSIGNAL|MSG_DONTWAIT);
+    (void)ret;
+}
+
 //初始化连接,外部调用初始化套接字地址
 void http_conn::init(int sockfd,const sockaddr_in& addr){
     m_sockfd=sockfd;
     m_address=addr;
+    ++m_load_id;
+    m_reader = NULL;
+    m_ktls_send = false;
     addfd(m_epollfd,sockfd,true);
     ++m_user_count;
 
@@ -112,6 +180,33 @@ void http_conn::init()
     m_read_idx = 0;
     m_write_idx = 0;
     cgi = 0;
+    m_accept_encoding = 0;
+    m_content_encoding = ENCODING_IDENTITY;
+    m_mime = &mime::default_type;
+    m_pack_variant = NULL;
+    m_if_none_match = 0;
+    m_cookie = 0;
+    m_session[0] = '\0';
+    m_user[0] = '\0';
+    m_iv = m_iv_buf;
+    m_template_len = 0;
+    m_inline = false;
+    m_deferred = false;
+    m_chunked = false;
+    m_chunk_trailer = false;
+    m_chunk_idx = 0;
+    m_upgrade = false;
+    m_conn_upgrade = false;
+    m_ws_key = 0;
+    m_ws_version = 0;
+    m_h2c = false;
+    m_conn_h2_settings = false;
+    m_h2_settings = 0;
+    delete m_stream;
+    m_stream = NULL;
+    //上一个请求(或同一fd上的上一个连接)留下的响应体不能带进新请求
+    unmap();
+    m_arena.reset();
     memset(m_read_buf, '\0', READ_BUFFER_SIZE);
     memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
@@ -119,15 +214,15 @@ void http_conn::init()
 
 //从状态机，用于分析出一行内容
 //返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
-httpconn::LINE_STATUS httpconn::parse_line(){
+http_conn::LINE_STATUS http_conn::parse_line(){
     char temp;
-    for(;m_check_idx<m_read_idx;++m_checked_idx){
+    for(;m_checked_idx<m_read_idx;++m_checked_idx){
         temp=m_read_buf[m_checked_idx];
         if(temp=='\r'){
             if((m_checked_idx+1)==m_read_idx) return LINE_OPEN;
             else if(m_read_buf[m_checked_idx+1]=='\n'){
-                m_read_buf[m_checked_idx++]=='\0';
-                m_read_buf[m_checked_idx++]=='\0';
+                m_read_buf[m_checked_idx++]='\0';
+                m_read_buf[m_checked_idx++]='\0';
                 return LINE_OK;
             }
 
@@ -146,13 +241,16 @@ httpconn::LINE_STATUS httpconn::parse_line(){
 }
 
 //循环读取客户数据，直到无数据可读或对方关闭连接
-bool httpconn::read_once(){
+bool http_conn::read_once(){
     if(m_read_idx>=READ_BUFFER_SIZE){
         return false;
     }
+    if(m_ssl) return tls_read();
 
     int bytes_read=0;
     while(true){
+        //HTTP/2连接读满缓冲区时先交给会话处理,由h2_process接着读
+        if(m_read_idx==READ_BUFFER_SIZE&&(m_h2||h2_preface())) break;
         //从套接字接收数据，存储在m_read_buf缓冲区
         bytes_read=recv(m_sockfd,m_read_buf+m_read_idx,READ_BUFFER_SIZE-m_read_idx,0);
         if(bytes_read==-1){
@@ -171,7 +269,7 @@ bool httpconn::read_once(){
 http_conn::HTTP_CODE http_conn::parse_request_line(char* text){
     //extern char *strpbrk(char *str1, char *str2)
     //比较字符串str1和str2中是否有相同的字符，如果有，则返回该字符在str1中的位置的指针。
-    m_url=strpbrk(text,"\t");
+    m_url=strpbrk(text," \t");
     if(!m_url) return BAD_REQUEST;
     *m_url++='\0';
 
@@ -189,13 +287,13 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text){
         return BAD_REQUEST;
     }
 
-    m_url+=strspn(m_url,"\t");
-    m_version=strpbrk(m_url,"\t");
+    m_url+=strspn(m_url," \t");
+    m_version=strpbrk(m_url," \t");
     if(!m_version){
         return BAD_REQUEST;
     }
     *m_version++='\0';
-    m_version+=strspn(m_version,"\t");
+    m_version+=strspn(m_version," \t");
     if(strcasecmp(m_version,"HTTP/1.1")!=0){
         return BAD_REQUEST;
     }
@@ -225,10 +323,77 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text){
     return NO_REQUEST;
 }
 
+//解析Accept-Encoding,返回可接受编码的位标志,例如"gzip, deflate, br;q=0.9"
+//只识别gzip和br,q=0表示客户端明确拒绝该编码
+static int parse_accept_encoding(const char *text){
+    int mask=0;
+    while(*text){
+        text+=strspn(text," \t,");
+        size_t name_len=strcspn(text," \t,;");
+        size_t item_len=strcspn(text,",");
+        if(name_len==0&&item_len==0) break;
+
+        int flag=0;
+        if(name_len==4&&strncasecmp(text,"gzip",4)==0) flag=ENCODING_GZIP;
+        else if(name_len==2&&strncasecmp(text,"br",2)==0) flag=ENCODING_BR;
+
+        const char *q=text+name_len;
+        while(flag&&q<text+item_len){
+            q+=strspn(q," \t;");
+            if((q[0]=='q'||q[0]=='Q')&&q[1]=='='){
+                if(atof(q+2)<=0) flag=0;
+                break;
+            }
+            q+=strcspn(q,";,");
+        }
+        mask|=flag;
+        text+=item_len;
+    }
+    return mask;
+}
+
+//在Cookie报头中查找name的值,例如"theme=dark; sid=0123..."
+static bool find_cookie(const char *text,const char *name,const char *&value,size_t &len){
+    size_t name_len=strlen(name);
+    while(text&&*text){
+        text+=strspn(text," \t;");
+        size_t item_len=strcspn(text,";");
+        if(item_len>name_len&&text[name_len]=='='&&strncmp(text,name,name_len)==0){
+            value=text+name_len+1;
+            len=item_len-name_len-1;
+            while(len>0&&(value[len-1]==' '||value[len-1]=='\t')) --len;
+            return true;
+        }
+        text+=item_len;
+    }
+    return false;
+}
+
+//逗号分隔的报头值中是否有token,例如"keep-alive, Upgrade"
+static bool has_token(const char *text,const char *token){
+    size_t token_len=strlen(token);
+    while(*text){
+        text+=strspn(text," \t,");
+        size_t item_len=strcspn(text,",");
+        size_t len=item_len;
+        while(len>0&&(text[len-1]==' '||text[len-1]=='\t')) --len;
+        if(len==token_len&&strncasecmp(text,token,len)==0) return true;
+        text+=item_len;
+    }
+    return false;
+}
+
 //解析http请求的一个头部信息
 http_conn::HTTP_CODE http_conn::parse_headers(char *text){
     //遇到空行,表示头部字段解析完毕
     if(text[0]=='\0'){
+        //分块的请求体边读边解码,同时带Content-Length的请求可能是请求走私,拒绝
+        if(m_chunked){
+            if(m_content_length!=0) return BAD_REQUEST;
+            m_check_state=CHECK_STATE_CONTENT;
+            m_chunk_idx=m_checked_idx;
+            return NO_REQUEST;
+        }
         //如果http请求有消息体,则还需要读取m_content_length字节的消息体
         if(m_content_length!=0){
             m_check_state=CHECK_STATE_CONTENT;
@@ -239,19 +404,63 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text){
     }
     else if(strncasecmp(text,"Connection:",11)==0){
         text+=11;
-        text+=strspn(text,"\t");
-        if(strcasecmp(text,"keep-alive")==0){
+        //WebSocket握手时为"Upgrade"或"keep-alive, Upgrade"
+        if(has_token(text,"keep-alive")){
             m_linger=true;
         }
+        m_conn_upgrade=has_token(text,"upgrade");
+        m_conn_h2_settings=has_token(text,"http2-settings");
+    }
+    else if(strncasecmp(text,"Upgrade:",8)==0){
+        text+=8;
+        text+=strspn(text," \t");
+        m_upgrade=strcasecmp(text,"websocket")==0;
+        m_h2c=has_token(text,"h2c");
+    }
+    else if(strncasecmp(text,"HTTP2-Settings:",15)==0){
+        text+=15;
+        text+=strspn(text," \t");
+        m_h2_settings=text;
+    }
+    else if(strncasecmp(text,"Sec-WebSocket-Key:",18)==0){
+        text+=18;
+        text+=strspn(text," \t");
+        m_ws_key=text;
+    }
+    else if(strncasecmp(text,"Sec-WebSocket-Version:",22)==0){
+        text+=22;
+        text+=strspn(text," \t");
+        m_ws_version=atoi(text);
     }
     else if(strncasecmp(text,"Content-Length:",15)==0){
         text+=15;
-        text+=strspn(text,"\t");
+        text+=strspn(text," \t");
         m_content_length=atol(text);
     }
+    else if(strncasecmp(text,"Transfer-Encoding:",18)==0){
+        text+=18;
+        text+=strspn(text," \t");
+        //只支持单独的chunked
+        if(strcasecmp(text,"chunked")!=0) return BAD_REQUEST;
+        m_chunked=true;
+    }
+    else if(strncasecmp(text,"Accept-Encoding:",16)==0){
+        text+=16;
+        m_accept_encoding=parse_accept_encoding(text);
+    }
+    else if(strncasecmp(text,"If-None-Match:",14)==0){
+        text+=14;
+        text+=strspn(text," \t");
+        m_if_none_match=text;
+    }
+    else if(strncasecmp(text,"Cookie:",7)==0){
+        text+=7;
+        text+=strspn(text," \t");
+        m_cookie=text;
+    }
     else if(strncasecmp(text,"Host:",5)==0){
         text+=5;
-        text+=strspn(text,"\t");
+        text+=strspn(text," \t");
         m_host=text;
     }
     else{
@@ -263,6 +472,11 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text){
 
 //这里并不解析http请求的消息体,只是判断http请求是否被完整读入
 http_conn::HTTP_CODE http_conn::parse_content(char* text){
+    if(m_chunked) return parse_chunked(text);
+    //消息体连同结尾的'\0'必须能放进读缓冲区,负数或过大的Content-Length直接拒绝
+    if(m_content_length<0||m_content_length>=READ_BUFFER_SIZE-m_checked_idx){
+        return BAD_REQUEST;
+    }
     if(m_read_idx>=(m_content_length+m_checked_idx)){
         text[m_content_length]='\0';
         //POST请求中最后为输入的用户名和密码
@@ -273,14 +487,56 @@ http_conn::HTTP_CODE http_conn::parse_content(char* text){
     return NO_REQUEST;
 }
 
+//分块的请求体:每块为"十六进制长度[;扩展]\r\n数据\r\n",长度为0的块之后是trailer和空行.
+//数据原地前移拼接到body处,m_content_length记录已解码的长度,读完后与普通请求体一样使用
+http_conn::HTTP_CODE http_conn::parse_chunked(char *body){
+    while(true){
+        char *p=m_read_buf+m_chunk_idx;
+        size_t avail=m_read_idx-m_chunk_idx;
+        char *eol=(char *)memmem(p,avail,"\r\n",2);
+        if(!eol) return NO_REQUEST;
+        size_t line_len=eol-p;
+
+        if(m_chunk_trailer){
+            m_chunk_idx+=line_len+2;
+            if(line_len!=0) continue;
+            body[m_content_length]='\0';
+            m_string=body;
+            return GET_REQUEST;
+        }
+
+        //块长度不会超过读缓冲区,位数多了直接拒绝,避免溢出
+        size_t size=0,digits=0;
+        for(;digits<line_len&&isxdigit((unsigned char)p[digits]);++digits){
+            if(digits>=4) return BAD_REQUEST;
+            char c=p[digits];
+            size=size*16+(c<='9'?c-'0':(c|0x20)-'a'+10);
+        }
+        if(digits==0||(digits<line_len&&p[digits]!=';'&&p[digits]!=' '&&p[digits]!='\t')) return BAD_REQUEST;
+
+        if(size==0){
+            m_chunk_trailer=true;
+            m_chunk_idx+=line_len+2;
+            continue;
+        }
+        if(avail<line_len+2+size+2) return NO_REQUEST;
+        char *data=eol+2;
+        if(data[size]!='\r'||data[size+1]!='\n') return BAD_REQUEST;
+        memmove(body+m_content_length,data,size);
+        m_content_length+=size;
+        m_chunk_idx+=line_len+2+size+2;
+    }
+}
+
 //主状态机,用于从读缓冲区中取出所有完整的行
 http_conn::HTTP_CODE http_conn::process_read(){
     LINE_STATUS line_status=LINE_OK;
     HTTP_CODE ret=NO_REQUEST;
     char* text=0;
 
+    //消息体不按行切分:parse_line会把体内的\r\n改成\0,消息体不完整时等下次读取再从体的起点解析
     while(((m_check_state==CHECK_STATE_CONTENT)&&(line_status==LINE_OK))
-        ||((line_status=parse_line())==LINE_OK))
+        ||((m_check_state!=CHECK_STATE_CONTENT)&&((line_status=parse_line())==LINE_OK)))
     {
         text = get_line();//行在读缓冲区中起始位置
         m_start_line = m_checked_idx;//记录下一行的起始位置
@@ -317,6 +573,9 @@ http_conn::HTTP_CODE http_conn::process_read(){
                 if(ret==GET_REQUEST){
                     return do_request();
                 }
+                else if(ret==BAD_REQUEST){
+                    return BAD_REQUEST;
+                }
                 line_status=LINE_OPEN;
                 break;
             }
@@ -329,127 +588,438 @@ http_conn::HTTP_CODE http_conn::process_read(){
     return NO_REQUEST;
 }
 
-//当得到一个完整、正确的http请求时,分析目标文件的属性.
-//如果目标文件存在、对所有用户可读,则使用mmap将其映射到内存地址m_file_address处,并告诉调用者获取文件成功
+//路由表在第一次请求时构建,之后只读,各线程可并发匹配
+const router<http_conn::route> &http_conn::routes(){
+    static router<route> table=build_routes();
+    return table;
+}
+
+router<http_conn::route> http_conn::build_routes(){
+    router<route> table;
+    route r;
+
+    //内部跳转到固定页面
+    r.handler=&http_conn::do_redirect;
+    r.target="/register.html";
+    table.add("/0",r);
+    r.target="/log.html";
+    table.add("/1",r);
+
+    //登录后才能访问的页面,会话检查在do_file中,见protected_file
+    r.target="/picture.html";
+    table.add("/5",r);
+    r.target="/video.html";
+    table.add("/6",r);
+    r.target="/fans.html";
+    table.add("/7",r);
+
+    //运行状态,分块生成
+    r.handler=&http_conn::do_status;
+    r.target=NULL;
+    table.add("/status",r);
+
+    //粉丝页的实时通知
+    r.handler=&http_conn::do_websocket;
+    table.add("/ws",r);
+
+    //登录和注册
+#if defined(COROUTINE_HANDLERS) && defined(SYNSQL)
+    r.handler=&http_conn::do_co_login;
+#else
+    r.handler=&http_conn::do_login;
+#endif
+    r.target=NULL;
+    table.add("/2CGISQL.cgi",r);
+    r.handler=&http_conn::do_register;
+    table.add("/3CGISQL.cgi",r);
+
+    table.build();
+    return table;
+}
+
+//当得到一个完整、正确的http请求时,按路由表分派到对应的处理器.
+//未命中路由的请求都是静态文件,直接将url与网站目录拼接
 http_conn::HTTP_CODE http_conn::do_request(){
-    strcpy(m_real_file,doc_root);
-    int len=strlen(doc_root);
-
-    //char *strrchr(const char *str, int c) 
-    //在参数 str 所指向的字符串中搜索最后一次出现字符 c（一个无符号字符）的位置。
-    const char *p = strrchr(m_url, '/');
-
-    if(cgi==1&& (*(p + 1) == '2' || *(p + 1) == '3')){
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-//同步线程登录校验
-#ifdef SYNSQL
-        //将用户名和密码提取出来
-        //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-                pthread_mutex_t lock;
-        pthread_mutex_init(&lock, NULL);
-
-        if (*(p + 1) == '3')
-        {
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
-            {
+    //登录和注册要查询数据库,不在I/O线程上处理
+    if(m_inline&&cgi==1) return DEFER_REQUEST;
+    //明文连接上不带请求体的h2c升级:请求本身在HTTP/2的流1上回应,不接受时按HTTP/1.1处理
+    if(m_h2c&&m_conn_upgrade&&m_conn_h2_settings&&m_h2_settings&&!m_h2&&!m_ssl&&m_content_length==0&&!m_chunked){
+        if(m_inline) return DEFER_REQUEST;
+        if(h2_upgrade()) return H2_REQUEST;
+    }
+    const route *r=routes().match(m_url);
+    if(r){
+        return (this->*(r->handler))(r->target);
+    }
+    return do_file(m_url);
+}
 
-                pthread_mutex_lock(&lock);
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                pthread_mutex_unlock(&lock);
+//跳转到固定页面,如/0跳转注册界面,/5跳转图片请求
+http_conn::HTTP_CODE http_conn::do_redirect(const char *target){
+    return do_file(target);
+}
 
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            }
-            else
-                strcpy(m_url, "/registerError.html");
+void http_conn::collect_stats(worker_counters &c){
+    file_cache *files=file_cache::get_instance();
+    content_cache *encoded=content_cache::get_instance();
+    tls_context *tls=tls_context::get_instance();
+    c.connections=m_user_count;
+    c.file_hits=files->hits();
+    c.file_misses=files->misses();
+    c.encode_hits=encoded->hits();
+    c.encode_misses=encoded->misses();
+    c.avoided=path_filter::get_instance()->avoided();
+    c.websockets=ws_hub::get_instance()->subscribers();
+    c.tls_handshakes=tls->handshakes();
+    c.tls_resumed=tls->resumed();
+    c.h2_sessions=h2_session::sessions();
+    c.h2_streams=h2_session::streams();
+}
+
+//请求是否带有有效的会话Cookie
+bool http_conn::has_session(){
+    const char *sid;
+    size_t len;
+    return m_cookie&&find_cookie(m_cookie,"sid",sid,len)&&session_store::get_instance()->validate(sid,len,m_user);
+}
+
+//登录成功后建立会话,会话ID随响应以Set-Cookie发给浏览器
+bool http_conn::start_session(const char *user){
+    if(!session_store::get_instance()->create(user,m_session)) return false;
+    //用户名长度已由create检查
+    strcpy(m_user,user);
+    return true;
+}
+
+//运行状态页:每个统计项生成一块,发完一块才生成下一块
+class status_page : public chunk_source
+{
+public:
+    status_page() : m_step(0), m_worker(0) {}
+
+    bool next(string &out)
+    {
+        char line[192];
+        int n;
+        switch (m_step++)
+        {
+        case 0:
+            out += "<html><head><title>status</title></head><body><table>\n";
+            return true;
+        case 1:
+            n = snprintf(line, sizeof(line), "<tr><td>connections</td><td>%d</td></tr>\n", http_conn::m_user_count);
+            break;
+        case 2:
+        {
+            file_cache *files = file_cache::get_instance();
+            n = snprintf(line, sizeof(line), "<tr><td>file cache</td><td>%llu hits, %llu misses, %zu bytes</td></tr>\n",
+                         files->hits(), files->misses(), files->bytes());
+            break;
+        }
+        case 3:
+        {
+            content_cache *encoded = content_cache::get_instance();
+            n = snprintf(line, sizeof(line), "<tr><td>compression cache</td><td>%llu hits, %llu misses</td></tr>\n",
+                         encoded->hits(), encoded->misses());
+            break;
         }
-        //如果是登录，直接判断
-        //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2')
+        case 4:
+            n = snprintf(line, sizeof(line), "<tr><td>sessions</td><td>%zu</td></tr>\n",
+                         session_store::get_instance()->sessions());
+            break;
+        case 5:
+            n = snprintf(line, sizeof(line), "<tr><td>404 without stat</td><td>%llu</td></tr>\n",
+                         path_filter::get_instance()->avoided());
+            break;
+        case 6:
         {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+            //订阅者表属于主线程,分块响应也在主线程上生成
+            ws_hub *hub = ws_hub::get_instance();
+            n = snprintf(line, sizeof(line), "<tr><td>websockets</td><td>%zu open, %llu published, %llu dropped</td></tr>\n",
+                         hub->subscribers(), hub->published(), hub->dropped());
+            break;
         }
-#endif       
+        case 7:
+        {
+            tls_context *tls = tls_context::get_instance();
+            if (!tls->enabled())
+                return next(out);
+            n = snprintf(line, sizeof(line), "<tr><td>tls handshakes</td><td>%llu (%llu resumed, %llu failed), ktls send %llu recv %llu</td></tr>\n",
+                         tls->handshakes(), tls->resumed(), tls->failed(), tls->ktls_send(), tls->ktls_recv());
+            break;
+        }
+        case 8:
+            n = snprintf(line, sizeof(line), "<tr><td>http2</td><td>%llu connections, %llu streams</td></tr>\n",
+                         h2_session::sessions(), h2_session::streams());
+            break;
+        case 9:
+        {
+            //多进程模式:以上是本进程的数字,下面是主进程每秒加出的合计和各工作进程最近一次发布的计数
+            shared_stats *stats = shared_stats::get_instance();
+            worker_counters c;
+            if (!stats->total(c))
+                return next(out);
+            n = snprintf(line, sizeof(line), "<tr><td>all workers</td><td>%lld connections, %llu file hits, %llu misses, %llu http2 streams</td></tr>\n",
+                         c.connections, c.file_hits, c.file_misses, c.h2_streams);
+            break;
+        }
+        case 10:
+        {
+            shared_stats *stats = shared_stats::get_instance();
+            worker_counters c;
+            pid_t pid;
+            unsigned restarts;
+            if (!stats->read(m_worker, c, &pid, &restarts))
+                return next(out);
+            n = snprintf(line, sizeof(line), "<tr><td>worker %d%s</td><td>pid %d, %u restarts, %lld connections, %llu file hits, %llu http2 streams</td></tr>\n",
+                         m_worker, m_worker == stats->self() ? " (this)" : "", (int)pid, restarts, c.connections, c.file_hits, c.h2_streams);
+            if (++m_worker < stats->workers())
+                --m_step;
+            break;
+        }
+        default:
+            out += "</table></body></html>\n";
+            return false;
+        }
+        out.append(line, n);
+        return true;
+    }
+
+private:
+    int m_step;
+    int m_worker;
+};
+
+http_conn::HTTP_CODE http_conn::do_status(const char *){
+    return stream(new status_page,mime::lookup("status.html"));
+}
+
+//WebSocket握手:只接受已登录的用户,101响应发完后连接加入广播表
+http_conn::HTTP_CODE http_conn::do_websocket(const char *){
+    if(m_method!=GET||!m_upgrade||!m_conn_upgrade||m_ws_version!=13||!m_ws_key) return BAD_REQUEST;
+    if(!websocket::accept_key(m_ws_key,strlen(m_ws_key),m_ws_accept)) return BAD_REQUEST;
+    if(!has_session()) return FORBIDDEN_REQUEST;
+    return UPGRADE_REQUEST;
+}
+
+//由处理器调用:响应体交给source分块生成,连接负责释放它
+http_conn::HTTP_CODE http_conn::stream(chunk_source *source,const mime_type *mime){
+    delete m_stream;
+    m_stream=source;
+    m_mime=mime;
+    return STREAM_REQUEST;
+}
+
+//从POST消息体中取出用户名和密码,如user=123&passwd=123.
+//在读缓冲区中原地解码,name和password指向读缓冲区,不分配内存
+bool http_conn::parse_user(char *body,size_t len,const char *&name,const char *&password){
+    url_form form;
+    url_form::slice user,passwd;
+    if(!body||!form.parse(body,len)||!form.get("user",user)||!form.get("passwd",passwd)) return false;
+    if(user.len==0) return false;
+    name=user.data;
+    password=passwd.data;
+    return true;
+}
+
+//登录:若浏览器端输入的用户名和密码在表中可以查找到,跳转欢迎界面,否则跳转错误界面
+http_conn::HTTP_CODE http_conn::do_login(const char *){
+    //只有POST才是登录请求,GET按普通文件处理
+    if(cgi!=1) return do_file(m_url);
+
+//同步线程登录校验
+#ifdef SYNSQL
+    const char *name, *password;
+    if(!parse_user(m_string,m_content_length,name,password)) return do_file("/logError.html");
+
+    m_lock.lock();
+    map<string, string>::iterator it=users.find(name);
+    bool found=(it!=users.end());
+    bool ok=(found&&it->second==password);
+    m_lock.unlock();
+
+    //内存表中没有的用户可能是其他实例注册的,回数据库查一次
+    if(!found&&load_user(name)){
+        m_lock.lock();
+        it=users.find(name);
+        ok=(it!=users.end()&&it->second==password);
+        m_lock.unlock();
     }
 
-        //跳转注册界面
-    if (*(p + 1) == '0'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    if(ok) start_session(name);
+    return do_file(ok?"/welcome.html":"/logError.html");
+#else
+    return do_file(m_url);
+#endif
+}
+
+//从数据库查找用户并放入内存表,返回是否找到.
+//同名用户的并发查询合并成一次,避免大量登录同时打到数据库
+bool http_conn::load_user(const char *name){
+    static single_flight<bool> flight;
+    return flight.run(name,[&](){ return query_user(name); });
+}
+
+bool http_conn::query_user(const char *name){
+    string password;
+    if(!user_backend->find(name,password)) return false;
+    m_lock.lock();
+    users[name].swap(password);
+    m_lock.unlock();
+    return true;
+}
 
-        free(m_url_real);
+//启动时把全部用户读入内存表,之后内存表未命中和注册都交给这个后端
+bool http_conn::init_users(user_store *store){
+    user_backend=store;
+    long long start=file_cache::now_ms();
+    long long rows=store->load(users,m_lock);
+    if(rows<0){
+        LOG_ERROR("%s","load users failed");
+        return false;
     }
-    //跳转登录界面
-    else if (*(p + 1) == '1'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    LOG_INFO("loaded %lld users in %lld ms",rows,file_cache::now_ms()-start);
+    return true;
+}
+
+//注册:先检测数据库中是否有重名的,没有重名的,进行增加数据
+http_conn::HTTP_CODE http_conn::do_register(const char *){
+    if(cgi!=1) return do_file(m_url);
 
-        free(m_url_real);
+#ifdef SYNSQL
+    const char *name, *password;
+    if(!parse_user(m_string,m_content_length,name,password)) return do_file("/registerError.html");
+
+    //先在内存表中占住用户名,同名的注册只有一个能写入存储
+    m_lock.lock();
+    bool taken=users.find(name)!=users.end()||!registering.insert(name).second;
+    m_lock.unlock();
+    if(taken) return do_file("/registerError.html");
+
+    //与同时到达的注册合并成一批写入
+    bool ok=user_backend->insert(name,password);
+    m_lock.lock();
+    registering.erase(name);
+    if(ok) users.insert(pair<string, string>(name, password));
+    size_t fans=users.size();
+    m_lock.unlock();
+
+    //通知粉丝页上的WebSocket连接
+    if(ok){
+        char msg[64];
+        int n=snprintf(msg,sizeof(msg),"{\"event\":\"fan\",\"fans\":%zu}",fans);
+        ws_hub::get_instance()->publish(msg,n);
     }
-    //跳转图片请求
-    else if (*(p + 1) == '5'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
 
-        free(m_url_real);
+    return do_file(ok?"/log.html":"/registerError.html");
+#else
+    return do_file(m_url);
+#endif
+}
+
+//模板页面:静态片段直接指向编译好的模板正文,只有变量的值转义后放进请求内存池,
+//m_iv改指向池中的iovec数组,第一项留给报头
+http_conn::HTTP_CODE http_conn::do_template(const html_template *page,const char *url){
+    const char *values[html_template::VAR_COUNT]={0};
+    size_t lens[html_template::VAR_COUNT]={0};
+    if(page->uses(html_template::VAR_USER)&&(m_user[0]||has_session())){
+        size_t len=strlen(m_user);
+        char *escaped=(char *)m_arena.alloc(len*6+1,1);
+        if(!escaped) return INTERNAL_ERROR;
+        values[html_template::VAR_USER]=escaped;
+        lens[html_template::VAR_USER]=html_template::escape(m_user,len,escaped);
+    }
+    if(page->uses(html_template::VAR_FANS)){
+        m_lock.lock();
+        size_t fans=users.size();
+        m_lock.unlock();
+        char *text=m_arena.printf("%zu",fans);
+        if(!text) return INTERNAL_ERROR;
+        values[html_template::VAR_FANS]=text;
+        lens[html_template::VAR_FANS]=strlen(text);
     }
-    //跳转视频请求
-    else if (*(p + 1) == '6'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    struct iovec *iv=(struct iovec *)m_arena.alloc(sizeof(struct iovec)*(page->segments()+1));
+    if(!iv) return INTERNAL_ERROR;
+    m_iv=iv;
+    m_iv_count=1+page->render(values,lens,iv+1,m_template_len);
+    m_mime=mime::lookup(url);
+    return TEMPLATE_REQUEST;
+}
 
-        free(m_url_real);
+//登录后才能访问的文件
+static const char *const protected_files[]={"/picture.html","/video.html","/fans.html"};
+
+//url是否指向受保护的文件:先按文件系统的方式去掉空段、"."和"..",
+//再与列表比较,文件名后面还有".gz"之类后缀的预压缩文件同样受保护
+static bool protected_file(const char *url){
+    char path[256];
+    size_t len=0;
+    const char *p=url;
+    while(*p){
+        while(*p=='/') ++p;
+        const char *end=p;
+        while(*end&&*end!='/') ++end;
+        size_t n=end-p;
+        bool dot=(n==1&&p[0]=='.');
+        if(n==2&&p[0]=='.'&&p[1]=='.'){
+            while(len>0&&path[len-1]!='/') --len;
+            if(len>0) --len;
+        }
+        else if(n>0&&!dot){
+            //超长的路径不会是列表中的文件,按受保护处理,宁可多回一次登录页
+            if(len+1+n>=sizeof(path)) return true;
+            path[len++]='/';
+            memcpy(path+len,p,n);
+            len+=n;
+        }
+        p=end;
+    }
+    for(size_t i=0;i<sizeof(protected_files)/sizeof(protected_files[0]);++i){
+        size_t plen=strlen(protected_files[i]);
+        if(len>=plen&&memcmp(path,protected_files[i],plen)==0&&(len==plen||path[plen]=='.')) return true;
     }
-    //跳转关注页面
-    else if (*(p + 1) == '7'){
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    return false;
+}
 
-        free(m_url_real);
+//将url与网站根目录拼接后分析目标文件的属性.
+//如果目标文件存在、对所有用户可读,小文件从file_cache取内容,大文件使用mmap将其映射到内存地址m_file_address处,并告诉调用者获取文件成功
+http_conn::HTTP_CODE http_conn::do_file(const char *url){
+    //受保护的文件不论从/5这样的入口还是直接按文件名请求(包括资源包和模板),都凭会话Cookie放行,否则回到登录页.
+    //会话有效只需一次哈希查找,不再校验密码
+    if(protected_file(url)&&!has_session()) url="/log.html";
+
+    //含占位符的页面在启动时已编译成模板
+    const html_template *page=template_cache::get_instance()->find(url);
+    if(page) return do_template(page,url);
+
+    //资源包模式下所有静态文件都在包内,不访问文件系统
+    if(static_pack::get_instance()->loaded()) return do_pack(url);
+
+    //网站根目录的长度只计算一次
+    static const size_t root_len=strlen(doc_root);
+    size_t url_len=strlen(url);
+    if(root_len+url_len>=FILENAME_LEN) return BAD_REQUEST;
+    memcpy(m_real_file,doc_root,root_len);
+    memcpy(m_real_file+root_len,url,url_len+1);
+
+    //过滤器确定不存在的文件直接404,不必stat;路径中有//或/.时可能被规范化,不做判断
+    if(!strstr(url,"//")&&!strstr(url,"/.")
+        &&!path_filter::get_instance()->may_exist(m_real_file,root_len+url_len)){
+        path_filter::get_instance()->count_avoided();
+        return NO_RESOURCE;
     }
-    else{
-        //如果以上均不符合，即不是登录和注册，直接将url与网站目录拼接
-        //这里的情况是welcome界面，请求服务器上的一个图片
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+
+    file_cache *files=file_cache::get_instance();
+    file_entry entry;
+    //I/O线程上不做任何系统调用,只使用最近校验过的缓存项,否则交给工作线程
+    if(m_inline){
+        if(!files->get_fresh(m_real_file,entry)) return DEFER_REQUEST;
+        m_file_stat.st_size=entry.size;
+        m_file_stat.st_mtime=entry.mtime;
+        m_mime=entry.mime;
+        m_body=entry.data;
+        if(m_mime->compressible&&m_accept_encoding&&!cached_encoding()) return DEFER_REQUEST;
+        return FILE_REQUEST;
     }
 
     //通过stat获取请求资源文件信息，成功则将信息更新到m_file_stat结构体
@@ -460,56 +1030,177 @@ http_conn::HTTP_CODE http_conn::do_request(){
     //判断文件类型，如果是目录，则返回BAD_REQUEST，表示请求报文有误
     if (S_ISDIR(m_file_stat.st_mode)) return BAD_REQUEST;
 
-    int fd=open(m_real_file,O_RDONLY);
-    m_file_address=mmap(0,m_file_stat.st_size,PROT_READ, MAP_PRIVATE, fd, 0);
-    close fd;
+    //按扩展名确定类型,文本类型按Accept-Encoding协商压缩,成功时响应体已经就绪
+    m_mime=mime::lookup(url);
+    //小文件读入缓存,之后的请求不再open/mmap
+    if(files->load(m_real_file,m_file_stat,m_mime,entry)) m_body=entry.data;
+    if(m_mime->compressible&&m_accept_encoding&&do_encoding()) return FILE_REQUEST;
+
+    if(!m_body&&!map_file(m_real_file)) return INTERNAL_ERROR;
     return FILE_REQUEST;
 }
 
-void http_conn::unmap(){
-    if(m_file_address){
-        munmap(m_file_address,m_file_stat.st_size);
-        m_file_address=0;
+//在资源包中查找url,按Accept-Encoding选择变体,全程没有系统调用
+http_conn::HTTP_CODE http_conn::do_pack(const char *url){
+    static_pack *pack=static_pack::get_instance();
+    const pack::entry *e=pack->find(url,strlen(url));
+    if(!e) return NO_RESOURCE;
+    m_pack_variant=pack->select(e,m_accept_encoding,m_content_encoding);
+
+    //客户端缓存的版本与包内一致时只回应304
+    const pack::variant *v=m_pack_variant;
+    if(m_if_none_match&&(strcmp(m_if_none_match,"*")==0
+        ||memmem(m_if_none_match,strlen(m_if_none_match),pack->data(v->etag_offset),v->etag_len))){
+        return NOT_MODIFIED;
     }
+    return FILE_REQUEST;
+}
+
+//将path映射到m_file_address,大小取m_file_stat;先放开已有的映射,响应体总是刚映射的这个文件.
+//描述符随映射一起保留,冷文件的预读通过它进行
+bool http_conn::map_file(const char *path){
+    m_file_address=0;
+    m_mapping.reset();
+    int fd=open(path,O_RDONLY|O_CLOEXEC);
+    if(fd<0) return false;
+    void *addr=mmap(0,m_file_stat.st_size,PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr==MAP_FAILED){
+        close(fd);
+        return false;
+    }
+    m_mapping=std::make_shared<mapped_file>(addr,m_file_stat.st_size,fd);
+    m_file_address=m_mapping->data();
+    return true;
+}
+
+//内容编码的优先顺序及预压缩文件的后缀
+static const CONTENT_ENCODING prefer[]={ENCODING_BR,ENCODING_GZIP};
+static const char *suffix[]={".br",".gz"};
+static const int prefer_count=sizeof(prefer)/sizeof(prefer[0]);
+
+//按Accept-Encoding选择内容编码,优先brotli.
+//先找doc_root中预压缩好的同名.br/.gz文件(不能比原文件旧),没有则即时压缩一次并放入缓存.
+//返回false时按原文件发送,此时m_body或m_file_address中可能已经是原文件
+bool http_conn::do_encoding(){
+    const int count=prefer_count;
+
+    size_t len=strlen(m_real_file);
+    char sibling[FILENAME_LEN+3];
+    memcpy(sibling,m_real_file,len);
+    for(int i=0;i<count;++i){
+        if(!(m_accept_encoding&prefer[i])) continue;
+        struct stat st;
+        memcpy(sibling+len,suffix[i],4);
+        if(!path_filter::get_instance()->may_exist(sibling,len+3)){
+            path_filter::get_instance()->count_avoided();
+            continue;
+        }
+        if(stat(sibling,&st)<0||!S_ISREG(st.st_mode)||st.st_mtime<m_file_stat.st_mtime) continue;
+        struct stat origin=m_file_stat;
+        m_file_stat=st;
+        if(map_file(sibling)){
+            m_body.reset();
+            m_content_encoding=prefer[i];
+            return true;
+        }
+        m_file_stat=origin;
+    }
+
+    if(m_file_stat.st_size==0||(size_t)m_file_stat.st_size>content_cache::MAX_FILE_SIZE) return false;
+    content_cache *cache=content_cache::get_instance();
+    for(int i=0;i<count;++i){
+        if(!(m_accept_encoding&prefer[i])) continue;
+        shared_body body=cache->get(m_real_file,m_file_stat.st_mtime,m_file_stat.st_size,prefer[i]);
+        if(!body){
+            if(!m_body&&!map_file(m_real_file)) return false;
+            const char *data=m_body?m_body->data():m_file_address;
+            body=cache->put(m_real_file,m_file_stat.st_mtime,m_file_stat.st_size,prefer[i],data);
+        }
+        //空结果表示该文件压缩不划算
+        if(!body->empty()){
+            unmap();
+            m_body=body;
+            m_content_encoding=prefer[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+//I/O线程上的编码协商:只用压缩缓存中已有的结果,不找预压缩文件也不即时压缩.
+//返回false表示需要交给工作线程
+bool http_conn::cached_encoding(){
+    if(m_file_stat.st_size==0||(size_t)m_file_stat.st_size>content_cache::MAX_FILE_SIZE) return true;
+    content_cache *cache=content_cache::get_instance();
+    for(int i=0;i<prefer_count;++i){
+        if(!(m_accept_encoding&prefer[i])) continue;
+        shared_body body=cache->get(m_real_file,m_file_stat.st_mtime,m_file_stat.st_size,prefer[i]);
+        if(!body) return false;
+        if(!body->empty()){
+            m_body=body;
+            m_content_encoding=prefer[i];
+            return true;
+        }
+    }
+    return true;
+}
+
+//响应体是mmap的文件或资源包且下一段未驻留内存时提交异步加载,返回true表示正在等待加载完成
+bool http_conn::wait_for_file(){
+    if((!m_file_address&&!m_pack_variant)||m_iv_count<2||m_iv[1].iov_len==0) return false;
+    size_t len=m_iv[1].iov_len<file_loader::WINDOW?m_iv[1].iov_len:file_loader::WINDOW;
+    //刚预读完的这一段不再等待:文件被截断后它永远不会驻留,直接发送,由writev报错
+    if(m_iv[1].iov_base==m_preloaded){
+        m_preloaded=NULL;
+        return false;
+    }
+    if(file_loader::resident(m_iv[1].iov_base,len)) return false;
+    const file_mapping &mapping=m_file_address?m_mapping:static_pack::get_instance()->mapping();
+    if(!file_loader::get_instance()->submit(mapping,m_iv[1].iov_base,len,on_file_loaded,this,m_load_id)) return false;
+    m_preloaded=m_iv[1].iov_base;
+    return true;
+}
+
+//在I/O线程上调用,数据已驻留,注册EPOLLOUT让主线程继续发送
+void http_conn::on_file_loaded(void *arg,unsigned id){
+    http_conn *conn=(http_conn *)arg;
+    //等待期间连接超时关闭或换了新连接时id已经不同
+    if(conn->m_load_id==id) modfd(m_epollfd,conn->m_sockfd,EPOLLOUT);
+}
+
+//映射在最后一个持有者放手时解除,预读任务还在访问时由它解除
+void http_conn::unmap(){
+    m_file_address=0;
+    m_preloaded=NULL;
+    m_mapping.reset();
+    m_body.reset();
+    m_pack_variant=NULL;
 }
 
 //写http响应,服务器子线程调用process_write完成响应报文，随后注册epollout事件。
 //服务器主线程检测写事件，并调用http_conn::write函数将响应报文发送给浏览器端。
 bool http_conn::write(){
     int temp=0;
-    int newadd=0;
+
+    if(m_h2) return h2_send();
 
     //若发送数据长度为0,表示响应报文为空，一般不会出现这种情况
     if(bytes_to_send==0){
         modfd(m_epollfd,m_sockfd,EPOLLIN);
-        init;
+        init();
         return true;
     }
 
     while(true){
+        //接下来要发送的文件内容不在页缓存中时先交给I/O线程预读,完成后再恢复发送
+        if(wait_for_file()) return true;
+
         //将响应报文的状态行、消息头、空行和响应正文发送给浏览器端
-        temp=writev(m_sockfd,m_iv,m_iv_count);
-
-        if(temp>0){
-            //更新已发送字节
-            bytes_have_send+=temp;
-            //偏移文件iovec的指针
-            newadd=bytes_have_send-m_write_idx;
-        }
-        if(temp<=-1){
-            //如果TCP写缓存没有空间
-            if(errno=EAGAIN){
-                //第一个iovec头部信息的数据已发送完，发送第二个iovec数据
-                if(bytes_have_send>=m_iv[0].iov_len){
-                    m_iv[0].iov_len=0;
-                    m_iv[1].iov_base=m_file_address+newadd;
-                    m_iv[1].iov_len=bytes_to_send;
-                }
-                //继续发送第一个iovec头部信息的数据
-                else{
-                    m_iv[0].iov_base=m_write_buf+bytes_to_send;
-                    m_iv[0].iov_len=m_iv[0].iov_len-bytes_have_send;
-                }
+        temp=send_iov(m_iv,m_iv_count);
+
+        if(temp<0){
+            //如果TCP写缓存没有空间,等待下一轮EPOLLOUT事件,iovec已指向未发送的部分
+            if(errno==EAGAIN){
                 modfd(m_epollfd,m_sockfd,EPOLLOUT);
                 return true;
             }
@@ -517,11 +1208,34 @@ bool http_conn::write(){
             unmap();
             return false;
         }
+
+        //更新已发送字节,并按发送量推进iovec,下次从未发送处继续
+        bytes_have_send+=temp;
         bytes_to_send-=temp;
+        size_t sent=temp;
+        for(int i=0;i<m_iv_count&&sent>0;++i){
+            if(sent>=m_iv[i].iov_len){
+                sent-=m_iv[i].iov_len;
+                m_iv[i].iov_len=0;
+            }
+            else{
+                m_iv[i].iov_base=(char *)m_iv[i].iov_base+sent;
+                m_iv[i].iov_len-=sent;
+                sent=0;
+            }
+        }
 
         //判断数据是否已发完
         if(bytes_to_send<=0){
+            //分块响应:上一块发完才生成下一块,写不动时停在EPOLLOUT上等待
+            if(m_stream){
+                next_chunk();
+                continue;
+            }
             unmap();
+            if(m_ws_state==WS_HANDSHAKE){
+                return open_websocket();
+            }
             modfd(m_epollfd,m_sockfd,EPOLLIN);
 
             //浏览器请求长连接
@@ -536,7 +1250,37 @@ bool http_conn::write(){
     }
 }
 
-bool http_conn::add_response(cosnt char* format,...){
+//从m_stream取下一块,加上块头块尾放入m_chunk;最后一块之后紧跟结束块"0\r\n\r\n"
+void http_conn::next_chunk(){
+    //块头最长为8位十六进制加\r\n,先留出位置,内容写好后再从后往前填
+    static const size_t HEAD=10;
+    bool more=true;
+    size_t len=0;
+    m_chunk.assign(HEAD,'\0');
+    while(more&&len==0){
+        more=m_stream->next(m_chunk);
+        len=m_chunk.size()-HEAD;
+    }
+    size_t start=HEAD;
+    if(len){
+        char head[HEAD+1];
+        int n=snprintf(head,sizeof(head),"%zx\r\n",len);
+        start=HEAD-n;
+        memcpy(&m_chunk[start],head,n);
+        m_chunk.append("\r\n",2);
+    }
+    if(!more){
+        m_chunk.append("0\r\n\r\n",5);
+        delete m_stream;
+        m_stream=NULL;
+    }
+    m_iv[0].iov_base=&m_chunk[start];
+    m_iv[0].iov_len=m_chunk.size()-start;
+    m_iv_count=1;
+    bytes_to_send=m_iv[0].iov_len;
+}
+
+bool http_conn::add_response(const char* format,...){
     if(m_write_idx>=WRITE_BUFFER_SIZE){
         return false;
     }
@@ -547,13 +1291,14 @@ bool http_conn::add_response(cosnt char* format,...){
     int len=vsnprintf(m_write_buf+m_write_idx,WRITE_BUFFER_SIZE-1-m_write_idx,format,arg_list);
 
     if(len>=(WRITE_BUFFER_SIZE-1-m_write_idx)){
+        va_end(arg_list);
         return false;
     }
 
     //更新m_write_idx位置
     m_write_idx+=len;
     va_end(arg_list);
-    return 
+    return true;
 }
 
 //添加状态行
@@ -563,9 +1308,7 @@ bool http_conn::add_status_line(int status,const char* title){
 
 //添加消息报头，具体为添加文本长度、连接状态和空行
 bool http_conn::add_headers(int content_len){
-    add_content_length(content_len);
-    add_linger();
-    add_blank_line();
+    return add_content_length(content_len)&&add_linger()&&add_blank_line();
 }
 
 //添加Content-Length，表示响应报文的长度
@@ -573,9 +1316,39 @@ bool http_conn::add_content_length(int content_len){
     return add_response("Content-Length:%d\r\n",content_len);
 }
 
-//添加文本类型，这里是html
-bool http_conn::add_content_type(){
-    return add_response("Content-Type:%s\r\n","text/html");
+//添加文本类型
+bool http_conn::add_content_type(const char *type){
+    return add_response("Content-Type:%s\r\n",type);
+}
+
+//直接拷贝预先格式化好的报头行,不经过vsnprintf
+bool http_conn::add_raw(const char *data,size_t len){
+    if(m_write_idx+len>=(size_t)WRITE_BUFFER_SIZE){
+        return false;
+    }
+    memcpy(m_write_buf+m_write_idx,data,len);
+    m_write_idx+=len;
+    return true;
+}
+
+//添加文件响应的消息报头:长度、类型、内容编码、连接状态和空行
+//可压缩的类型无论本次是否压缩都要带上Vary,避免中间缓存把压缩结果发给不支持的客户端
+bool http_conn::add_file_headers(int content_len){
+    if(!add_content_length(content_len)) return false;
+    if(!add_raw(m_mime->header,m_mime->header_len)) return false;
+    if(m_content_encoding!=ENCODING_IDENTITY
+        &&!add_response("Content-Encoding:%s\r\n",content_cache::encoding_name(m_content_encoding))){
+        return false;
+    }
+    if(m_mime->compressible&&!add_response("Vary:Accept-Encoding\r\n")) return false;
+    return add_session_cookie()&&add_linger()&&add_blank_line();
+}
+
+//本次请求新建了会话时下发Cookie,有效期与会话表一致
+bool http_conn::add_session_cookie(){
+    if(!m_session[0]) return true;
+    return add_response("Set-Cookie:sid=%s; Max-Age=%d; Path=/; HttpOnly\r\n",
+                        m_session,session_store::get_instance()->ttl_seconds());
 }
 
 //添加连接状态，通知浏览器端是保持连接还是关闭
@@ -583,6 +1356,12 @@ bool http_conn::add_linger(){
     return add_response("Connection:%s\r\n",(m_linger==true)?"keep-alive":"close");
 }
 
+//WebSocket握手响应的报头
+bool http_conn::add_upgrade_headers(){
+    static const char headers[]="Upgrade:websocket\r\nConnection:Upgrade\r\n";
+    return add_raw(headers,sizeof(headers)-1)&&add_response("Sec-WebSocket-Accept:%s\r\n",m_ws_accept);
+}
+
 //添加空行
 bool http_conn::add_blank_line(){
     return add_response("%s","\r\n");
@@ -609,16 +1388,16 @@ bool http_conn::process_write(HTTP_CODE ret){
         {
             add_status_line(400,error_400_title);
             add_headers(strlen(error_400_form));
-            if(!add_conrent(error_400_form)){
+            if(!add_content(error_400_form)){
                 return false;
             }
             break;
         }
-        case NO_REQUEST:
+        case NO_RESOURCE:
         {
-            add_status_line(404,error_404_title);
-            add_headers(strlen(error_404_form));
-            if(!add_conrent(error_404_form)){
+            bool ok=m_linger?add_raw(error_404_keepalive,sizeof(error_404_keepalive)-1)
+                            :add_raw(error_404_close,sizeof(error_404_close)-1);
+            if(!ok){
                 return false;
             }
             break;
@@ -627,26 +1406,87 @@ bool http_conn::process_write(HTTP_CODE ret){
         {
             add_status_line(403,error_403_title);
             add_headers(strlen(error_403_form));
-            if(!add_conrent(error_403_form)){
+            if(!add_content(error_403_form)){
                 return false;
             }
             break;
         }
         //请求的文件存在，通过io向量机制iovec，声明两个iovec，第一个指向m_write_buf，第二个指向mmap的地址m_file_address
+        case NOT_MODIFIED:
+        {
+            const pack::variant *v=m_pack_variant;
+            if(!add_status_line(304,"Not Modified")
+                ||!add_raw("ETag:",5)||!add_raw(static_pack::get_instance()->data(v->etag_offset),v->etag_len)
+                ||!add_raw("\r\n",2)||!add_linger()||!add_blank_line()){
+                return false;
+            }
+            break;
+        }
+        //分块响应先只发报头,响应体由write逐块生成
+        case STREAM_REQUEST:
+        {
+            if(!add_status_line(200,ok_200_title)||!add_raw(m_mime->header,m_mime->header_len)
+                ||!add_raw("Transfer-Encoding:chunked\r\n",27)||!add_session_cookie()
+                ||!add_linger()||!add_blank_line()){
+                return false;
+            }
+            break;
+        }
+        //模板页面是动态内容,不允许缓存
+        case TEMPLATE_REQUEST:
+        {
+            if(!add_status_line(200,ok_200_title)||!add_raw(m_mime->header,m_mime->header_len)
+                ||!add_content_length(m_template_len)||!add_raw("Cache-Control:no-store\r\n",24)
+                ||!add_session_cookie()||!add_linger()||!add_blank_line()){
+                return false;
+            }
+            m_iv[0].iov_base=m_write_buf;
+            m_iv[0].iov_len=m_write_idx;
+            bytes_to_send=m_write_idx+m_template_len;
+            return true;
+        }
+        //握手响应,发完后连接转为WebSocket
+        case UPGRADE_REQUEST:
+        {
+            if(!add_status_line(101,"Switching Protocols")||!add_upgrade_headers()||!add_blank_line()){
+                return false;
+            }
+            m_ws_state=WS_HANDSHAKE;
+            break;
+        }
         case FILE_REQUEST:
         {
             add_status_line(200,ok_200_title);
-            if(m_file_stat.st_size!=0){
-                add_headers(m_file_stat.st_size);
+            //资源包中的报头是预先拼好的,只需补上Connection
+            if(m_pack_variant){
+                const pack::variant *v=m_pack_variant;
+                const static_pack *pack=static_pack::get_instance();
+                if(!add_raw(pack->data(v->header_offset),v->header_len)||!add_session_cookie()
+                    ||!add_linger()||!add_blank_line()){
+                    return false;
+                }
+                m_iv[0].iov_base=m_write_buf;
+                m_iv[0].iov_len=m_write_idx;
+                m_iv[1].iov_base=(char *)pack->data(v->body_offset);
+                m_iv[1].iov_len=v->body_len;
+                m_iv_count=v->body_len?2:1;
+                bytes_to_send=m_write_idx+v->body_len;
+                return true;
+            }
+            //响应体为缓存中的压缩结果或mmap的文件
+            const char *body=m_body?m_body->data():m_file_address;
+            size_t body_len=m_body?m_body->size():(m_mapping?m_mapping->size():0);
+            if(body_len!=0){
+                add_file_headers(body_len);
                 //第一个iovec指针指向响应报文缓冲区，长度指向m_write_idx
                 m_iv[0].iov_base=m_write_buf;
                 m_iv[0].iov_len=m_write_idx;
-                //第二个iovec指针指向mmap返回的文件指针，长度指向文件大小
-                m_iv[1].iov_base=m_file_address;
-                m_iv[1].iov_len=m_file_stat.st_size;
+                //第二个iovec指针指向响应体，长度为响应体大小
+                m_iv[1].iov_base=(char *)body;
+                m_iv[1].iov_len=body_len;
                 m_iv_count=2;
-                //发送的全部数据为响应报文头部信息和文件大小
-                bytes_to_send = m_write_idx + m_file_stat.st_size;
+                //发送的全部数据为响应报文头部信息和响应体大小
+                bytes_to_send = m_write_idx + body_len;
                 return true;
             }
             else{
@@ -656,6 +1496,7 @@ bool http_conn::process_write(HTTP_CODE ret){
                     return false;
                 }
             }
+            break;
         }
         default:
         {
@@ -667,21 +1508,592 @@ bool http_conn::process_write(HTTP_CODE ret){
     m_iv[0].iov_base=m_write_buf;
     m_iv[0].iov_len=m_write_idx;
     m_iv_count=1;
+    bytes_to_send=m_write_idx;
     return true;
 }
 
 void http_conn::process()
 {
-    HTTP_CODE read_ret = process_read();
+    //HTTPS连接的握手要做签名和密钥交换,放在工作线程上推进
+    if (m_tls_state == TLS_HANDSHAKE)
+    {
+        tls_handshake();
+        return;
+    }
+    //HTTP/2连接:读到的数据都交给会话,以连接前言开头的新连接在这里建立会话
+    if (m_h2 || h2_preface())
+    {
+        if (!m_h2)
+            m_h2 = new h2_session(this);
+        h2_process(0);
+        return;
+    }
+    //I/O线程已经解析完、交过来的请求直接分派
+    HTTP_CODE read_ret;
+    if (m_deferred)
+    {
+        m_deferred = false;
+        read_ret = do_request();
+    }
+    else
+        read_ret = process_read();
+    //协程处理器挂起,之后在主线程上完成
+    if (read_ret == ASYNC_REQUEST)
+        return;
     if (read_ret == NO_REQUEST)
     {
         modfd(m_epollfd, m_sockfd, EPOLLIN);
         return;
     }
+    //升级请求之后读缓冲区中可能已经有连接前言和帧
+    if (read_ret == H2_REQUEST)
+    {
+        h2_process(m_checked_idx);
+        return;
+    }
     bool write_ret = process_write(read_ret);
     if (!write_ret)
     {
         close_conn();
     }
     modfd(m_epollfd, m_sockfd, EPOLLOUT);
-}
\ No newline at end of file
+}
+
+//在I/O线程上直接处理请求:请求已经完整到达且命中静态缓存时,当场生成响应并发送,
+//省去线程池的入队、唤醒和一次EPOLLOUT往返;需要阻塞的请求(数据库、未缓存的文件、压缩)交给线程池
+http_conn::INLINE_RESULT http_conn::process_inline()
+{
+    //HTTP/2的帧在工作线程上处理,流上的请求可能需要阻塞
+    if (m_h2 || h2_preface())
+        return INLINE_DEFER;
+    m_inline = true;
+    HTTP_CODE read_ret = process_read();
+    m_inline = false;
+    if (read_ret == NO_REQUEST)
+    {
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+        return INLINE_DONE;
+    }
+    if (read_ret == DEFER_REQUEST)
+    {
+        m_deferred = true;
+        return INLINE_DEFER;
+    }
+    if (read_ret == ASYNC_REQUEST)
+        return INLINE_DONE;
+    if (!process_write(read_ret))
+        return INLINE_CLOSE;
+    return write() ? INLINE_DONE : INLINE_CLOSE;
+}
+
+//连接在等待期间被关闭时协程已由handler_task::resume销毁,不会走到这里
+void http_conn::finish_async(HTTP_CODE ret)
+{
+    //还需要阻塞的工作(如读取未缓存的页面)交回线程池,由工作线程从do_request继续
+    if (ret == DEFER_REQUEST)
+    {
+        m_deferred = true;
+        if (!m_pool || !m_pool->append(this))
+            close_conn();
+        return;
+    }
+    if (!process_write(ret))
+    {
+        close_conn();
+        return;
+    }
+    modfd(m_epollfd, m_sockfd, EPOLLOUT);
+}
+
+void http_conn::wait_readable(void (*resume)(void *), void *arg)
+{
+    m_reader = resume;
+    m_reader_arg = arg;
+    modfd(m_epollfd, m_sockfd, EPOLLIN);
+}
+
+//没有协程在等待时返回false,由调用者按普通请求处理
+bool http_conn::resume_reader(bool ok)
+{
+    if (!m_reader)
+        return false;
+    void (*resume)(void *) = m_reader;
+    m_reader = NULL;
+    m_reader_ok = ok;
+    resume(m_reader_arg);
+    return true;
+}
+
+//101响应发完:连接加入广播表,之后的读写由ws_event处理
+bool http_conn::open_websocket()
+{
+    m_ws_state = WS_OPEN;
+    //握手请求之后已经读到的字节是客户端的帧,移到缓冲区开头
+    int rest = m_read_idx - m_checked_idx;
+    memmove(m_read_buf, m_read_buf + m_checked_idx, rest);
+    m_read_idx = rest;
+    m_checked_idx = 0;
+    m_start_line = 0;
+    ws_hub::get_instance()->subscribe(this);
+    if (rest > 0 && !ws_read())
+        return false;
+    return ws_event(0);
+}
+
+//主循环在WebSocket连接可读或可写时调用,返回false表示应当关闭连接
+bool http_conn::ws_event(uint32_t events)
+{
+    if (m_ws_state == WS_FAILED)
+        return false;
+    if ((events & EPOLLIN) && (!read_once() || !ws_read()))
+        return false;
+    if (!ws_send())
+        return false;
+    //队列发完时只等待读;写不动时ws_send已注册EPOLLOUT
+    if (m_ws_head == m_ws_queue.size())
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+    return true;
+}
+
+//解析读缓冲区中所有完整的帧,不完整的帧留在缓冲区开头等待下次读取
+bool http_conn::ws_read()
+{
+    //帧头最长14字节,超过缓冲区的帧无法完整读入,直接断开
+    static const size_t MAX_PAYLOAD = READ_BUFFER_SIZE - 14;
+    size_t pos = 0;
+    while (true)
+    {
+        websocket::frame f;
+        size_t used;
+        websocket::PARSE_RESULT ret = websocket::parse(m_read_buf + pos, m_read_idx - pos, MAX_PAYLOAD, f, used);
+        if (ret == websocket::FRAME_BAD)
+            return false;
+        if (ret == websocket::FRAME_INCOMPLETE)
+            break;
+        pos += used;
+        if (m_ws_state != WS_OPEN)
+            continue;
+        if (f.opcode == websocket::OP_PING)
+        {
+            shared_body pong = websocket::encode(websocket::OP_PONG, f.payload, f.len);
+            if (!ws_enqueue(&pong, 1))
+                return false;
+        }
+        else if (f.opcode == websocket::OP_CLOSE)
+        {
+            //回应同样的状态码,发完后关闭连接;之后不再接收广播
+            shared_body close = websocket::encode(websocket::OP_CLOSE, f.payload, f.len >= 2 ? 2 : 0);
+            if (!ws_enqueue(&close, 1))
+                return false;
+            m_ws_state = WS_CLOSING;
+            ws_hub::get_instance()->unsubscribe(this);
+        }
+        //通知是单向的,客户端发来的数据帧和pong只用于保持连接活跃
+    }
+    memmove(m_read_buf, m_read_buf + pos, m_read_idx - pos);
+    m_read_idx -= pos;
+    return true;
+}
+
+//放入发送队列,积压超过WS_QUEUE_LIMIT时标记连接失败
+bool http_conn::ws_enqueue(const shared_body *frames, size_t count)
+{
+    if (m_ws_queue.size() - m_ws_head + count > WS_QUEUE_LIMIT)
+    {
+        ws_fail();
+        return false;
+    }
+    m_ws_queue.insert(m_ws_queue.end(), frames, frames + count);
+    return true;
+}
+
+//广播调用:队列原本为空时当场发送,否则连接正在等待EPOLLOUT,由ws_event接着发送
+bool http_conn::ws_push(const shared_body *frames, size_t count)
+{
+    if (m_ws_state != WS_OPEN)
+        return true;
+    bool idle = m_ws_head == m_ws_queue.size();
+    if (!ws_enqueue(frames, count))
+        return false;
+    if (idle && !ws_send())
+    {
+        ws_fail();
+        return false;
+    }
+    return true;
+}
+
+//用一次writev发送队列中尽可能多的帧;写不动时注册EPOLLOUT,返回false表示连接应当关闭
+bool http_conn::ws_send()
+{
+    static const int MAX_IOV = 64;
+    while (m_ws_head < m_ws_queue.size())
+    {
+        struct iovec iv[MAX_IOV];
+        int count = 0;
+        for (size_t i = m_ws_head; i < m_ws_queue.size() && count < MAX_IOV; ++i, ++count)
+        {
+            size_t skip = i == m_ws_head ? m_ws_offset : 0;
+            iv[count].iov_base = (char *)m_ws_queue[i]->data() + skip;
+            iv[count].iov_len = m_ws_queue[i]->size() - skip;
+        }
+        ssize_t sent = send_iov(iv, count);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                return false;
+            modfd(m_epollfd, m_sockfd, EPOLLIN | EPOLLOUT);
+            return true;
+        }
+        //发完的帧释放引用,最后一个订阅者发完时编码结果随之释放
+        size_t left = sent;
+        while (left > 0)
+        {
+            size_t rest = m_ws_queue[m_ws_head]->size() - m_ws_offset;
+            if (left < rest)
+            {
+                m_ws_offset += left;
+                break;
+            }
+            left -= rest;
+            m_ws_queue[m_ws_head++].reset();
+            m_ws_offset = 0;
+        }
+    }
+    //空闲连接只保留很小的队列容量
+    if (m_ws_queue.capacity() > 16)
+        std::vector<shared_body>().swap(m_ws_queue);
+    else
+        m_ws_queue.clear();
+    m_ws_head = 0;
+    m_ws_offset = 0;
+    return m_ws_state != WS_CLOSING;
+}
+
+//广播中不能关闭连接:丢掉队列并关闭socket的读写,主循环收到EPOLLRDHUP后按正常流程关闭
+void http_conn::ws_fail()
+{
+    if (m_ws_state == WS_FAILED)
+        return;
+    m_ws_state = WS_FAILED;
+    std::vector<shared_body>().swap(m_ws_queue);
+    m_ws_head = 0;
+    m_ws_offset = 0;
+    shutdown(m_sockfd, SHUT_RDWR);
+    modfd(m_epollfd, m_sockfd, EPOLLIN);
+}
+
+//连接来自HTTPS端口时由主线程在init之后调用,之后的第一个事件进入线程池开始握手
+bool http_conn::start_tls()
+{
+    m_ssl = tls_context::get_instance()->accept(m_sockfd);
+    if (!m_ssl)
+        return false;
+    m_tls_state = TLS_HANDSHAKE;
+    return true;
+}
+
+//推进一步握手.完成后检查OpenSSL是否已把发送方向交给内核,之后回到普通的请求处理;
+//失败时关闭socket的读写,主循环收到EPOLLRDHUP后按正常流程关闭
+void http_conn::tls_handshake()
+{
+    tls_context *tls = tls_context::get_instance();
+    ERR_clear_error();
+    int ret = SSL_do_handshake(m_ssl);
+    if (ret == 1)
+    {
+        m_tls_state = TLS_OPEN;
+        m_ktls_send = BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+        tls->count_handshake(m_ssl, m_ktls_send, BIO_get_ktls_recv(SSL_get_rbio(m_ssl)));
+        //请求可能和握手的最后一个报文一起到达,已经在OpenSSL的缓冲中
+        if (SSL_pending(m_ssl) > 0 || SSL_has_pending(m_ssl))
+        {
+            if (!read_once())
+            {
+                shutdown(m_sockfd, SHUT_RDWR);
+                modfd(m_epollfd, m_sockfd, EPOLLIN);
+                return;
+            }
+            process();
+            return;
+        }
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+        return;
+    }
+    int err = SSL_get_error(m_ssl, ret);
+    if (err == SSL_ERROR_WANT_READ)
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+    else if (err == SSL_ERROR_WANT_WRITE)
+        modfd(m_epollfd, m_sockfd, EPOLLOUT);
+    else
+    {
+        tls->count_failure();
+        ERR_clear_error();
+        shutdown(m_sockfd, SHUT_RDWR);
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+    }
+}
+
+//HTTPS连接的read_once:读出OpenSSL中已解密的全部数据,直到socket上没有完整的记录
+bool http_conn::tls_read()
+{
+    while (m_read_idx < READ_BUFFER_SIZE)
+    {
+        ERR_clear_error();
+        int n = SSL_read(m_ssl, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx);
+        if (n > 0)
+        {
+            m_read_idx += n;
+            continue;
+        }
+        //WANT_WRITE:OpenSSL要先发出握手后的报文(如会话票据),下次可读时再继续
+        int err = SSL_get_error(m_ssl, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+            return true;
+        //close_notify或错误
+        return false;
+    }
+    return true;
+}
+
+//writev的替代:明文连接和发送方向已交给内核的HTTPS连接直接writev,iovec中的mmap文件和缓存的响应体不经过用户态拷贝;
+//否则逐段SSL_write.返回值和errno与writev相同,写不动时为-1且errno为EAGAIN
+ssize_t http_conn::send_iov(const struct iovec *iv, int count)
+{
+    if (!m_ssl || m_ktls_send)
+        return writev(m_sockfd, iv, count);
+    ssize_t total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (iv[i].iov_len == 0)
+            continue;
+        //写不动后重试时iovec没有推进,传给SSL_write的仍是同一段数据,满足OpenSSL的重试要求
+        ERR_clear_error();
+        int n = SSL_write(m_ssl, iv[i].iov_base, iv[i].iov_len > INT_MAX ? INT_MAX : (int)iv[i].iov_len);
+        if (n > 0)
+        {
+            total += n;
+            if ((size_t)n < iv[i].iov_len)
+                break;
+            continue;
+        }
+        int err = SSL_get_error(m_ssl, n);
+        if (total > 0)
+            break;
+        errno = (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? EAGAIN : EIO;
+        return -1;
+    }
+    return total;
+}
+
+//以HTTP/2连接前言开头的新连接(prior knowledge)
+bool http_conn::h2_preface() const
+{
+    return m_check_state == CHECK_STATE_REQUESTLINE && m_start_line == 0 && m_read_idx >= 4
+           && memcmp(m_read_buf, "PRI ", 4) == 0;
+}
+
+//h2c升级:把已解析的请求搬进流1,读缓冲区随后会被h2_dispatch重置.HTTP2-Settings无效时返回false
+bool http_conn::h2_upgrade()
+{
+    h2_stream *s = new h2_stream(1);
+    s->method = m_method == POST ? "POST" : "GET";
+    s->path = m_url;
+    if (m_host)
+        s->authority = m_host;
+    if (m_cookie)
+        s->cookie = m_cookie;
+    if (m_if_none_match)
+        s->if_none_match = m_if_none_match;
+    if (m_accept_encoding & ENCODING_BR)
+        s->accept_encoding = "br";
+    if (m_accept_encoding & ENCODING_GZIP)
+        s->accept_encoding += s->accept_encoding.empty() ? "gzip" : ", gzip";
+
+    m_h2 = new h2_session(this);
+    if (!m_h2->upgrade(m_h2_settings, strlen(m_h2_settings), s))
+    {
+        delete s;
+        delete m_h2;
+        m_h2 = NULL;
+        return false;
+    }
+    return true;
+}
+
+//在工作线程上处理HTTP/2连接的输入:读缓冲区从from开始的数据交给会话,缓冲区满时继续读,
+//之后发送各流的响应;出错或会话结束时关闭连接
+void http_conn::h2_process(int from)
+{
+    bool readable = true;
+    while (true)
+    {
+        bool full = m_read_idx == READ_BUFFER_SIZE;
+        bool ok = m_h2->feed(m_read_buf + from, m_read_idx - from);
+        m_read_idx = 0;
+        from = 0;
+        //出错时GOAWAY已在发送队列中,由h2_send发出后关闭
+        if (!ok || !full)
+            break;
+        //边沿触发:读缓冲区满时socket中可能还有数据
+        if (!read_once())
+        {
+            readable = false;
+            break;
+        }
+    }
+    if (!h2_send() || !readable)
+    {
+        shutdown(m_sockfd, SHUT_RDWR);
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+    }
+}
+
+//发送会话中待发送的帧,直到写不动或没有数据;写不动时同时等待可读和可写,
+//流量控制窗口用完时只等待对方的WINDOW_UPDATE.返回false表示连接应当关闭
+bool http_conn::h2_send()
+{
+    struct iovec iv[64];
+    while (true)
+    {
+        int count = m_h2->pending(iv, sizeof(iv) / sizeof(iv[0]));
+        if (count == 0)
+            break;
+        ssize_t n = send_iov(iv, count);
+        if (n < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                modfd(m_epollfd, m_sockfd, EPOLLIN | EPOLLOUT);
+                return true;
+            }
+            return false;
+        }
+        m_h2->sent(n);
+    }
+    if (m_h2->done())
+        return false;
+    modfd(m_epollfd, m_sockfd, EPOLLIN);
+    return true;
+}
+
+//HTTP/2中不允许出现的逐跳报头
+static bool h2_hop_by_hop(const char *name, size_t len)
+{
+    static const char *const names[] = {"connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        if (strlen(names[i]) == len && memcmp(names[i], name, len) == 0)
+            return true;
+    return false;
+}
+
+//HTTP/2流上的请求:借用连接的请求状态交给与HTTP/1.1相同的路由和处理器,
+//再把写缓冲区中的状态行和报头转成HPACK报头块,响应体交给流持有,DATA帧直接引用它
+void http_conn::h2_dispatch(h2_stream &s)
+{
+    init();
+    m_linger = true;
+    HTTP_CODE ret = BAD_REQUEST;
+    bool valid = !s.path.empty() && s.path[0] == '/' && s.path.size() < FILENAME_LEN;
+    if (s.method == "GET")
+        m_method = GET;
+    else if (s.method == "POST")
+    {
+        m_method = POST;
+        cgi = 1;
+    }
+    else
+        valid = false;
+    //与请求行一致:url为/时显示判断界面
+    if (valid && (m_url = (char *)m_arena.alloc(s.path.size() + sizeof("judge.html"), 1)))
+    {
+        memcpy(m_url, s.path.c_str(), s.path.size() + 1);
+        if (s.path.size() == 1)
+            strcat(m_url, "judge.html");
+        m_string = &s.body[0];
+        m_content_length = s.body.size();
+        m_cookie = s.cookie.empty() ? NULL : &s.cookie[0];
+        m_if_none_match = s.if_none_match.empty() ? NULL : &s.if_none_match[0];
+        m_host = s.authority.empty() ? NULL : &s.authority[0];
+        m_accept_encoding = parse_accept_encoding(s.accept_encoding.c_str());
+        ret = do_request();
+    }
+    if (!process_write(ret))
+    {
+        unmap();
+        delete m_stream;
+        m_stream = NULL;
+        m_write_idx = 0;
+        process_write(INTERNAL_ERROR);
+    }
+
+    //报头以空行结束,空行之后的部分(错误页面)属于响应体
+    const char *head_end = (const char *)memmem(m_write_buf, m_write_idx, "\r\n\r\n", 4);
+    if (!head_end)
+    {
+        unmap();
+        hpack_encoder::status(s.headers, 500);
+        return;
+    }
+    size_t head_len = head_end - m_write_buf + 4;
+    hpack_encoder::status(s.headers, atoi(m_write_buf + 9));
+    const char *line = (const char *)memchr(m_write_buf, '\n', m_write_idx) + 1;
+    const char *end = head_end + 2;
+    while (line < end)
+    {
+        const char *eol = (const char *)memmem(line, end - line, "\r\n", 2);
+        const char *colon = (const char *)memchr(line, ':', eol - line);
+        size_t name_len = colon ? colon - line : 0;
+        char name[64];
+        if (name_len > 0 && name_len < sizeof(name))
+        {
+            for (size_t i = 0; i < name_len; ++i)
+                name[i] = tolower((unsigned char)line[i]);
+            const char *value = colon + 1;
+            while (value < eol && (*value == ' ' || *value == '\t'))
+                ++value;
+            if (!h2_hop_by_hop(name, name_len))
+                hpack_encoder::header(s.headers, name, name_len, value, eol - value);
+        }
+        line = eol + 2;
+    }
+
+    size_t tail = m_write_idx - head_len;
+    if (m_stream)
+    {
+        s.source = m_stream;
+        m_stream = NULL;
+    }
+    else if (m_iv_count == 2 && tail == 0 && m_body && m_iv[1].iov_base == m_body->data())
+    {
+        s.owned = m_body;
+        s.data = m_body->data();
+        s.len = m_body->size();
+    }
+    else if (m_iv_count == 2 && tail == 0 && m_file_address && m_iv[1].iov_base == m_file_address)
+    {
+        //大文件的映射交给流,发完后由流释放
+        s.map.swap(m_mapping);
+        s.data = s.map->data();
+        s.len = s.map->size();
+        m_file_address = 0;
+    }
+    else if (m_iv_count == 2 && tail == 0 && m_pack_variant)
+    {
+        s.data = (const char *)m_iv[1].iov_base;
+        s.len = m_iv[1].iov_len;
+    }
+    else
+    {
+        //错误页面和模板页面的片段拼成一块,模板的片段在请求内存池中,下一个流会重置它
+        std::string *body = new std::string(m_write_buf + head_len, tail);
+        for (int i = 1; i < m_iv_count; ++i)
+            body->append((const char *)m_iv[i].iov_base, m_iv[i].iov_len);
+        s.owned.reset(body);
+        s.data = body->data();
+        s.len = body->size();
+    }
+    unmap();
+}
@@ -19,8 +19,34 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <atomic>
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "router.h"
+#include "content_cache.h"
+#include "file_cache.h"
+#include "arena.h"
+#include "file_loader.h"
+#include "path_filter.h"
+#include "static_pack.h"
+#include "session_store.h"
+#include "user_store.h"
+#include "chunk_source.h"
+#include "websocket.h"
+#include "html_template.h"
+#include "tls.h"
+#include "http2.h"
+#include "mime.h"
+#include "../process/shared_stats.h"
+
+template<typename T> class threadpool;
+
+//编译器支持C++20协程时启用协程风格的路由处理器(http/coroutine.h)
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+#define COROUTINE_HANDLERS
+class handler_task;
+#endif
+
 class http_conn
 {
 public:
@@ -60,7 +86,14 @@ public:
         FORBIDDEN_REQUEST,//客户对资源没有足够的访问权限
         FILE_REQUEST,//文件存在
         INTERNAL_ERROR,//服务器内部错误
-        CLOSED_CONNECTION//客户端已经关闭连接
+        CLOSED_CONNECTION,//客户端已经关闭连接
+        NOT_MODIFIED,//条件请求的ETag未变,回应304
+        ASYNC_REQUEST,//协程处理器已挂起,完成后由finish_async填写响应
+        DEFER_REQUEST,//I/O线程上无法立即处理,需要交给工作线程
+        STREAM_REQUEST,//响应体由chunk_source分块生成
+        UPGRADE_REQUEST,//WebSocket握手成功,回应101
+        TEMPLATE_REQUEST,//响应体由页面模板渲染
+        H2_REQUEST//h2c升级成功,连接转为HTTP/2
     };
     //从状态机可能状态
     enum LINE_STATUS
@@ -69,30 +102,97 @@ public:
         LINE_BAD,//行出错
         LINE_OPEN//行数据不完整
     };
+    //process_inline的结果
+    enum INLINE_RESULT
+    {
+        INLINE_DONE = 0,//已处理,等待后续事件
+        INLINE_DEFER,//需要交给线程池
+        INLINE_CLOSE//需要关闭连接
+    };
+    //WebSocket连接的状态
+    enum WS_STATE
+    {
+        WS_NONE = 0,//普通http连接
+        WS_HANDSHAKE,//101响应正在发送
+        WS_OPEN,//已加入广播表
+        WS_CLOSING,//已回应关闭帧,发完后关闭连接
+        WS_FAILED//发送失败或积压过多,等待主循环关闭
+    };
+    //HTTPS连接的状态
+    enum TLS_STATE
+    {
+        TLS_NONE = 0,//明文连接
+        TLS_HANDSHAKE,//握手进行中,由线程池推进
+        TLS_OPEN//握手完成
+    };
+    //WebSocket连接发送队列中最多积压的帧数,超过时断开,不让慢客户端占用内存
+    static const size_t WS_QUEUE_LIMIT = 256;
+    //路由项:处理器及其参数(如跳转的目标页面)
+    struct route
+    {
+        HTTP_CODE (http_conn::*handler)(const char *target);
+        const char *target;
+    };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_file_address(NULL), m_preloaded(NULL), m_load_id(0), m_reader(NULL), m_reader_arg(NULL), m_reader_ok(false), m_stream(NULL),
+                  m_ws_state(WS_NONE), m_ws_slot(-1), m_ws_head(0), m_ws_offset(0), m_ssl(NULL), m_tls_state(TLS_NONE), m_h2(NULL) {}
+    ~http_conn()
+    {
+        delete m_stream;
+        delete m_h2;
+    }
 
 public:
     //初始化新接受的连接
     void init(int sockfd, const sockaddr_in &addr);
+    //连接来自HTTPS端口:创建SSL对象,之后的事件先用于握手
+    bool start_tls();
+    bool tls_handshaking() const { return m_tls_state == TLS_HANDSHAKE; }
+    bool is_tls() const { return m_ssl != NULL; }
     //关闭连接
     void close_conn(bool real_close = true);
+    //释放连接上跨请求的资源,连接被定时器关闭时由主线程调用
+    void release();
     //处理客户请求
     void process();
+    //在I/O线程上尝试直接处理请求
+    INLINE_RESULT process_inline();
     //非阻塞读操作
     bool read_once();
     //非阻塞写操作
     bool write();
+    //过载时用预先生成的503拒绝
+    static void reject(int sockfd);
     sockaddr_in *get_address()
     {
         return &m_address;
     }
-    void initmysql_result(connection_pool *connPool);
+    //协程处理器在主线程上完成后填写响应并注册EPOLLOUT;结果为DEFER_REQUEST时交回线程池
+    void finish_async(HTTP_CODE ret);
+    //连接的代号,每个新连接和每次关闭都会改变;挂起的协程恢复时据此判断连接是否还是原来的
+    unsigned generation() const { return m_load_id; }
+    //协程等待socket可读,主线程读到数据或连接关闭时调用resume_reader恢复它
+    void wait_readable(void (*resume)(void *), void *arg);
+    bool resume_reader(bool ok);
+    bool reader_ok() const { return m_reader_ok; }
+    //握手完成后连接上的读写都在主线程上由ws_event处理,不再进入线程池
+    bool is_websocket() const { return m_ws_state >= WS_OPEN; }
+    bool ws_event(uint32_t events);
+    //选择用户存储后端,并在启动时把全部用户读入内存表
+    static bool init_users(user_store *store);
+    //本进程的统计计数,多进程模式下工作进程定期发布到共享内存
+    static void collect_stats(worker_counters &c);
     void initresultFile(connection_pool *connPool);
 
 private:
+    //微基准测试(bench/microbench.cpp)需要直接驱动解析状态机
+    friend class http_conn_bench;
+    //广播表直接操作订阅者的下标和发送队列
+    friend class ws_hub;
+    //HTTP/2会话把请求完整的流交给h2_dispatch
+    friend class h2_session;
+
     //初始化连接
     void init();
     //解析http请求
@@ -104,19 +204,72 @@ private:
     HTTP_CODE parse_request_line(char *text);
     HTTP_CODE parse_headers(char *text);
     HTTP_CODE parse_content(char *text);
+    HTTP_CODE parse_chunked(char *body);
     HTTP_CODE do_request();
     char *get_line() { return m_read_buf + m_start_line; };
     LINE_STATUS parse_line();
 
+    //下面这组函数是路由处理器,由do_request按url分派
+    static const router<route> &routes();
+    static router<route> build_routes();
+    HTTP_CODE do_redirect(const char *target);
+    HTTP_CODE do_login(const char *target);
+    HTTP_CODE do_register(const char *target);
+    HTTP_CODE do_status(const char *target);
+    HTTP_CODE do_websocket(const char *target);
+    HTTP_CODE stream(chunk_source *source, const mime_type *mime);
+#ifdef COROUTINE_HANDLERS
+    HTTP_CODE do_co_login(const char *target);
+    handler_task login_flow();
+#endif
+    HTTP_CODE do_file(const char *url);
+    HTTP_CODE do_pack(const char *url);
+    HTTP_CODE do_template(const html_template *page, const char *url);
+    bool map_file(const char *path);
+    bool do_encoding();
+    bool cached_encoding();
+    static bool load_user(const char *name);
+    static bool query_user(const char *name);
+    static bool parse_user(char *body, size_t len, const char *&name, const char *&password);
+    bool start_session(const char *user);
+    bool has_session();
+
     //下面这组函数被process_write调用以填充http请求
     void unmap();
+    bool wait_for_file();
+    void next_chunk();
+
+    //下面这组函数是socket上的读写,HTTPS连接经过OpenSSL或kTLS
+    void tls_handshake();
+    bool tls_read();
+    ssize_t send_iov(const struct iovec *iv, int count);
+
+    //下面这组函数处理HTTP/2(h2c)连接,帧的收发由m_h2完成,流上的请求仍交给上面的处理器
+    bool h2_preface() const;
+    bool h2_upgrade();
+    void h2_process(int from);
+    bool h2_send();
+    void h2_dispatch(h2_stream &s);
+
+    //下面这组函数处理握手之后的WebSocket连接,只在主线程上调用
+    bool open_websocket();
+    bool ws_read();
+    bool ws_enqueue(const shared_body *frames, size_t count);
+    bool ws_push(const shared_body *frames, size_t count);
+    bool ws_send();
+    void ws_fail();
+    static void on_file_loaded(void *arg, unsigned id);
     bool add_response(const char *format, ...);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
     bool add_headers(int content_length);
-    bool add_content_type();
+    bool add_content_type(const char *type);
+    bool add_file_headers(int content_length);
+    bool add_session_cookie();
+    bool add_raw(const char *data, size_t len);
     bool add_content_length(int content_length);
     bool add_linger();
+    bool add_upgrade_headers();
     bool add_blank_line();
 
 public:
@@ -124,6 +277,8 @@ public:
     static int m_epollfd;
     //统计用户数量
     static int m_user_count;
+    //处理请求的线程池,协程处理器在主线程上完成时还需要阻塞的请求交回这里
+    static threadpool<http_conn> *m_pool;
     MYSQL *mysql;
 
 private:
@@ -162,18 +317,63 @@ private:
     //http请求是否要求保持连接
     bool m_linger;
 
-    //客户请求的目标文件被mmap到内存中的起始位置
+    //客户请求的目标文件被mmap到内存中的起始位置,m_mapping持有这段映射.
+    //长度取m_mapping:m_file_stat会被之后的stat覆盖;排队中的预读任务也持有映射,连接放手后它才解除
     char *m_file_address;
+    file_mapping m_mapping;
     //目标文件的状态,通过它我们可以判断文件是否存在、是否为目录、是否可读,并获取文件大小等信息
     struct stat m_file_stat;
-    //将采用writev来执行写操作,m_iv_count表示被写到内存块的数量
-    struct iovec m_iv[2];
+    //将采用writev来执行写操作,m_iv_count表示被写到内存块的数量.
+    //m_iv通常指向m_iv_buf,模板页面的片段较多,改指向请求内存池中的数组
+    struct iovec m_iv_buf[2];
+    struct iovec *m_iv;
     int m_iv_count;
+    size_t m_template_len;                  //模板渲染结果的总长度
 
     int cgi;        //是否启用的POST
     char *m_string; //存储请求头数据
     int bytes_to_send;//需要发送的字节数
     int bytes_have_send;//已发送字节数
+
+    int m_accept_encoding;                  //客户端可接受的内容编码,CONTENT_ENCODING的位组合
+    CONTENT_ENCODING m_content_encoding;    //本次响应采用的内容编码
+    const mime_type *m_mime;                //响应的MIME类型,含预先拼好的Content-Type报头
+    shared_body m_body;                     //文件缓存或压缩缓存中的响应体,为空时发送mmap的文件
+    const pack::variant *m_pack_variant;    //资源包模式下选中的响应,报头和响应体都在包内
+    char *m_if_none_match;                  //If-None-Match的值
+    char *m_cookie;                         //Cookie的值
+    char m_session[session_store::ID_LEN + 1];  //本次登录新建的会话ID,非空时响应带上Set-Cookie
+    char m_user[session_store::USER_LEN];   //本次登录或会话Cookie对应的用户名,模板中的{{user}}
+    bool m_inline;                          //正在I/O线程上处理,不允许阻塞
+    bool m_deferred;                        //请求已解析完,由工作线程从do_request继续
+    arena m_arena;                          //请求级内存池,每个请求结束时reset
+    const void *m_preloaded;                //上一次提交预读的位置,只在发送的线程上访问
+    std::atomic<unsigned> m_load_id;        //每个新连接和每次关闭加一,用于丢弃旧连接的异步加载完成通知和挂起的协程
+    void (*m_reader)(void *);               //等待socket可读的协程的恢复回调
+    void *m_reader_arg;
+    bool m_reader_ok;                       //恢复时连接是否仍然可读
+    bool m_chunked;                         //请求体使用Transfer-Encoding:chunked
+    bool m_chunk_trailer;                   //已读到最后一块,正在跳过trailer
+    int m_chunk_idx;                        //分块请求体中下一个待解析的字节
+    chunk_source *m_stream;                 //分块响应的生成器,发送完最后一块后释放
+    std::string m_chunk;                    //正在发送的一块,含块头和块尾
+    bool m_upgrade;                         //Upgrade:websocket
+    bool m_conn_upgrade;                    //Connection中含upgrade
+    char *m_ws_key;                         //Sec-WebSocket-Key的值
+    int m_ws_version;                       //Sec-WebSocket-Version的值
+    char m_ws_accept[websocket::ACCEPT_LEN + 1];  //握手响应的Sec-WebSocket-Accept
+    WS_STATE m_ws_state;
+    int m_ws_slot;                          //在ws_hub订阅者表中的下标,未订阅为-1
+    std::vector<shared_body> m_ws_queue;    //待发送的帧,广播的帧在订阅者之间共享
+    size_t m_ws_head;                       //m_ws_queue中第一个未发完的帧
+    size_t m_ws_offset;                     //该帧已发送的字节数
+    SSL *m_ssl;                             //HTTPS连接的SSL对象,明文连接为NULL
+    TLS_STATE m_tls_state;
+    bool m_ktls_send;                       //发送方向已交给内核加密,直接writev明文
+    bool m_h2c;                             //Upgrade中含h2c
+    bool m_conn_h2_settings;                //Connection中含http2-settings
+    char *m_h2_settings;                    //HTTP2-Settings的值
+    h2_session *m_h2;                       //HTTP/2连接的会话,HTTP/1.1连接为NULL
 };
 
 #endif
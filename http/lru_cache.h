@@ -0,0 +1,98 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+
+//按字节数限制总大小的LRU表,file_cache和content_cache共用.
+//以64位哈希为索引,查找时由调用者传入比较函数确认是否同一个键,不为构造键分配内存.
+//本身不加锁,调用者需持有自己的锁
+template <typename V>
+class lru_cache
+{
+public:
+    struct node
+    {
+        uint64_t hash;
+        size_t bytes;           //计入总大小的字节数
+        V value;
+    };
+    typedef std::list<node> lru_list;
+    typedef typename lru_list::iterator iterator;
+
+    explicit lru_cache(size_t max_bytes) : m_max_bytes(max_bytes), m_bytes(0) {}
+
+    //修改容量,超出部分立即淘汰
+    void set_capacity(size_t max_bytes)
+    {
+        m_max_bytes = max_bytes;
+        evict();
+    }
+
+    //查找哈希为h且match(value)为真的项,未找到返回end()
+    template <typename Match>
+    iterator find(uint64_t h, Match match)
+    {
+        std::pair<index_iterator, index_iterator> range = m_index.equal_range(h);
+        for (index_iterator it = range.first; it != range.second; ++it)
+        {
+            if (match(it->second->value))
+                return it->second;
+        }
+        return m_lru.end();
+    }
+
+    //移到表头
+    void touch(iterator it) { m_lru.splice(m_lru.begin(), m_lru, it); }
+
+    //放到表头,超出容量时从表尾淘汰;同一个键的旧项由调用者先erase
+    void insert(uint64_t h, size_t bytes, const V &value)
+    {
+        m_lru.push_front(node{h, bytes, value});
+        m_index.insert(std::make_pair(h, m_lru.begin()));
+        m_bytes += bytes;
+        evict();
+    }
+
+    void erase(iterator it)
+    {
+        std::pair<index_iterator, index_iterator> range = m_index.equal_range(it->hash);
+        for (index_iterator i = range.first; i != range.second; ++i)
+        {
+            if (i->second == it)
+            {
+                m_index.erase(i);
+                break;
+            }
+        }
+        m_bytes -= it->bytes;
+        m_lru.erase(it);
+    }
+
+    iterator end() { return m_lru.end(); }
+    size_t bytes() const { return m_bytes; }
+
+private:
+    typedef std::unordered_multimap<uint64_t, iterator> index_map;
+    typedef typename index_map::iterator index_iterator;
+
+    void evict()
+    {
+        while (m_bytes > m_max_bytes && !m_lru.empty())
+        {
+            iterator last = m_lru.end();
+            --last;
+            erase(last);
+        }
+    }
+
+private:
+    lru_list m_lru;             //表头为最近使用
+    index_map m_index;          //哈希 -> 链表节点
+    size_t m_max_bytes;
+    size_t m_bytes;
+};
+
+#endif
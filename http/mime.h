@@ -0,0 +1,148 @@
+#ifndef MIME_H
+#define MIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "fnv.h"
+
+//扩展名 -> MIME类型
+//表在编译期构建成完美哈希:constexpr函数在编译时找出使所有扩展名互不冲突的种子,
+//运行时查找只需对扩展名做一次哈希和一次比较.响应头整行也在编译期拼好,发送时直接拷贝
+struct mime_type
+{
+    const char *ext;        //小写扩展名,不含'.'
+    const char *type;       //MIME类型
+    const char *header;     //完整的"Content-Type:...\r\n"
+    size_t header_len;
+    bool compressible;      //是否值得做gzip/brotli压缩
+};
+
+#define MIME_ENTRY(ext, type, compressible) \
+    { ext, type, "Content-Type:" type "\r\n", sizeof("Content-Type:" type "\r\n") - 1, compressible }
+
+namespace mime
+{
+//扩展名最长长度,超过的一律按未知类型处理
+const size_t MAX_EXT_LEN = 8;
+
+constexpr mime_type table[] = {
+    MIME_ENTRY("html", "text/html; charset=utf-8", true),
+    MIME_ENTRY("htm", "text/html; charset=utf-8", true),
+    MIME_ENTRY("css", "text/css; charset=utf-8", true),
+    MIME_ENTRY("js", "application/javascript; charset=utf-8", true),
+    MIME_ENTRY("mjs", "application/javascript; charset=utf-8", true),
+    MIME_ENTRY("json", "application/json", true),
+    MIME_ENTRY("map", "application/json", true),
+    MIME_ENTRY("xml", "application/xml", true),
+    MIME_ENTRY("txt", "text/plain; charset=utf-8", true),
+    MIME_ENTRY("csv", "text/csv; charset=utf-8", true),
+    MIME_ENTRY("svg", "image/svg+xml", true),
+    MIME_ENTRY("wasm", "application/wasm", true),
+    MIME_ENTRY("ttf", "font/ttf", true),
+    MIME_ENTRY("otf", "font/otf", true),
+    MIME_ENTRY("woff", "font/woff", false),
+    MIME_ENTRY("woff2", "font/woff2", false),
+    MIME_ENTRY("ico", "image/x-icon", true),
+    MIME_ENTRY("bmp", "image/bmp", true),
+    MIME_ENTRY("png", "image/png", false),
+    MIME_ENTRY("jpg", "image/jpeg", false),
+    MIME_ENTRY("jpeg", "image/jpeg", false),
+    MIME_ENTRY("gif", "image/gif", false),
+    MIME_ENTRY("webp", "image/webp", false),
+    MIME_ENTRY("avif", "image/avif", false),
+    MIME_ENTRY("mp4", "video/mp4", false),
+    MIME_ENTRY("webm", "video/webm", false),
+    MIME_ENTRY("ogv", "video/ogg", false),
+    MIME_ENTRY("mp3", "audio/mpeg", false),
+    MIME_ENTRY("ogg", "audio/ogg", false),
+    MIME_ENTRY("wav", "audio/wav", false),
+    MIME_ENTRY("pdf", "application/pdf", false),
+    MIME_ENTRY("zip", "application/zip", false),
+    MIME_ENTRY("gz", "application/gzip", false),
+};
+
+//未知扩展名,让浏览器按二进制处理而不是去嗅探
+constexpr mime_type default_type = MIME_ENTRY("", "application/octet-stream", false);
+
+const size_t TABLE_SIZE = sizeof(table) / sizeof(table[0]);
+const size_t SLOT_COUNT = 128;
+
+//忽略大小写的FNV-1a,FNV的低位混合很差,最后再做一次murmur3的fmix32
+constexpr uint32_t hash(const char *s, size_t len, uint32_t seed)
+{
+    uint32_t h = fnv1a32(s, len, FNV32_OFFSET ^ seed, true);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+constexpr size_t length(const char *s)
+{
+    size_t n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
+
+struct slot_table
+{
+    uint32_t seed;
+    signed char slots[SLOT_COUNT];  //table下标,-1为空
+};
+
+//编译期搜索无冲突的种子
+constexpr slot_table build()
+{
+    for (uint32_t seed = 0; seed < 100000; ++seed)
+    {
+        slot_table t{seed, {}};
+        for (size_t i = 0; i < SLOT_COUNT; ++i)
+            t.slots[i] = -1;
+        bool ok = true;
+        for (size_t i = 0; i < TABLE_SIZE && ok; ++i)
+        {
+            size_t idx = hash(table[i].ext, length(table[i].ext), seed) & (SLOT_COUNT - 1);
+            if (t.slots[idx] >= 0)
+                ok = false;
+            else
+                t.slots[idx] = (signed char)i;
+        }
+        if (ok)
+            return t;
+    }
+    return slot_table{UINT32_MAX, {}};
+}
+
+constexpr slot_table slots = build();
+static_assert(slots.seed != UINT32_MAX, "no perfect hash seed for mime table");
+
+//按扩展名查找,ext不含'.'
+inline const mime_type *find(const char *ext, size_t len)
+{
+    if (len == 0 || len > MAX_EXT_LEN)
+        return &default_type;
+    int i = slots.slots[hash(ext, len, slots.seed) & (SLOT_COUNT - 1)];
+    if (i < 0)
+        return &default_type;
+    const mime_type &m = table[i];
+    if (strlen(m.ext) != len || strncasecmp(m.ext, ext, len) != 0)
+        return &default_type;
+    return &m;
+}
+
+//按url或文件路径最后一段的扩展名查找
+inline const mime_type *lookup(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/'))
+        return &default_type;
+    return find(dot + 1, strlen(dot + 1));
+}
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef PACK_FORMAT_H
+#define PACK_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fnv.h"
+
+//静态资源包的文件格式,打包工具tools/packer.cpp和服务器(static_pack)共用.
+//  [header][entry * count,按url哈希升序][字符串区:url、预先拼好的报头和ETag][按页对齐的响应体...]
+//所有偏移都相对文件开头,服务器mmap整个文件后直接使用,启动时不需要解析和拷贝
+namespace pack
+{
+const char MAGIC[8] = {'T', 'W', 'S', 'P', 'A', 'C', 'K', '1'};
+const uint32_t VERSION = 1;
+//响应体按页对齐,便于按页预读和mincore检查
+const uint64_t ALIGN = 4096;
+
+//变体下标与CONTENT_ENCODING的取值一致
+const int VARIANT_COUNT = 3;
+
+struct header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;             //资源个数
+    uint64_t entries_offset;    //entry数组的偏移
+    uint64_t file_size;         //整个包的大小,用于校验是否被截断
+};
+
+//一种内容编码下的响应
+struct variant
+{
+    uint64_t body_offset;       //响应体偏移
+    uint64_t body_len;          //响应体长度,0且header_len为0表示没有该编码
+    uint32_t header_offset;     //预先拼好的报头:Content-Length、Content-Type、Content-Encoding、Vary、ETag
+    uint32_t header_len;
+    uint32_t etag_offset;       //带引号的ETag
+    uint32_t etag_len;
+};
+
+struct entry
+{
+    uint64_t hash;              //url的哈希
+    uint32_t url_offset;
+    uint32_t url_len;
+    variant variants[VARIANT_COUNT];
+};
+
+//url的FNV-1a,写进了资源包的索引,不能改动
+inline uint64_t hash(const char *url, size_t len)
+{
+    return fnv1a(url, len);
+}
+}
+
+#endif
@@ -0,0 +1,241 @@
+#include "path_filter.h"
+#include "fnv.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "../log/log.h"
+
+using namespace std;
+
+//目录符号链接可能成环,递归深度超过这个值就不再深入;更深的文件无法收录,过滤器整体不启用
+static const int MAX_DEPTH = 32;
+
+//过滤器说不存在的文件必须一定不存在:目录树没有扫描完整、要求跟踪却建立不了监视时都不启用,
+//所有请求照常stat
+bool path_filter::init(const char *root, size_t max_bytes, bool watch)
+{
+    if (m_ready.load() || !root)
+        return false;
+    m_root = root;
+    while (m_root.size() > 1 && m_root[m_root.size() - 1] == '/')
+        m_root.erase(m_root.size() - 1);
+
+    if (watch)
+    {
+        m_inotify = inotify_init1(IN_CLOEXEC);
+        if (m_inotify < 0)
+            return false;
+    }
+
+    vector<string> files;
+    if (!scan(m_root, files, 0))
+    {
+        stop_watching();
+        return false;
+    }
+
+    //按文件数确定位图大小,至少64K位,给新增文件留一倍余量
+    size_t bits = 1 << 16;
+    while (bits < files.size() * BITS_PER_ENTRY * 2 && bits < max_bytes * 8)
+        bits <<= 1;
+    m_words = bits / 64;
+    m_mask = bits - 1;
+    m_bits.reset(new std::atomic<uint64_t>[m_words]);
+    for (size_t i = 0; i < m_words; ++i)
+        m_bits[i].store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < files.size(); ++i)
+        add(files[i].data(), files[i].size());
+    m_ready.store(true);
+
+    //先启用再启动线程,线程出错时停用不会被这里覆盖
+    if (m_inotify >= 0)
+    {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, watcher, this) != 0)
+        {
+            m_ready.store(false);
+            stop_watching();
+            return false;
+        }
+        pthread_detach(tid);
+    }
+    return true;
+}
+
+void path_filter::stop_watching()
+{
+    if (m_inotify >= 0)
+        close(m_inotify);
+    m_inotify = -1;
+    m_watches.clear();
+}
+
+//inotify线程上调用,之后不再跟踪新增文件
+void path_filter::disable(const char *why)
+{
+    LOG_ERROR("path filter: %s (errno %d), filter disabled", why, errno);
+    m_ready.store(false);
+    stop_watching();
+}
+
+//FNV-1a和一个乘法移位哈希做双重哈希
+void path_filter::hash(const char *path, size_t len, uint64_t &h1, uint64_t &h2)
+{
+    h1 = fnv1a(path, len);
+    h2 = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h2 += (unsigned char)path[i];
+        h2 *= 0xff51afd7ed558ccdull;
+        h2 ^= h2 >> 29;
+    }
+    h2 |= 1;
+}
+
+bool path_filter::may_exist(const char *path, size_t len) const
+{
+    if (!m_ready.load(std::memory_order_acquire))
+        return true;
+    uint64_t h1, h2;
+    hash(path, len, h1, h2);
+    for (int i = 0; i < HASH_COUNT; ++i)
+    {
+        uint64_t bit = (h1 + i * h2) & m_mask;
+        if (!(m_bits[bit / 64].load(std::memory_order_relaxed) & (1ull << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+void path_filter::add(const char *path, size_t len)
+{
+    uint64_t h1, h2;
+    hash(path, len, h1, h2);
+    for (int i = 0; i < HASH_COUNT; ++i)
+    {
+        uint64_t bit = (h1 + i * h2) & m_mask;
+        m_bits[bit / 64].fetch_or(1ull << (bit % 64), std::memory_order_relaxed);
+    }
+    m_entries.fetch_add(1, std::memory_order_relaxed);
+}
+
+//递归收集dir下的文件,同时给每个目录加上inotify监视;
+//超过深度上限或有目录加不上监视时返回false,此时收集到的文件不完整
+bool path_filter::scan(const string &dir, vector<string> &files, int depth)
+{
+    if (depth > MAX_DEPTH || !watch_dir(dir))
+        return false;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return true;
+    bool complete = true;
+    struct dirent *e;
+    while (complete && (e = readdir(d)) != NULL)
+    {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        string path = dir + "/" + e->d_name;
+        bool is_dir = (e->d_type == DT_DIR);
+        if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            is_dir = (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+        }
+        if (is_dir)
+            complete = scan(path, files, depth + 1);
+        else
+            files.push_back(path);
+    }
+    closedir(d);
+    return complete;
+}
+
+//没有要求跟踪时总是成功;inotify_add_watch失败(如超过max_user_watches)时之后在这个目录中新建的文件
+//都收不到通知,返回false
+bool path_filter::watch_dir(const string &dir)
+{
+    if (m_inotify < 0)
+        return true;
+    //符号链接指向的目录同样监视,事件按链接的路径报告
+    int wd = inotify_add_watch(m_inotify, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0)
+        return false;
+    m_watches[wd] = dir;
+    return true;
+}
+
+//path在m_root之下的层数,与scan的depth一致
+int path_filter::depth_of(const string &path) const
+{
+    int depth = 0;
+    for (size_t i = m_root.size(); i < path.size(); ++i)
+        depth += path[i] == '/';
+    return depth;
+}
+
+void *path_filter::watcher(void *arg)
+{
+    ((path_filter *)arg)->run();
+    return NULL;
+}
+
+//把新建和移入的文件加入过滤器,新目录先加监视再扫描,避免漏掉监视建立前写入的文件.
+//inotify读失败、新目录加不上监视或太深时不再能保证收录所有文件,停用过滤器,之后的请求都照常stat
+void path_filter::run()
+{
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        ssize_t n = read(m_inotify, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            disable("inotify read failed");
+            return;
+        }
+        for (char *p = buf; p < buf + n;)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            vector<string> files;
+            bool complete = true;
+            if (ev->mask & IN_IGNORED)
+            {
+                //目录已删除
+                m_watches.erase(ev->wd);
+            }
+            else if (ev->mask & IN_Q_OVERFLOW)
+            {
+                //事件丢失,重新扫描整棵树,位图只增不减所以直接再加一遍
+                complete = scan(m_root, files, 0);
+            }
+            else if (ev->len > 0)
+            {
+                unordered_map<int, string>::iterator it = m_watches.find(ev->wd);
+                if (it == m_watches.end())
+                    continue;
+                string path = it->second + "/" + ev->name;
+                //新建的指向目录的符号链接不带IN_ISDIR,同样要扫描它下面的文件
+                struct stat st;
+                bool is_dir = (ev->mask & IN_ISDIR) || (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+                if (is_dir)
+                    complete = scan(path, files, depth_of(path));
+                else
+                    files.push_back(path);
+            }
+            if (!complete)
+            {
+                disable("directory tree too deep or inotify watch failed");
+                return;
+            }
+            for (size_t i = 0; i < files.size(); ++i)
+                add(files[i].data(), files[i].size());
+        }
+    }
+}
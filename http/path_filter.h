@@ -0,0 +1,70 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+//doc_root下所有文件路径的Bloom过滤器,用来拦截扫描器对不存在路径的请求.
+//过滤器说不存在时文件一定不存在,直接回应预先拼好的404,不再stat;说可能存在时照常stat.
+//启动时扫描整个目录树建立,之后由inotify线程把新建、移入的文件加入;删除的文件不会移出,
+//只是退化成多一次stat.过滤器不能有漏判:目录树太深、inotify或某个目录的监视建立不了时
+//不启用或停用过滤器,所有请求都照常stat.位图大小在启动时按文件数确定并受max_bytes限制,之后不再增长
+class path_filter
+{
+public:
+    static path_filter *get_instance()
+    {
+        static path_filter instance;
+        return &instance;
+    }
+
+    //扫描root建立过滤器,watch为true时启动inotify线程跟踪新增文件;返回false时过滤器未启用
+    bool init(const char *root, size_t max_bytes = 1024 * 1024, bool watch = true);
+
+    //path为完整路径,返回false表示文件一定不存在;未初始化时总是返回true
+    bool may_exist(const char *path, size_t len) const;
+
+    //加入一个存在的文件
+    void add(const char *path, size_t len);
+
+    //统计信息
+    void count_avoided() { m_avoided.fetch_add(1, std::memory_order_relaxed); }
+    unsigned long long avoided() const { return m_avoided.load(std::memory_order_relaxed); }
+    size_t entries() const { return m_entries.load(std::memory_order_relaxed); }
+    size_t bytes() const { return m_words * sizeof(uint64_t); }
+
+private:
+    path_filter() : m_words(0), m_mask(0), m_ready(false), m_entries(0), m_avoided(0), m_inotify(-1) {}
+    ~path_filter() {}
+
+    //每个路径设置的位数,每个文件10位时误判率约1%
+    static const int HASH_COUNT = 7;
+    static const size_t BITS_PER_ENTRY = 10;
+
+    static void hash(const char *path, size_t len, uint64_t &h1, uint64_t &h2);
+    bool scan(const std::string &dir, std::vector<std::string> &files, int depth);
+    bool watch_dir(const std::string &dir);
+    int depth_of(const std::string &path) const;
+    void stop_watching();
+    void disable(const char *why);
+    static void *watcher(void *arg);
+    void run();
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> m_bits;    //位图,只置位不清零,读写都不加锁
+    size_t m_words;
+    uint64_t m_mask;                                    //位数-1,位数为2的幂
+    std::atomic<bool> m_ready;
+    std::atomic<size_t> m_entries;
+    std::atomic<unsigned long long> m_avoided;          //省掉的stat次数
+    std::string m_root;
+    int m_inotify;
+    std::unordered_map<int, std::string> m_watches;     //watch描述符 -> 目录,只在初始化和inotify线程中访问
+};
+
+#endif
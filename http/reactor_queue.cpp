@@ -0,0 +1,54 @@
+#include "reactor_queue.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+int reactor_queue::fd()
+{
+    m_lock.lock();
+    if (m_fd < 0)
+        m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int fd = m_fd;
+    m_lock.unlock();
+    return fd;
+}
+
+bool reactor_queue::post(callback fn, void *arg)
+{
+    item it;
+    it.fn = fn;
+    it.arg = arg;
+    m_lock.lock();
+    if (m_fd < 0)
+    {
+        m_lock.unlock();
+        return false;
+    }
+    bool wake = m_items.empty();
+    m_items.push_back(it);
+    m_lock.unlock();
+
+    //队列原本非空时主线程已被唤醒,不用重复写
+    if (wake)
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(m_fd, &one, sizeof(one));
+        (void)ret;
+    }
+    return true;
+}
+
+void reactor_queue::drain()
+{
+    uint64_t count;
+    while (read(m_fd, &count, sizeof(count)) > 0)
+    {
+    }
+
+    m_lock.lock();
+    m_running.swap(m_items);
+    m_lock.unlock();
+    for (size_t i = 0; i < m_running.size(); ++i)
+        m_running[i].fn(m_running[i].arg);
+    m_running.clear();
+}
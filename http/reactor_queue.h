@@ -0,0 +1,47 @@
+#ifndef REACTOR_QUEUE_H
+#define REACTOR_QUEUE_H
+
+#include <vector>
+#include "../lock/locker.h"
+
+//把回调从其他线程交给主线程(reactor)执行:post把回调放进队列并写eventfd,
+//eventfd注册在主线程的epoll中,可读时主线程调用drain逐个执行.
+//协程在I/O线程或阻塞执行器上完成等待后,通过它回到主线程恢复
+class reactor_queue
+{
+public:
+    typedef void (*callback)(void *arg);
+
+    static reactor_queue *get_instance()
+    {
+        static reactor_queue instance;
+        return &instance;
+    }
+
+    //eventfd,第一次调用时创建,失败返回-1
+    int fd();
+
+    //任意线程调用,把fn(arg)交给主线程
+    bool post(callback fn, void *arg);
+
+    //主线程在eventfd可读时调用
+    void drain();
+
+private:
+    reactor_queue() : m_fd(-1) {}
+    ~reactor_queue() {}
+
+    struct item
+    {
+        callback fn;
+        void *arg;
+    };
+
+private:
+    locker m_lock;
+    std::vector<item> m_items;      //待执行的回调
+    std::vector<item> m_running;    //drain时与m_items交换,两边的容量都会复用
+    int m_fd;
+};
+
+#endif
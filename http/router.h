@@ -0,0 +1,97 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <exception>
+#include "fnv.h"
+
+//路由表:url路径 -> 处理器
+//启动时一次性构建成完美哈希表(所有路由落在互不冲突的槽位),
+//匹配时只做一次哈希和一次memcmp,不分配内存,未命中时也只多一次哈希
+template<typename H>
+class router{
+public:
+    router():m_mask(0),m_seed(0),m_built(false){}
+
+    //添加路由,只能在build之前调用
+    bool add(const char *path,const H &handler){
+        if(m_built||!path) return false;
+        for(size_t i=0;i<m_routes.size();++i){
+            if(m_routes[i].path==path) return false;
+        }
+        entry e;
+        e.path=path;
+        e.handler=handler;
+        m_routes.push_back(e);
+        return true;
+    }
+
+    //寻找一个使所有路由无冲突的种子,表长至少为路由数的2倍
+    void build(){
+        size_t size=8;
+        while(size<m_routes.size()*2) size<<=1;
+
+        while(true){
+            for(uint32_t seed=0;seed<4096;++seed){
+                if(try_build(size,seed)){
+                    m_built=true;
+                    return;
+                }
+            }
+            size<<=1;
+            if(size>(1u<<20)) throw std::exception();
+        }
+    }
+
+    //返回匹配的处理器,未命中返回NULL
+    const H *match(const char *path,size_t len) const{
+        if(!m_built) return NULL;
+        int slot=m_slots[hash(path,len,m_seed)&m_mask];
+        if(slot<0) return NULL;
+        const entry &e=m_routes[slot];
+        if(e.path.size()!=len||memcmp(e.path.data(),path,len)!=0) return NULL;
+        return &e.handler;
+    }
+
+    const H *match(const char *path) const{
+        return match(path,strlen(path));
+    }
+
+    size_t size() const { return m_routes.size(); }
+
+private:
+    struct entry{
+        std::string path;
+        H handler;
+    };
+
+    //FNV-1a,种子混入初始值
+    static uint32_t hash(const char *s,size_t len,uint32_t seed){
+        return fnv1a32(s,len,FNV32_OFFSET^(seed*FNV32_PRIME));
+    }
+
+    bool try_build(size_t size,uint32_t seed){
+        std::vector<int> slots(size,-1);
+        for(size_t i=0;i<m_routes.size();++i){
+            uint32_t idx=hash(m_routes[i].path.data(),m_routes[i].path.size(),seed)&(size-1);
+            if(slots[idx]>=0) return false;
+            slots[idx]=(int)i;
+        }
+        m_slots.swap(slots);
+        m_mask=(uint32_t)(size-1);
+        m_seed=seed;
+        return true;
+    }
+
+private:
+    std::vector<entry> m_routes;    //路由项
+    std::vector<int> m_slots;       //哈希槽,存放路由项下标,-1为空
+    uint32_t m_mask;                //表长-1
+    uint32_t m_seed;                //无冲突的哈希种子
+    bool m_built;                   //是否已构建
+};
+
+#endif
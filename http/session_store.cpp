@@ -0,0 +1,277 @@
+#include "session_store.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+session_store::session_store() : m_shards(new shard[SHARDS]), m_shared(false), m_capacity(0), m_ttl_ms(0), m_evicted(0)
+{
+    init(65536, 30 * 60);
+}
+
+//共享内存随进程退出释放,其他进程可能还在使用,不解除映射
+session_store::~session_store()
+{
+    if (m_shared)
+        return;
+    for (size_t i = 0; i < SHARDS; ++i)
+    {
+        delete[] m_shards[i].slots;
+        delete[] m_shards[i].index;
+    }
+    delete[] m_shards;
+}
+
+bool session_store::init(size_t max_sessions, int ttl_seconds)
+{
+    if (max_sessions == 0 || ttl_seconds <= 0 || m_shared)
+        return false;
+    size_t cap = (max_sessions + SHARDS - 1) / SHARDS;
+    //索引至少是槽位数的两倍,装载率不超过一半,探测很短
+    size_t buckets = 1;
+    while (buckets < cap * 2)
+        buckets <<= 1;
+    for (size_t i = 0; i < SHARDS; ++i)
+    {
+        shard &s = m_shards[i];
+        delete[] s.slots;
+        delete[] s.index;
+        s.slots = new slot[cap];
+        s.index = new uint32_t[buckets]();
+        s.cap = cap;
+        s.mask = buckets - 1;
+        s.head = s.count = 0;
+    }
+    m_capacity = cap * SHARDS;
+    m_ttl_ms = (long long)ttl_seconds * 1000;
+    return true;
+}
+
+//一次映射放下分片数组和每片的槽位、索引,按init时的容量分配
+bool session_store::share()
+{
+    if (m_shared)
+        return false;
+    size_t cap = m_shards[0].cap;
+    size_t buckets = m_shards[0].mask + 1;
+    size_t per_shard = cap * sizeof(slot) + buckets * sizeof(uint32_t);
+    size_t size = SHARDS * sizeof(shard) + SHARDS * per_shard;
+    void *addr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return false;
+
+    //shard和slot的大小都是8的倍数,后面的数组自然对齐
+    char *p = (char *)addr;
+    shard *shards = (shard *)p;
+    p += SHARDS * sizeof(shard);
+    for (size_t i = 0; i < SHARDS; ++i)
+    {
+        shard *s;
+        try
+        {
+            s = new (&shards[i]) shard(true);
+        }
+        catch (...)
+        {
+            munmap(addr, size);
+            return false;
+        }
+        s->slots = (slot *)p;
+        p += cap * sizeof(slot);
+        s->index = (uint32_t *)p;
+        p += buckets * sizeof(uint32_t);
+        s->cap = cap;
+        s->mask = buckets - 1;
+    }
+
+    for (size_t i = 0; i < SHARDS; ++i)
+    {
+        delete[] m_shards[i].slots;
+        delete[] m_shards[i].index;
+    }
+    delete[] m_shards;
+    m_shards = shards;
+    m_shared = true;
+    return true;
+}
+
+long long session_store::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool session_store::parse_id(const char *text, size_t len, uint64_t id[2])
+{
+    if (len != ID_LEN)
+        return false;
+    id[0] = id[1] = 0;
+    for (size_t i = 0; i < ID_LEN; ++i)
+    {
+        int v = hex_value(text[i]);
+        if (v < 0)
+            return false;
+        id[i / 16] = (id[i / 16] << 4) | v;
+    }
+    return true;
+}
+
+//会话丢了只需重新登录,不值得逐个核对槽位和索引
+void session_store::lock(shard &s)
+{
+    bool owner_dead;
+    s.lock.lock(&owner_dead);
+    if (owner_dead)
+        reset(s);
+}
+
+void session_store::reset(shard &s)
+{
+    memset(s.index, 0, (s.mask + 1) * sizeof(uint32_t));
+    s.head = s.count = 0;
+}
+
+//ID是随机数,直接取第二个字做探测起点
+size_t session_store::find(const shard &s, const uint64_t id[2])
+{
+    for (size_t pos = id[1] & s.mask;; pos = (pos + 1) & s.mask)
+    {
+        uint32_t n = s.index[pos];
+        if (n == 0)
+            return NPOS;
+        const slot &e = s.slots[n - 1];
+        if (e.id[0] == id[0] && e.id[1] == id[1])
+            return pos;
+    }
+}
+
+//从索引中删除pos,之后的探测链向前移,不留墓碑
+void session_store::unlink(shard &s, size_t pos)
+{
+    size_t hole = pos;
+    for (size_t next = (hole + 1) & s.mask; s.index[next] != 0; next = (next + 1) & s.mask)
+    {
+        size_t home = s.slots[s.index[next] - 1].id[1] & s.mask;
+        //home不在(hole,next]之间时,这一项可以移到空位上
+        bool between = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!between)
+        {
+            s.index[hole] = s.index[next];
+            hole = next;
+        }
+    }
+    s.index[hole] = 0;
+}
+
+//移出环头的槽位;索引中找不到它时只移动环头
+void session_store::pop(shard &s)
+{
+    size_t pos = find(s, s.slots[s.head].id);
+    if (pos != NPOS)
+        unlink(s, pos);
+    s.head = (s.head + 1) % s.cap;
+    --s.count;
+}
+
+bool session_store::create(const char *user, char *id)
+{
+    size_t user_len = strlen(user);
+    if (user_len >= USER_LEN)
+        return false;
+    uint64_t key[2];
+    if (getrandom(key, sizeof(key), 0) != sizeof(key))
+        return false;
+
+    long long now = now_ms();
+    shard &s = shard_of(key);
+    lock(s);
+    //已过期的顺带清理,满了再淘汰最早的会话
+    while (s.count > 0 && s.slots[s.head].expire_ms <= now)
+        pop(s);
+    if (s.count == s.cap)
+    {
+        pop(s);
+        m_evicted.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t n = (s.head + s.count) % s.cap;
+    slot &e = s.slots[n];
+    e.id[0] = key[0];
+    e.id[1] = key[1];
+    e.expire_ms = now + m_ttl_ms;
+    memcpy(e.user, user, user_len + 1);
+    size_t pos = key[1] & s.mask;
+    while (s.index[pos] != 0)
+        pos = (pos + 1) & s.mask;
+    s.index[pos] = n + 1;
+    ++s.count;
+    s.lock.unlock();
+
+    snprintf(id, ID_LEN + 1, "%016llx%016llx", (unsigned long long)key[0], (unsigned long long)key[1]);
+    return true;
+}
+
+bool session_store::validate(const char *id, size_t len, char *user)
+{
+    uint64_t key[2];
+    if (!parse_id(id, len, key))
+        return false;
+    long long now = now_ms();
+    shard &s = shard_of(key);
+    lock(s);
+    size_t pos = find(s, key);
+    bool ok = false;
+    if (pos != NPOS)
+    {
+        const slot &e = s.slots[s.index[pos] - 1];
+        ok = e.expire_ms > now;
+        if (ok && user)
+            memcpy(user, e.user, strlen(e.user) + 1);
+    }
+    s.lock.unlock();
+    return ok;
+}
+
+size_t session_store::expire()
+{
+    long long now = now_ms();
+    size_t expired = 0;
+    for (size_t i = 0; i < SHARDS; ++i)
+    {
+        shard &s = m_shards[i];
+        lock(s);
+        while (s.count > 0 && s.slots[s.head].expire_ms <= now)
+        {
+            pop(s);
+            ++expired;
+        }
+        s.lock.unlock();
+    }
+    return expired;
+}
+
+size_t session_store::sessions() const
+{
+    size_t n = 0;
+    for (size_t i = 0; i < SHARDS; ++i)
+    {
+        shard &s = m_shards[i];
+        lock(s);
+        n += s.count;
+        s.lock.unlock();
+    }
+    return n;
+}
@@ -0,0 +1,98 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "../lock/locker.h"
+
+//登录会话表:登录成功后发放128位随机会话ID(Set-Cookie:sid=...),之后的请求凭Cookie
+//做一次哈希查找即可确认身份,不再比较密码或访问数据库.
+//按ID分成若干分片,每片一把锁;每片的槽位在init时一次分配,总内存固定,满时淘汰最早的会话.
+//会话的有效期从创建时起算且长度相同,所以槽位按创建顺序组成环,环头就是最早过期的,
+//过期清理由主线程的定时器链表定期调用expire.
+//多进程模式下主进程在fork前调用share,整张表放进共享内存,登录后的请求落到哪个工作进程都能通过校验
+class session_store
+{
+public:
+    //会话ID的十六进制长度
+    static const size_t ID_LEN = 32;
+    //用户名的最大长度,更长的用户名不建立会话
+    static const size_t USER_LEN = 64;
+
+    static session_store *get_instance()
+    {
+        static session_store instance;
+        return &instance;
+    }
+
+    //设置会话总数上限和有效期,默认65536个、30分钟.只能在启动时、还没有会话时调用
+    bool init(size_t max_sessions, int ttl_seconds);
+
+    //把会话表移到进程间共享的匿名内存中,之后fork出的进程共用同一张表,锁也换成进程间的.
+    //只能在fork前、还没有会话时调用,之后不能再init
+    bool share();
+
+    //为user建立会话,ID写入id(至少ID_LEN+1字节),失败返回false
+    bool create(const char *user, char *id);
+
+    //校验会话ID,有效时把用户名写入user(可为NULL,至少USER_LEN字节)
+    bool validate(const char *id, size_t len, char *user = NULL);
+
+    //清理所有已过期的会话,返回清理的个数
+    size_t expire();
+
+    int ttl_seconds() const { return m_ttl_ms / 1000; }
+    size_t capacity() const { return m_capacity; }
+    size_t sessions() const;        //含已过期、尚未清理的会话
+    unsigned long long evicted() const { return m_evicted.load(std::memory_order_relaxed); }
+
+private:
+    session_store();
+    ~session_store();
+
+    static const size_t SHARDS = 16;
+
+    struct slot
+    {
+        uint64_t id[2];
+        long long expire_ms;
+        char user[USER_LEN];
+    };
+
+    //槽位环加开放寻址的索引,索引中存槽位下标加一,0表示空
+    struct shard
+    {
+        explicit shard(bool shared = false)
+            : lock(shared), slots(NULL), index(NULL), cap(0), mask(0), head(0), count(0) {}
+
+        mutable locker lock;
+        slot *slots;
+        uint32_t *index;
+        size_t cap;
+        size_t mask;
+        size_t head;            //最早创建的槽位
+        size_t count;           //环中的会话数,含已过期、尚未清理的
+    };
+
+    static long long now_ms();
+    static bool parse_id(const char *text, size_t len, uint64_t id[2]);
+    shard &shard_of(const uint64_t id[2]) { return m_shards[id[0] % SHARDS]; }
+    //加分片的锁;多进程模式下上一个持锁的进程死在修改中间时,分片可能已不一致,整片清空
+    static void lock(shard &s);
+    static void reset(shard &s);
+    //下面的函数调用者需持有分片的锁
+    static const size_t NPOS = (size_t)-1;
+    static size_t find(const shard &s, const uint64_t id[2]);
+    static void unlink(shard &s, size_t pos);
+    static void pop(shard &s);
+
+private:
+    shard *m_shards;                //SHARDS个分片,share之后位于共享内存
+    bool m_shared;
+    size_t m_capacity;
+    long long m_ttl_ms;
+    std::atomic<unsigned long long> m_evicted;   //未到期就被淘汰的会话数
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "static_pack.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+bool static_pack::open(const char *path)
+{
+    if (m_base)
+        return false;
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(pack::header))
+    {
+        close(fd);
+        return false;
+    }
+    void *addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    m_mapping = std::make_shared<mapped_file>(addr, st.st_size, fd);
+    m_base = (const char *)addr;
+    m_size = st.st_size;
+    const pack::header *h = (const pack::header *)m_base;
+    m_entries = (const pack::entry *)(m_base + h->entries_offset);
+    m_count = h->count;
+    if (!validate())
+    {
+        m_mapping.reset();
+        m_base = NULL;
+        m_size = 0;
+        m_entries = NULL;
+        m_count = 0;
+        return false;
+    }
+    return true;
+}
+
+//只检查索引的偏移是否都落在文件内,不读取响应体
+bool static_pack::validate() const
+{
+    const pack::header *h = (const pack::header *)m_base;
+    if (memcmp(h->magic, pack::MAGIC, sizeof(pack::MAGIC)) != 0 || h->version != pack::VERSION)
+        return false;
+    if (h->file_size != m_size || h->entries_offset % 8 != 0)
+        return false;
+    if (h->entries_offset > m_size || (m_size - h->entries_offset) / sizeof(pack::entry) < m_count)
+        return false;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        const pack::entry &e = m_entries[i];
+        if (i > 0 && e.hash < m_entries[i - 1].hash)
+            return false;
+        if ((uint64_t)e.url_offset + e.url_len > m_size)
+            return false;
+        for (int j = 0; j < pack::VARIANT_COUNT; ++j)
+        {
+            const pack::variant &v = e.variants[j];
+            if (v.body_offset > m_size || v.body_len > m_size - v.body_offset)
+                return false;
+            if ((uint64_t)v.header_offset + v.header_len > m_size || (uint64_t)v.etag_offset + v.etag_len > m_size)
+                return false;
+        }
+    }
+    return true;
+}
+
+//按哈希二分查找,再比较url
+const pack::entry *static_pack::find(const char *url, size_t len) const
+{
+    if (!m_base)
+        return NULL;
+    uint64_t h = pack::hash(url, len);
+    size_t lo = 0, hi = m_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m_entries[mid].hash < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < m_count && m_entries[lo].hash == h; ++lo)
+    {
+        const pack::entry &e = m_entries[lo];
+        if (e.url_len == len && memcmp(m_base + e.url_offset, url, len) == 0)
+            return &e;
+    }
+    return NULL;
+}
+
+const pack::variant *static_pack::select(const pack::entry *e, int accept, CONTENT_ENCODING &encoding) const
+{
+    static const CONTENT_ENCODING prefer[] = {ENCODING_BR, ENCODING_GZIP};
+    for (size_t i = 0; i < sizeof(prefer) / sizeof(prefer[0]); ++i)
+    {
+        const pack::variant &v = e->variants[prefer[i]];
+        if ((accept & prefer[i]) && v.header_len != 0)
+        {
+            encoding = prefer[i];
+            return &v;
+        }
+    }
+    encoding = ENCODING_IDENTITY;
+    return &e->variants[ENCODING_IDENTITY];
+}
@@ -0,0 +1,53 @@
+#ifndef STATIC_PACK_H
+#define STATIC_PACK_H
+
+#include <stddef.h>
+#include "pack_format.h"
+#include "content_cache.h"
+#include "file_loader.h"
+
+//资源包模式:启动时把tools/packer生成的资源包整个mmap一次,之后按url在包内查找,
+//报头、ETag和压缩结果都是预先生成的,处理请求时除了发送不再有任何系统调用,也不再打开文件.
+//整个进程只为资源包保留一个描述符,冷数据的预读通过它进行.
+//资源包以MAP_SHARED映射,运行中只能用rename整体替换文件(packer就是这样做的),
+//原地截断或重写会让已映射的页失效,访问时进程收到SIGBUS
+class static_pack
+{
+public:
+    static static_pack *get_instance()
+    {
+        static static_pack instance;
+        return &instance;
+    }
+
+    //映射并校验资源包,失败时返回false,服务器照常从doc_root取文件
+    bool open(const char *path);
+    bool loaded() const { return m_base != NULL; }
+    //整个资源包的映射,提交预读时使用
+    const file_mapping &mapping() const { return m_mapping; }
+
+    //按url查找,未找到返回NULL
+    const pack::entry *find(const char *url, size_t len) const;
+
+    //按Accept-Encoding选择变体,优先brotli,encoding返回选中的编码
+    const pack::variant *select(const pack::entry *e, int accept, CONTENT_ENCODING &encoding) const;
+
+    const char *data(uint64_t offset) const { return m_base + offset; }
+    size_t count() const { return m_count; }
+    size_t size() const { return m_size; }
+
+private:
+    static_pack() : m_base(NULL), m_size(0), m_entries(NULL), m_count(0) {}
+    ~static_pack() {}
+
+    bool validate() const;
+
+private:
+    file_mapping m_mapping;
+    const char *m_base;             //映射的起始地址
+    size_t m_size;
+    const pack::entry *m_entries;   //按哈希升序
+    size_t m_count;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "tls.h"
+#include <stdio.h>
+#include <openssl/err.h>
+
+//kTLS支持的AEAD套件优先,TLS 1.2只保留前向安全的GCM和ChaCha20套件
+static const char CIPHERS_TLS12[] = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                                    "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                                    "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+static const char CIPHERS_TLS13[] = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+static const unsigned char SESSION_ID_CONTEXT[] = "tinywebserver";
+
+bool tls_context::init(const char *cert_file, const char *key_file)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx)
+        return false;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE
+                                 | SSL_OP_NO_COMPRESSION);
+    //写不完时下次从iovec推进后的位置重试;空闲连接不保留读写缓冲区
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    //每次完整握手只发一张票据,减少握手的字节数
+    SSL_CTX_set_num_tickets(ctx, 1);
+
+    if (SSL_CTX_set_cipher_list(ctx, CIPHERS_TLS12) != 1 || SSL_CTX_set_ciphersuites(ctx, CIPHERS_TLS13) != 1
+        || SSL_CTX_use_certificate_chain_file(ctx, cert_file) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    if (m_ctx)
+        SSL_CTX_free(m_ctx);
+    m_ctx = ctx;
+    return true;
+}
+
+SSL *tls_context::accept(int fd)
+{
+    if (!m_ctx)
+        return NULL;
+    SSL *ssl = SSL_new(m_ctx);
+    if (!ssl)
+        return NULL;
+    if (SSL_set_fd(ssl, fd) != 1)
+    {
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+void tls_context::count_handshake(SSL *ssl, bool ktls_send, bool ktls_recv)
+{
+    m_handshakes.fetch_add(1, std::memory_order_relaxed);
+    if (SSL_session_reused(ssl))
+        m_resumed.fetch_add(1, std::memory_order_relaxed);
+    if (ktls_send)
+        m_ktls_send.fetch_add(1, std::memory_order_relaxed);
+    if (ktls_recv)
+        m_ktls_recv.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,60 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <atomic>
+#include <openssl/ssl.h>
+
+//HTTPS监听端口使用的TLS上下文,需要链接libssl和libcrypto.
+//握手在用户态由OpenSSL完成(在线程池中执行),完成后OpenSSL把记录层的密钥交给内核(kTLS):
+//发送方向启用kTLS时socket上直接writev明文,mmap的文件和缓存的响应体照常零拷贝地交给内核加密;
+//内核或所选密码套件不支持时退回SSL_write.接收总是经过SSL_read,启用了kTLS时解密同样在内核中完成.
+//会话复用:TLS 1.2的会话ID缓存在服务端会话缓存中,TLS 1.3使用无状态票据,复用的握手省掉证书签名
+class tls_context
+{
+public:
+    //服务端会话缓存的条数和会话的有效期
+    static const long SESSION_CACHE_SIZE = 20480;
+    static const long SESSION_TIMEOUT = 3600;
+
+    static tls_context *get_instance()
+    {
+        static tls_context instance;
+        return &instance;
+    }
+
+    //加载PEM格式的证书链和私钥,失败时返回false并输出OpenSSL的错误
+    bool init(const char *cert_file, const char *key_file);
+    bool enabled() const { return m_ctx != NULL; }
+
+    //为新接受的连接创建服务端的SSL对象
+    SSL *accept(int fd);
+
+    //握手结束时记录统计
+    void count_handshake(SSL *ssl, bool ktls_send, bool ktls_recv);
+    void count_failure() { m_failed.fetch_add(1, std::memory_order_relaxed); }
+
+    //统计信息:完成的握手数,其中复用会话的,启用kTLS发送/接收的,以及失败的握手数
+    unsigned long long handshakes() const { return m_handshakes.load(std::memory_order_relaxed); }
+    unsigned long long resumed() const { return m_resumed.load(std::memory_order_relaxed); }
+    unsigned long long ktls_send() const { return m_ktls_send.load(std::memory_order_relaxed); }
+    unsigned long long ktls_recv() const { return m_ktls_recv.load(std::memory_order_relaxed); }
+    unsigned long long failed() const { return m_failed.load(std::memory_order_relaxed); }
+
+private:
+    tls_context() : m_ctx(NULL), m_handshakes(0), m_resumed(0), m_ktls_send(0), m_ktls_recv(0), m_failed(0) {}
+    ~tls_context()
+    {
+        if (m_ctx)
+            SSL_CTX_free(m_ctx);
+    }
+
+private:
+    SSL_CTX *m_ctx;
+    std::atomic<unsigned long long> m_handshakes;
+    std::atomic<unsigned long long> m_resumed;
+    std::atomic<unsigned long long> m_ktls_send;
+    std::atomic<unsigned long long> m_ktls_recv;
+    std::atomic<unsigned long long> m_failed;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "url_form.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+//返回p中第一个'%'或'+'的下标,没有时返回n
+static inline size_t next_escape(const char *p, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, plus)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (p[i] == '%' || p[i] == '+')
+            return i;
+    }
+    return n;
+}
+
+long url_form::decode(const char *src, size_t len, char *dst)
+{
+    size_t in = 0, out = 0;
+    while (in < len)
+    {
+        //不需要解码的一段整段搬移,原地解码时dst在src之前或相同
+        size_t run = next_escape(src + in, len - in);
+        if (run)
+        {
+            if (dst + out != src + in)
+                memmove(dst + out, src + in, run);
+            in += run;
+            out += run;
+            if (in == len)
+                break;
+        }
+        if (src[in] == '+')
+        {
+            dst[out++] = ' ';
+            ++in;
+            continue;
+        }
+        if (len - in < 3)
+            return -1;
+        int high = hex_value(src[in + 1]);
+        int low = hex_value(src[in + 2]);
+        //%00会截断之后按C字符串使用的字段
+        if (high < 0 || low < 0 || (high | low) == 0)
+            return -1;
+        dst[out++] = (char)(high << 4 | low);
+        in += 3;
+    }
+    return out;
+}
+
+//body[len]也必须可写,最后一个字段的结尾'\0'写在那里
+bool url_form::parse(char *body, size_t len)
+{
+    m_count = 0;
+    if (memchr(body, '\0', len))
+        return false;
+    char *p = body;
+    char *end = body + len;
+    while (p < end)
+    {
+        char *amp = (char *)memchr(p, '&', end - p);
+        char *stop = amp ? amp : end;
+        //跳过"a=1&&b=2"中的空字段
+        if (stop > p)
+        {
+            if (m_count == MAX_FIELDS)
+                return false;
+            char *eq = (char *)memchr(p, '=', stop - p);
+            char *name_end = eq ? eq : stop;
+            char *value = eq ? eq + 1 : stop;
+            long name_len = decode(p, name_end - p, p);
+            long value_len = decode(value, stop - value, value);
+            if (name_len < 0 || value_len < 0)
+                return false;
+            p[name_len] = '\0';
+            value[value_len] = '\0';
+            field &f = m_fields[m_count++];
+            f.name.data = p;
+            f.name.len = name_len;
+            f.value.data = value;
+            f.value.len = value_len;
+        }
+        p = stop + 1;
+    }
+    return true;
+}
+
+bool url_form::get(const char *name, slice &value) const
+{
+    size_t len = strlen(name);
+    for (int i = 0; i < m_count; ++i)
+    {
+        const field &f = m_fields[i];
+        if (f.name.len == len && memcmp(f.name.data, name, len) == 0)
+        {
+            value = f.value;
+            return true;
+        }
+    }
+    return false;
+}
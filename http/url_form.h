@@ -0,0 +1,46 @@
+#ifndef URL_FORM_H
+#define URL_FORM_H
+
+#include <stddef.h>
+
+//application/x-www-form-urlencoded消息体的解析,例如"user=a%40b&passwd=1+2".
+//在消息体所在的缓冲区上原地解码:%XX和+解码后不会变长,结果直接写回原处并以'\0'结尾,
+//字段以指向缓冲区的片段返回,不分配也不拷贝.解码时用SSE2一次检查16个字节,
+//没有%和+的字节段整段搬移.畸形的%XX、%00和超过MAX_FIELDS个字段都视为非法
+class url_form
+{
+public:
+    static const int MAX_FIELDS = 16;
+
+    //消息体中的一段,解码后以'\0'结尾
+    struct slice
+    {
+        const char *data;
+        size_t len;
+    };
+
+    url_form() : m_count(0) {}
+
+    //解析body的前len个字节,body会被改写,解析结果在body有效期内有效
+    bool parse(char *body, size_t len);
+
+    //按名字查找字段,有同名字段时取第一个
+    bool get(const char *name, slice &value) const;
+
+    int count() const { return m_count; }
+
+    //把src的len个字节解码到dst,dst可以与src相同;返回解码后的长度,非法时返回-1
+    static long decode(const char *src, size_t len, char *dst);
+
+private:
+    struct field
+    {
+        slice name;
+        slice value;
+    };
+
+    field m_fields[MAX_FIELDS];
+    int m_count;
+};
+
+#endif
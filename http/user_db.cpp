@@ -0,0 +1,370 @@
+#include "user_db.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../threadpool/blocking.h"
+
+using namespace std;
+
+//加载时每攒够这么多行才加锁放入内存表一次
+static const size_t LOAD_BATCH = 4096;
+//重复键,行级错误,不影响同一批中的其他注册
+static const unsigned int ER_DUP_ENTRY_CODE = 1062;
+
+static const char SELECT_SQL[] = "SELECT passwd FROM user WHERE username=?";
+static const char INSERT_SQL[] = "INSERT INTO user(username, passwd) VALUES(?, ?)";
+
+static void flush(vector<pair<string, string> > &batch, map<string, string> &users, locker &lock)
+{
+    lock.lock();
+    for (size_t i = 0; i < batch.size(); ++i)
+        users[batch[i].first].swap(batch[i].second);
+    lock.unlock();
+    batch.clear();
+}
+
+//执行查询并逐行读取,结果集不在客户端整体缓存
+long long user_db::stream(MYSQL *mysql, const char *sql, map<string, string> &users, locker &lock)
+{
+    if (mysql_query(mysql, sql))
+        return -1;
+    MYSQL_RES *result = mysql_use_result(mysql);
+    if (!result)
+        return -1;
+
+    vector<pair<string, string> > batch;
+    batch.reserve(LOAD_BATCH);
+    long long rows = 0;
+    while (MYSQL_ROW row = mysql_fetch_row(result))
+    {
+        if (!row[0] || !row[1])
+            continue;
+        batch.push_back(make_pair(string(row[0]), string(row[1])));
+        ++rows;
+        if (batch.size() == LOAD_BATCH)
+            flush(batch, users, lock);
+    }
+    flush(batch, users, lock);
+    //mysql_fetch_row返回NULL也可能是读取中途出错
+    bool failed = mysql_errno(mysql) != 0;
+    mysql_free_result(result);
+    return failed ? -1 : rows;
+}
+
+//是否有以username开头的索引,只有这样按用户名排序和按区间读取才不用扫全表
+bool user_db::indexed(MYSQL *mysql)
+{
+    if (mysql_query(mysql, "SHOW INDEX FROM user WHERE Column_name='username' AND Seq_in_index=1"))
+        return false;
+    MYSQL_RES *result = mysql_store_result(mysql);
+    if (!result)
+        return false;
+    bool found = mysql_fetch_row(result) != NULL;
+    mysql_free_result(result);
+    return found;
+}
+
+//按用户名把表分成parts段,取每段的起点;重复的分界点只保留一个
+bool user_db::boundaries(MYSQL *mysql, int parts, vector<string> &bounds)
+{
+    if (mysql_query(mysql, "SELECT COUNT(*) FROM user"))
+        return false;
+    MYSQL_RES *result = mysql_store_result(mysql);
+    if (!result)
+        return false;
+    MYSQL_ROW row = mysql_fetch_row(result);
+    long long count = (row && row[0]) ? atoll(row[0]) : 0;
+    mysql_free_result(result);
+
+    for (int i = 1; i < parts; ++i)
+    {
+        char sql[128];
+        snprintf(sql, sizeof(sql), "SELECT username FROM user WHERE username IS NOT NULL ORDER BY username LIMIT 1 OFFSET %lld",
+                 count * i / parts);
+        if (mysql_query(mysql, sql))
+            return false;
+        result = mysql_store_result(mysql);
+        if (!result)
+            return false;
+        row = mysql_fetch_row(result);
+        if (row && row[0] && (bounds.empty() || bounds.back() != row[0]))
+            bounds.push_back(row[0]);
+        mysql_free_result(result);
+    }
+    return true;
+}
+
+static string quote(MYSQL *mysql, const string &s)
+{
+    vector<char> buf(s.size() * 2 + 1);
+    unsigned long len = mysql_real_escape_string(mysql, buf.data(), s.data(), s.size());
+    return "'" + string(buf.data(), len) + "'";
+}
+
+//读取[lower,upper)区间内的用户
+void *user_db::load_range(void *arg)
+{
+    range_job *job = (range_job *)arg;
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, job->pool);
+    if (!mysql)
+    {
+        job->rows = -1;
+        return NULL;
+    }
+    string sql = "SELECT username, passwd FROM user WHERE username IS NOT NULL";
+    if (!job->lower.empty())
+        sql += " AND username>=" + quote(mysql, job->lower);
+    if (!job->upper.empty())
+        sql += " AND username<" + quote(mysql, job->upper);
+    job->rows = stream(mysql, sql.c_str(), *job->users, *job->lock);
+    return NULL;
+}
+
+long long user_db::load(map<string, string> &users, locker &lock)
+{
+    return load(connection_pool::GetInstance(), users, lock, LOAD_THREADS);
+}
+
+long long user_db::load(connection_pool *pool, map<string, string> &users, locker &lock, int threads)
+{
+    vector<string> bounds;
+    if (threads > 1)
+    {
+        MYSQL *mysql = NULL;
+        connectionRAII mysqlcon(&mysql, pool);
+        if (!mysql || !indexed(mysql) || !boundaries(mysql, threads, bounds))
+            bounds.clear();
+    }
+    if (bounds.empty())
+    {
+        MYSQL *mysql = NULL;
+        connectionRAII mysqlcon(&mysql, pool);
+        if (!mysql)
+            return -1;
+        return stream(mysql, "SELECT username, passwd FROM user", users, lock);
+    }
+
+    //n个分界点分出n+1个区间,每个区间一个线程一个连接
+    vector<range_job> jobs(bounds.size() + 1);
+    vector<pthread_t> tids(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        range_job &job = jobs[i];
+        job.pool = pool;
+        job.users = &users;
+        job.lock = &lock;
+        job.lower = i > 0 ? bounds[i - 1] : string();
+        job.upper = i < bounds.size() ? bounds[i] : string();
+        job.rows = -1;
+    }
+    size_t started = 0;
+    for (; started < jobs.size(); ++started)
+    {
+        if (pthread_create(&tids[started], NULL, load_range, &jobs[started]) != 0)
+            break;
+    }
+    //线程创建失败的区间在当前线程读取
+    for (size_t i = started; i < jobs.size(); ++i)
+        load_range(&jobs[i]);
+    long long rows = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        if (i < started)
+            pthread_join(tids[i], NULL);
+        if (jobs[i].rows < 0)
+            rows = -1;
+        else if (rows >= 0)
+            rows += jobs[i].rows;
+    }
+    return rows;
+}
+
+//取连接上准备好的语句,第一次使用该连接时准备
+user_db::statements *user_db::prepare(MYSQL *mysql)
+{
+    m_stmt_lock.lock();
+    unordered_map<MYSQL *, statements>::iterator it = m_stmts.find(mysql);
+    if (it != m_stmts.end())
+    {
+        m_stmt_lock.unlock();
+        return &it->second;
+    }
+    m_stmt_lock.unlock();
+
+    statements s;
+    s.select = mysql_stmt_init(mysql);
+    s.insert = mysql_stmt_init(mysql);
+    if (!s.select || !s.insert
+        || mysql_stmt_prepare(s.select, SELECT_SQL, sizeof(SELECT_SQL) - 1)
+        || mysql_stmt_prepare(s.insert, INSERT_SQL, sizeof(INSERT_SQL) - 1))
+    {
+        if (s.select)
+            mysql_stmt_close(s.select);
+        if (s.insert)
+            mysql_stmt_close(s.insert);
+        return NULL;
+    }
+    //连接同一时刻只属于一个线程,不会有两个线程同时为它准备语句
+    m_stmt_lock.lock();
+    statements *out = &m_stmts.insert(make_pair(mysql, s)).first->second;
+    m_stmt_lock.unlock();
+    return out;
+}
+
+//语句执行出错时连接可能已经重连,丢掉旧语句,下次重新准备
+void user_db::discard(MYSQL *mysql)
+{
+    m_stmt_lock.lock();
+    unordered_map<MYSQL *, statements>::iterator it = m_stmts.find(mysql);
+    if (it != m_stmts.end())
+    {
+        mysql_stmt_close(it->second.select);
+        mysql_stmt_close(it->second.insert);
+        m_stmts.erase(it);
+    }
+    m_stmt_lock.unlock();
+}
+
+static void bind_string(MYSQL_BIND &bind, const char *s, unsigned long *len)
+{
+    memset(&bind, 0, sizeof(bind));
+    *len = strlen(s);
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = (void *)s;
+    bind.buffer_length = *len;
+    bind.length = len;
+}
+
+bool user_db::find(const char *name, string &password)
+{
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+    if (!mysql)
+        return false;
+    statements *s = prepare(mysql);
+    if (!s)
+        return false;
+
+    MYSQL_BIND param;
+    unsigned long name_len;
+    bind_string(param, name, &name_len);
+
+    char buf[256];
+    unsigned long len = 0;
+    MYSQL_BIND result;
+    memset(&result, 0, sizeof(result));
+    result.buffer_type = MYSQL_TYPE_STRING;
+    result.buffer = buf;
+    result.buffer_length = sizeof(buf);
+    result.length = &len;
+
+    blocking_guard guard;
+    if (mysql_stmt_bind_param(s->select, &param) || mysql_stmt_execute(s->select)
+        || mysql_stmt_bind_result(s->select, &result))
+    {
+        discard(mysql);
+        return false;
+    }
+    //is_null未设置时由客户端库指向is_null_value
+    bool found = mysql_stmt_fetch(s->select) == 0 && !result.is_null_value;
+    if (found)
+        password.assign(buf, len);
+    mysql_stmt_free_result(s->select);
+    return found;
+}
+
+//同时到达的注册排成队,由一个写者成批写入,其余的等待结果
+bool user_db::insert(const char *name, const char *password)
+{
+    pending p;
+    p.name = name;
+    p.password = password;
+    p.done = false;
+    p.ok = false;
+    p.next = NULL;
+
+    m_lock.lock();
+    if (m_tail)
+        m_tail->next = &p;
+    else
+        m_queue = &p;
+    m_tail = &p;
+
+    blocking_guard guard;
+    while (!p.done)
+    {
+        if (m_writing)
+        {
+            m_cond.wait(m_lock.get());
+            continue;
+        }
+        //取出队头的至多MAX_BATCH个,自己的注册可能要等下一批
+        pending *batch = m_queue;
+        pending *last = batch;
+        size_t n = 1;
+        while (last->next && n < MAX_BATCH)
+        {
+            last = last->next;
+            ++n;
+        }
+        m_queue = last->next;
+        if (!m_queue)
+            m_tail = NULL;
+        last->next = NULL;
+        m_writing = true;
+        m_lock.unlock();
+
+        write_batch(batch);
+
+        m_lock.lock();
+        m_writing = false;
+        ++m_batches;
+        for (pending *q = batch; q; q = q->next)
+        {
+            q->done = true;
+            m_inserted += q->ok;
+        }
+        m_cond.broadcast();
+    }
+    bool ok = p.ok;
+    m_lock.unlock();
+    return ok;
+}
+
+//多条注册放在一个事务中执行,只提交一次;重名等行级错误只影响该行
+void user_db::write_batch(pending *batch)
+{
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+    statements *s = mysql ? prepare(mysql) : NULL;
+    if (!s)
+        return;
+
+    bool transaction = batch->next && mysql_autocommit(mysql, 0) == 0;
+    bool broken = false;
+    for (pending *q = batch; q && !broken; q = q->next)
+    {
+        MYSQL_BIND params[2];
+        unsigned long lens[2];
+        bind_string(params[0], q->name, &lens[0]);
+        bind_string(params[1], q->password, &lens[1]);
+        q->ok = mysql_stmt_bind_param(s->insert, params) == 0 && mysql_stmt_execute(s->insert) == 0;
+        if (!q->ok && mysql_stmt_errno(s->insert) != ER_DUP_ENTRY_CODE)
+            broken = true;
+    }
+    if (transaction)
+    {
+        //提交失败时整批都没有写入
+        if (broken || mysql_commit(mysql))
+        {
+            mysql_rollback(mysql);
+            for (pending *q = batch; q; q = q->next)
+                q->ok = false;
+        }
+        mysql_autocommit(mysql, 1);
+    }
+    if (broken)
+        discard(mysql);
+}
@@ -0,0 +1,100 @@
+#ifndef USER_DB_H
+#define USER_DB_H
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../lock/locker.h"
+#include "../CGImysql/sql_connection_pool.h"
+#include "user_store.h"
+
+//数据库中的用户表.
+//启动时用mysql_use_result流式读取整张表,按批放入内存表,不需要先把全部结果集缓存在客户端;
+//threads>1且用户名上有索引时先按用户名取分界点,每个线程用自己的连接读取一个区间;
+//没有索引时取分界点和每个区间都要扫全表,反而比一次流式读取慢,仍用一个连接.
+//之后的查找和注册都走预处理语句,每个连接只准备一次,请求中不再拼接SQL.
+//并发的注册合并成批:第一个等待的线程作为写者,把排队的注册放在一个事务中执行,一次提交
+class user_db : public user_store
+{
+public:
+    //一批注册的最大条数
+    static const size_t MAX_BATCH = 64;
+    //启动时并行读取用户表的连接数
+    static const int LOAD_THREADS = 4;
+
+    static user_db *get_instance()
+    {
+        static user_db instance;
+        return &instance;
+    }
+
+    //从连接池读取整张用户表,用户名有索引时按区间用LOAD_THREADS个连接并行读取
+    long long load(std::map<std::string, std::string> &users, locker &lock);
+    //读取整张用户表放入users,返回读到的行数,失败返回-1
+    long long load(connection_pool *pool, std::map<std::string, std::string> &users, locker &lock, int threads);
+
+    //按用户名查找密码,找到返回true
+    bool find(const char *name, std::string &password);
+
+    //插入一个用户,与同时到达的注册合并提交,返回是否成功
+    bool insert(const char *name, const char *password);
+
+    //统计信息:执行的批数和插入的行数
+    unsigned long long batches() const { return m_batches; }
+    unsigned long long inserted() const { return m_inserted; }
+
+private:
+    user_db() : m_queue(NULL), m_tail(NULL), m_writing(false), m_batches(0), m_inserted(0) {}
+    ~user_db() {}
+
+    //每个连接上准备好的语句
+    struct statements
+    {
+        MYSQL_STMT *select;
+        MYSQL_STMT *insert;
+    };
+
+    //排队等待写入的注册
+    struct pending
+    {
+        const char *name;
+        const char *password;
+        bool done;              //写者在m_lock下设置,之后ok才有效
+        bool ok;
+        pending *next;
+    };
+
+    struct range_job
+    {
+        connection_pool *pool;
+        std::map<std::string, std::string> *users;
+        locker *lock;
+        std::string lower;      //为空表示没有下界
+        std::string upper;      //为空表示没有上界
+        long long rows;
+    };
+
+    static void *load_range(void *arg);
+    static long long stream(MYSQL *mysql, const char *sql, std::map<std::string, std::string> &users, locker &lock);
+    static bool indexed(MYSQL *mysql);
+    static bool boundaries(MYSQL *mysql, int parts, std::vector<std::string> &bounds);
+    statements *prepare(MYSQL *mysql);
+    void discard(MYSQL *mysql);
+    void write_batch(pending *batch);
+
+private:
+    locker m_stmt_lock;
+    std::unordered_map<MYSQL *, statements> m_stmts;
+
+    locker m_lock;
+    cond m_cond;
+    pending *m_queue;
+    pending *m_tail;
+    bool m_writing;
+    unsigned long long m_batches;
+    unsigned long long m_inserted;
+};
+
+#endif
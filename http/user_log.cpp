@@ -0,0 +1,305 @@
+#include "user_log.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <zlib.h>
+#include "../log/log.h"
+#include "../threadpool/blocking.h"
+
+using namespace std;
+
+static const char MAGIC[8] = {'T', 'W', 'S', 'U', 'S', 'E', 'R', '1'};
+
+user_log::~user_log()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool user_log::open(const char *path, bool shared)
+{
+    if (m_fd >= 0)
+        return false;
+    m_fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    m_shared = shared;
+    return m_fd >= 0;
+}
+
+uint32_t user_log::checksum(const record &r, const char *name, const char *password)
+{
+    uLong crc = crc32(0L, (const Bytef *)&r.name_len, sizeof(r.name_len) + sizeof(r.password_len));
+    crc = crc32(crc, (const Bytef *)name, r.name_len);
+    crc = crc32(crc, (const Bytef *)password, r.password_len);
+    return (uint32_t)crc;
+}
+
+//多个工作进程同时启动时,扫描和截断尾部都在文件锁内进行
+long long user_log::load(map<string, string> &users, locker &lock)
+{
+    if (m_fd < 0)
+        return -1;
+    if (m_shared && flock(m_fd, LOCK_EX) != 0)
+        return -1;
+    long long count = scan(users, lock);
+    if (m_shared)
+        flock(m_fd, LOCK_UN);
+    return count;
+}
+
+//映射整个文件顺序扫描,遇到越界或校验和不对的记录就停下,之后的内容截掉
+long long user_log::scan(map<string, string> &users, locker &lock)
+{
+    struct stat st;
+    if (fstat(m_fd, &st) < 0)
+        return -1;
+    size_t size = st.st_size;
+
+    //新文件只写入magic
+    if (size == 0)
+    {
+        if (pwrite(m_fd, MAGIC, sizeof(MAGIC), 0) != (ssize_t)sizeof(MAGIC) || fdatasync(m_fd) != 0)
+            return -1;
+        m_size = m_durable = sizeof(MAGIC);
+        return 0;
+    }
+    if (size < sizeof(MAGIC))
+        return -1;
+    void *addr = mmap(0, size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (addr == MAP_FAILED)
+        return -1;
+    const char *base = (const char *)addr;
+    if (memcmp(base, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        munmap(addr, size);
+        return -1;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+
+    long long count = 0;
+    size_t pos = sizeof(MAGIC);
+    lock.lock();
+    while (size - pos >= sizeof(record))
+    {
+        record r;
+        memcpy(&r, base + pos, sizeof(r));
+        size_t len = sizeof(r) + r.name_len + r.password_len;
+        if (r.name_len == 0 || len > size - pos)
+            break;
+        const char *name = base + pos + sizeof(r);
+        const char *password = name + r.name_len;
+        if (checksum(r, name, password) != r.crc)
+            break;
+        string key(name, r.name_len);
+        m_index[key] = pos;
+        users[key].assign(password, r.password_len);
+        ++count;
+        pos += len;
+    }
+    lock.unlock();
+    munmap(addr, size);
+
+    if (pos < size)
+    {
+        LOG_WARN("user log: drop %llu bytes of torn records", (unsigned long long)(size - pos));
+        if (ftruncate(m_fd, pos) != 0)
+            return -1;
+    }
+    m_size = m_durable = pos;
+    return count;
+}
+
+bool user_log::find(const char *name, string &password)
+{
+    m_lock.lock();
+    unordered_map<string, uint64_t>::iterator it = m_index.find(name);
+    //可能是其他进程注册的用户,读入文件中新追加的记录再查一次
+    if (it == m_index.end() && m_shared)
+    {
+        catch_up(false);
+        it = m_index.find(name);
+    }
+    //还在缓冲区里的注册尚未成功,不算存在
+    bool found = it != m_index.end() && it->second < m_durable;
+    uint64_t offset = found ? it->second : 0;
+    m_lock.unlock();
+    if (!found)
+        return false;
+
+    record r;
+    if (pread(m_fd, &r, sizeof(r), offset) != (ssize_t)sizeof(r))
+        return false;
+    string data(r.name_len + r.password_len, '\0');
+    if (pread(m_fd, &data[0], data.size(), offset + sizeof(r)) != (ssize_t)data.size())
+        return false;
+    if (checksum(r, data.data(), data.data() + r.name_len) != r.crc)
+        return false;
+    password.assign(data, r.name_len, r.password_len);
+    return true;
+}
+
+//把data写到offset处并同步,调用时不持有m_lock
+bool user_log::sync(const string &data, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = pwrite(m_fd, data.data() + done, data.size() - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return fdatasync(m_fd) == 0;
+}
+
+//写入失败后磁盘上的内容不确定,截回已同步的长度,未同步的注册全部作废
+void user_log::rollback()
+{
+    for (unordered_map<string, uint64_t>::iterator it = m_index.begin(); it != m_index.end();)
+    {
+        if (it->second >= m_durable)
+            it = m_index.erase(it);
+        else
+            ++it;
+    }
+    m_buffer.clear();
+    m_size = m_durable;
+    if (ftruncate(m_fd, m_durable) != 0)
+        LOG_ERROR("%s", "user log: truncate after failed sync");
+}
+
+//不持有文件锁时可能读到其他进程写了一半的记录,停在那里,下次再读;
+//exclusive为true时调用者持有文件锁,这样的记录是写者中途退出留下的,截掉,否则之后追加的记录都读不到
+void user_log::catch_up(bool exclusive)
+{
+    struct stat st;
+    if (fstat(m_fd, &st) < 0 || (uint64_t)st.st_size <= m_durable)
+        return;
+    uint64_t size = st.st_size;
+    uint64_t pos = m_durable;
+    string data;
+    while (size - pos >= sizeof(record))
+    {
+        record r;
+        if (pread(m_fd, &r, sizeof(r), pos) != (ssize_t)sizeof(r))
+            break;
+        size_t len = sizeof(r) + r.name_len + r.password_len;
+        if (r.name_len == 0 || len > size - pos)
+            break;
+        data.resize(r.name_len + r.password_len);
+        if (pread(m_fd, &data[0], data.size(), pos + sizeof(r)) != (ssize_t)data.size())
+            break;
+        if (checksum(r, data.data(), data.data() + r.name_len) != r.crc)
+            break;
+        m_index[data.substr(0, r.name_len)] = pos;
+        pos += len;
+    }
+    if (exclusive && pos < size)
+    {
+        LOG_WARN("user log: drop %llu bytes of torn records", (unsigned long long)(size - pos));
+        if (ftruncate(m_fd, pos) != 0)
+            LOG_ERROR("%s", "user log: truncate torn records");
+    }
+    m_size = m_durable = pos;
+}
+
+//多进程模式下不攒批:每次注册在文件锁内判重并追加到文件末尾,同一进程内的注册由m_lock串行
+bool user_log::insert_shared(const string &key, const record &r, const char *password)
+{
+    blocking_guard guard;
+    m_lock.lock();
+    if (flock(m_fd, LOCK_EX) != 0)
+    {
+        m_lock.unlock();
+        return false;
+    }
+    catch_up(true);
+    bool ok = false;
+    if (m_index.find(key) == m_index.end())
+    {
+        string data((const char *)&r, sizeof(r));
+        data += key;
+        data.append(password, r.password_len);
+        ok = sync(data, m_durable);
+        ++m_syncs;
+        if (ok)
+        {
+            m_index[key] = m_durable;
+            m_size = m_durable += data.size();
+            ++m_appended;
+        }
+        else if (ftruncate(m_fd, m_durable) != 0)
+            LOG_ERROR("%s", "user log: truncate after failed sync");
+    }
+    flock(m_fd, LOCK_UN);
+    m_lock.unlock();
+    return ok;
+}
+
+bool user_log::insert(const char *name, const char *password)
+{
+    size_t name_len = strlen(name);
+    size_t password_len = strlen(password);
+    if (m_fd < 0 || name_len == 0 || name_len > 0xffff || password_len > 0xffff)
+        return false;
+    record r;
+    r.name_len = name_len;
+    r.password_len = password_len;
+    r.crc = checksum(r, name, password);
+    if (m_shared)
+        return insert_shared(string(name, name_len), r, password);
+
+    m_lock.lock();
+    if (m_broken || !m_index.insert(make_pair(string(name, name_len), m_size)).second)
+    {
+        m_lock.unlock();
+        return false;
+    }
+    m_buffer.append((const char *)&r, sizeof(r));
+    m_buffer.append(name, name_len);
+    m_buffer.append(password, password_len);
+    m_size += sizeof(r) + name_len + password_len;
+    uint64_t end = m_size;
+
+    blocking_guard guard;
+    while (m_durable < end && !m_broken)
+    {
+        if (m_syncing)
+        {
+            m_cond.wait(m_lock.get());
+            continue;
+        }
+        //取走缓冲区中所有的记录,一次写入一次同步
+        string data;
+        data.swap(m_buffer);
+        uint64_t offset = m_durable;
+        uint64_t upto = m_size;
+        m_syncing = true;
+        m_lock.unlock();
+
+        bool ok = sync(data, offset);
+
+        m_lock.lock();
+        m_syncing = false;
+        ++m_syncs;
+        if (ok)
+            m_durable = upto;
+        else
+        {
+            m_broken = true;
+            rollback();
+            LOG_ERROR("%s", "user log: sync failed, registrations disabled");
+        }
+        m_cond.broadcast();
+    }
+    bool ok = m_durable >= end;
+    if (ok)
+        ++m_appended;
+    m_lock.unlock();
+    return ok;
+}
@@ -0,0 +1,71 @@
+#ifndef USER_LOG_H
+#define USER_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include "../lock/locker.h"
+#include "user_store.h"
+
+//本地的用户存储,不需要mysqld:
+//  [magic "TWSUSER1"][记录][记录]...   记录 = [crc32][用户名长度][密码长度][用户名][密码]
+//文件只追加,内存中用哈希表记录每个用户名所在的偏移.并发的注册攒在缓冲区里,
+//第一个等待的线程作为写者把缓冲区一次写入并fdatasync,其余的随这次同步一起返回.
+//启动时mmap整个文件顺序扫描重建索引,校验和不对的尾部记录视为写了一半,截掉.
+//多进程模式下每个工作进程各自打开文件,注册在文件锁内先读入其他进程追加的记录再判重、追加
+class user_log : public user_store
+{
+public:
+    static user_log *get_instance()
+    {
+        static user_log instance;
+        return &instance;
+    }
+
+    //打开或创建日志文件,之后由load恢复.shared为true时文件同时被多个进程使用
+    bool open(const char *path, bool shared = false);
+
+    long long load(std::map<std::string, std::string> &users, locker &lock);
+    bool find(const char *name, std::string &password);
+    bool insert(const char *name, const char *password);
+
+    //统计信息:fdatasync的次数和写入的用户数
+    unsigned long long syncs() const { return m_syncs; }
+    unsigned long long appended() const { return m_appended; }
+
+private:
+    user_log() : m_fd(-1), m_shared(false), m_size(0), m_durable(0), m_syncing(false), m_broken(false), m_syncs(0), m_appended(0) {}
+    ~user_log();
+
+    struct record
+    {
+        uint32_t crc;               //从name_len到密码末尾的crc32
+        uint16_t name_len;
+        uint16_t password_len;
+    };
+
+    static uint32_t checksum(const record &r, const char *name, const char *password);
+    long long scan(std::map<std::string, std::string> &users, locker &lock);
+    bool sync(const std::string &data, uint64_t offset);
+    void rollback();
+    //多进程模式:读入其他进程在m_durable之后追加的记录,调用者持有m_lock
+    void catch_up(bool exclusive);
+    bool insert_shared(const std::string &key, const record &r, const char *password);
+
+private:
+    int m_fd;
+    bool m_shared;
+    locker m_lock;
+    cond m_cond;
+    std::unordered_map<std::string, uint64_t> m_index; //用户名->记录偏移,含尚未同步的
+    std::string m_buffer;           //已追加、尚未写入文件的记录
+    uint64_t m_size;                //下一条记录的偏移
+    uint64_t m_durable;             //已经同步到磁盘的长度
+    bool m_syncing;                 //有写者正在写入
+    bool m_broken;                  //写入或同步失败后不再接受注册
+    unsigned long long m_syncs;
+    unsigned long long m_appended;
+};
+
+#endif
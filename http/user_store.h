@@ -0,0 +1,26 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <map>
+#include <string>
+#include "../lock/locker.h"
+
+//用户存储后端.处理请求时只需要"按用户名取密码"和"插入用户"两种操作,
+//启动时整张表读入内存表,之后内存表未命中才调用find.
+//后端在启动时选择:MySQL(user_db)或本地日志文件(user_log)
+class user_store
+{
+public:
+    virtual ~user_store() {}
+
+    //读取全部用户放入users,返回读到的个数,失败返回-1
+    virtual long long load(std::map<std::string, std::string> &users, locker &lock) = 0;
+
+    //按用户名查找密码,找到返回true
+    virtual bool find(const char *name, std::string &password) = 0;
+
+    //插入一个用户,返回是否成功写入
+    virtual bool insert(const char *name, const char *password) = 0;
+};
+
+#endif
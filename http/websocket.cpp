@@ -0,0 +1,316 @@
+#include "websocket.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "http_conn.h"
+#include "reactor_queue.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+//握手
+//---------------------------------------------------------------------------
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static inline uint32_t rol(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+//只用于握手,输入很短,按FIPS 180-1逐块计算
+static void sha1(const unsigned char *data, size_t len, unsigned char out[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    //填充后的消息:原文,0x80,若干0,64位的比特长度
+    size_t total = (len + 8) / 64 * 64 + 64;
+    vector<unsigned char> msg(total, 0);
+    memcpy(msg.data(), data, len);
+    msg[len] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i)
+        msg[total - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+    for (size_t block = 0; block < total; block += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            const unsigned char *p = &msg[block + i * 4];
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; ++i)
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        out[i * 4] = (unsigned char)(h[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(h[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(h[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)h[i];
+    }
+}
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//out至少(len+2)/3*4+1字节
+static void base64(const unsigned char *data, size_t len, char *out)
+{
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3)
+    {
+        uint32_t v = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+        *out++ = BASE64[v >> 18];
+        *out++ = BASE64[(v >> 12) & 63];
+        *out++ = BASE64[(v >> 6) & 63];
+        *out++ = BASE64[v & 63];
+    }
+    if (i < len)
+    {
+        uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < len ? (uint32_t)data[i + 1] << 8 : 0);
+        *out++ = BASE64[v >> 18];
+        *out++ = BASE64[(v >> 12) & 63];
+        *out++ = i + 1 < len ? BASE64[(v >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+    *out = '\0';
+}
+
+bool websocket::accept_key(const char *key, size_t len, char *out)
+{
+    //16字节随机数的base64编码固定为24个字符,以"=="结尾
+    if (len != 24 || key[22] != '=' || key[23] != '=')
+        return false;
+    for (size_t i = 0; i < 22; ++i)
+    {
+        if (!strchr(BASE64, key[i]) || key[i] == '\0')
+            return false;
+    }
+    unsigned char text[24 + sizeof(WS_GUID) - 1];
+    memcpy(text, key, 24);
+    memcpy(text + 24, WS_GUID, sizeof(WS_GUID) - 1);
+    unsigned char digest[20];
+    sha1(text, sizeof(text), digest);
+    base64(digest, sizeof(digest), out);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+//帧
+//---------------------------------------------------------------------------
+
+void websocket::unmask(char *data, size_t len, const unsigned char key[4])
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    uint32_t k;
+    memcpy(&k, key, 4);
+    const __m128i pattern = _mm_set1_epi32((int)k);
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(v, pattern));
+    }
+#endif
+    //i是16的倍数,剩余部分的掩码下标仍从i&3开始
+    for (; i < len; ++i)
+        data[i] ^= key[i & 3];
+}
+
+websocket::PARSE_RESULT websocket::parse(char *buf, size_t avail, size_t max_len, frame &f, size_t &used)
+{
+    if (avail < 2)
+        return FRAME_INCOMPLETE;
+    const unsigned char *p = (const unsigned char *)buf;
+    //没有协商扩展,RSV位必须为0
+    if (p[0] & 0x70)
+        return FRAME_BAD;
+    f.fin = (p[0] & 0x80) != 0;
+    f.opcode = p[0] & 0x0f;
+    bool control = (f.opcode & 0x8) != 0;
+    switch (f.opcode)
+    {
+    case OP_CONTINUATION:
+    case OP_TEXT:
+    case OP_BINARY:
+    case OP_CLOSE:
+    case OP_PING:
+    case OP_PONG:
+        break;
+    default:
+        return FRAME_BAD;
+    }
+    //客户端发来的帧必须带掩码
+    if (!(p[1] & 0x80))
+        return FRAME_BAD;
+
+    uint64_t len = p[1] & 0x7f;
+    size_t head = 2;
+    if (len == 126)
+    {
+        if (avail < 4)
+            return FRAME_INCOMPLETE;
+        len = (uint64_t)p[2] << 8 | p[3];
+        head = 4;
+    }
+    else if (len == 127)
+    {
+        if (avail < 10)
+            return FRAME_INCOMPLETE;
+        len = 0;
+        for (int i = 0; i < 8; ++i)
+            len = len << 8 | p[2 + i];
+        head = 10;
+    }
+    //控制帧不能分片,负载不超过125字节
+    if (control && (!f.fin || len > MAX_CONTROL))
+        return FRAME_BAD;
+    if (len > max_len)
+        return FRAME_BAD;
+    if (avail < head + 4 + len)
+        return FRAME_INCOMPLETE;
+
+    unsigned char key[4];
+    memcpy(key, p + head, 4);
+    f.payload = buf + head + 4;
+    f.len = len;
+    unmask(f.payload, f.len, key);
+    used = head + 4 + len;
+    return FRAME_OK;
+}
+
+shared_body websocket::encode(int opcode, const char *payload, size_t len)
+{
+    string *out = new string;
+    out->reserve(len + 10);
+    out->push_back((char)(0x80 | opcode));
+    if (len < 126)
+        out->push_back((char)len);
+    else if (len <= 0xffff)
+    {
+        out->push_back((char)126);
+        out->push_back((char)(len >> 8));
+        out->push_back((char)len);
+    }
+    else
+    {
+        out->push_back((char)127);
+        for (int i = 7; i >= 0; --i)
+            out->push_back((char)((uint64_t)len >> (8 * i)));
+    }
+    out->append(payload, len);
+    return shared_body(out);
+}
+
+//---------------------------------------------------------------------------
+//广播
+//---------------------------------------------------------------------------
+
+void ws_hub::subscribe(http_conn *conn)
+{
+    if (conn->m_ws_slot >= 0)
+        return;
+    conn->m_ws_slot = (int)m_members.size();
+    m_members.push_back(conn);
+}
+
+//把最后一个订阅者移到空出的位置
+void ws_hub::unsubscribe(http_conn *conn)
+{
+    int slot = conn->m_ws_slot;
+    if (slot < 0)
+        return;
+    http_conn *last = m_members.back();
+    m_members[slot] = last;
+    last->m_ws_slot = slot;
+    m_members.pop_back();
+    conn->m_ws_slot = -1;
+}
+
+bool ws_hub::publish(const char *text, size_t len)
+{
+    shared_body frame = websocket::encode(websocket::OP_TEXT, text, len);
+    m_lock.lock();
+    m_pending.push_back(frame);
+    ++m_published;
+    //主线程还没取走上一批时不必再次唤醒,这条消息会在同一批中发出
+    bool post = !m_posted;
+    m_posted = true;
+    m_lock.unlock();
+    if (post && !reactor_queue::get_instance()->post(deliver, this))
+    {
+        m_lock.lock();
+        m_pending.clear();
+        m_posted = false;
+        m_lock.unlock();
+        return false;
+    }
+    return true;
+}
+
+void ws_hub::deliver(void *arg)
+{
+    ws_hub *hub = (ws_hub *)arg;
+    hub->m_lock.lock();
+    hub->m_sending.swap(hub->m_pending);
+    hub->m_posted = false;
+    hub->m_lock.unlock();
+    hub->broadcast(hub->m_sending.data(), hub->m_sending.size());
+    hub->m_sending.clear();
+}
+
+void ws_hub::ping()
+{
+    static const shared_body frame = websocket::encode(websocket::OP_PING, "", 0);
+    broadcast(&frame, 1);
+}
+
+//每个订阅者的队列中只增加对同一份编码结果的引用;发送失败或积压过多的连接由ws_push标记,主循环随后关闭
+void ws_hub::broadcast(const shared_body *frames, size_t count)
+{
+    for (size_t i = 0; i < m_members.size(); ++i)
+    {
+        if (m_members[i]->ws_push(frames, count))
+            m_delivered += count;
+        else
+            ++m_dropped;
+    }
+}
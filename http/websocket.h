@@ -0,0 +1,108 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "../lock/locker.h"
+#include "content_cache.h"
+
+//WebSocket(RFC 6455)的握手和帧编解码,不涉及socket.
+//客户端发来的帧都带掩码,解析时在读缓冲区中原地去掉:SSE2一次异或16个字节,16是掩码长度4的倍数,
+//把4字节掩码重复4次就是每16字节的异或模式.服务器发出的帧不带掩码,编码结果是shared_body,
+//广播时一条消息只编码一次,所有订阅者的发送队列共享同一份
+class websocket
+{
+public:
+    enum OPCODE
+    {
+        OP_CONTINUATION = 0x0,
+        OP_TEXT = 0x1,
+        OP_BINARY = 0x2,
+        OP_CLOSE = 0x8,
+        OP_PING = 0x9,
+        OP_PONG = 0xA
+    };
+    enum PARSE_RESULT
+    {
+        FRAME_OK = 0,       //解析出一帧
+        FRAME_INCOMPLETE,   //帧不完整,需要继续读取
+        FRAME_BAD           //协议错误或帧过大,应当断开
+    };
+    //Sec-WebSocket-Accept的长度:SHA-1的20字节经base64编码
+    static const size_t ACCEPT_LEN = 28;
+    //控制帧负载的最大长度
+    static const size_t MAX_CONTROL = 125;
+
+    struct frame
+    {
+        int opcode;
+        bool fin;
+        char *payload;      //指向缓冲区内已去掉掩码的负载
+        size_t len;
+    };
+
+    //从buf的前avail个字节解析一帧,负载超过max_len视为非法;成功时used为整帧占用的字节数
+    static PARSE_RESULT parse(char *buf, size_t avail, size_t max_len, frame &f, size_t &used);
+
+    //data与4字节掩码异或,data从负载的第一个字节开始
+    static void unmask(char *data, size_t len, const unsigned char key[4]);
+
+    //由Sec-WebSocket-Key计算Sec-WebSocket-Accept,out至少ACCEPT_LEN+1字节;key不是16字节的base64时返回false
+    static bool accept_key(const char *key, size_t len, char *out);
+
+    //编码一个服务器帧,不带掩码
+    static shared_body encode(int opcode, const char *payload, size_t len);
+};
+
+class http_conn;
+
+//订阅广播的WebSocket连接表,连接表和各连接的发送队列只在主线程上访问.
+//publish可以在任意线程调用:消息在调用线程编码一次放进待发列表,经reactor_queue唤醒主线程;
+//主线程一次取走所有待发的消息,放进每个订阅者的发送队列,每个订阅者只writev一次
+class ws_hub
+{
+public:
+    static ws_hub *get_instance()
+    {
+        static ws_hub instance;
+        return &instance;
+    }
+
+    //主线程调用:握手完成的连接加入,关闭的连接退出
+    void subscribe(http_conn *conn);
+    void unsubscribe(http_conn *conn);
+
+    //任意线程调用,向所有订阅者发送一条文本消息
+    bool publish(const char *text, size_t len);
+
+    //主线程调用:向所有订阅者发送ping,不回应的连接由空闲定时器关闭
+    void ping();
+
+    //统计信息:订阅者数,发布的消息数,放入发送队列的帧数,因发送过慢被断开的连接数
+    size_t subscribers() const { return m_members.size(); }
+    unsigned long long published() const { return m_published; }
+    unsigned long long delivered() const { return m_delivered; }
+    unsigned long long dropped() const { return m_dropped; }
+
+private:
+    ws_hub() : m_posted(false), m_published(0), m_delivered(0), m_dropped(0) {}
+    ~ws_hub() {}
+
+    static void deliver(void *arg);
+    void broadcast(const shared_body *frames, size_t count);
+
+private:
+    std::vector<http_conn *> m_members;     //订阅者在其中的下标记在http_conn::m_ws_slot
+
+    locker m_lock;                          //保护m_pending和m_posted
+    std::vector<shared_body> m_pending;     //已编码、等待主线程发送的消息
+    std::vector<shared_body> m_sending;     //deliver时与m_pending交换,容量复用
+    bool m_posted;                          //已经交给reactor_queue,主线程尚未取走
+
+    unsigned long long m_published;
+    unsigned long long m_delivered;
+    unsigned long long m_dropped;
+};
+
+#endif
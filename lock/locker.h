@@ -2,8 +2,10 @@
 #define LOCKER_H
 
 #include<exception>
+#include<errno.h>
 #include<pthread.h>
 #include<semaphore.h>
+#include<time.h>
 
 class sem{
 public:
@@ -16,7 +18,20 @@ public:
     }
 
     bool wait(){
-        return sem_wait(&m_sem);
+        return sem_wait(&m_sem)==0;
+    }
+
+    //最多等待ms毫秒,超时或被信号中断返回false,可通过errno区分
+    bool timedwait(int ms){
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME,&ts);
+        ts.tv_sec+=ms/1000;
+        ts.tv_nsec+=(long)(ms%1000)*1000000;
+        if(ts.tv_nsec>=1000000000){
+            ts.tv_sec+=1;
+            ts.tv_nsec-=1000000000;
+        }
+        return sem_timedwait(&m_sem,&ts)==0;
     }
 
     bool post(){
@@ -29,8 +44,18 @@ private:
 
 class locker{
 public:
-    locker(){
-        if(pthread_mutex_init(&m_mutex,NULL)!=0) throw std::exception();
+    //shared为true时锁放在进程间共享的内存里,供多个进程使用;
+    //同时设为robust,持有锁的进程崩溃后由下一个加锁的进程接手,不会永远锁住
+    explicit locker(bool shared=false){
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        if(shared){
+            pthread_mutexattr_setpshared(&attr,PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr,PTHREAD_MUTEX_ROBUST);
+        }
+        int ret=pthread_mutex_init(&m_mutex,&attr);
+        pthread_mutexattr_destroy(&attr);
+        if(ret!=0) throw std::exception();
     }
 
     ~locker(){
@@ -38,13 +63,27 @@ public:
     }
 
     bool lock(){
-        return pthread_mutex_lock(&m_mutex)==0;
+        bool owner_dead;
+        return lock(&owner_dead);
+    }
+
+    //上一个持有者在持锁时退出的话owner_dead置为true,它保护的数据可能只改了一半,
+    //调用者应在解锁前先把数据恢复到一致的状态
+    bool lock(bool *owner_dead){
+        int ret=pthread_mutex_lock(&m_mutex);
+        *owner_dead=(ret==EOWNERDEAD);
+        if(ret==EOWNERDEAD) ret=pthread_mutex_consistent(&m_mutex);
+        return ret==0;
     }
 
     bool unlock(){
         return pthread_mutex_unlock(&m_mutex)==0;
     }
 
+    pthread_mutex_t *get(){
+        return &m_mutex;
+    }
+
 private:
     pthread_mutex_t m_mutex;
 };
@@ -72,8 +111,17 @@ public:
         return ret==0;
     }
 
+    //在调用者持有的互斥锁上等待
+    bool wait(pthread_mutex_t *mutex){
+        return pthread_cond_wait(&m_cond,mutex)==0;
+    }
+
     bool signal(){
-        pthread_cond_signal(&m_cond)==0;
+        return pthread_cond_signal(&m_cond)==0;
+    }
+
+    bool broadcast(){
+        return pthread_cond_broadcast(&m_cond)==0;
     }
 
 private:
@@ -0,0 +1,81 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <string>
+#include <unordered_map>
+#include "locker.h"
+#include "../threadpool/blocking.h"
+
+//请求合并:同一个键上并发的多次调用只真正执行一次,其余调用者等待这次执行并共享结果.
+//用于缓存未命中时的加载,防止热点资源刚上线或缓存清空时大量请求同时打到磁盘或数据库
+template<typename V>
+class single_flight{
+public:
+    single_flight():m_leaders(0),m_coalesced(0){}
+
+    //执行fn()并返回结果;相同key已有调用在进行中时等待它完成,*shared置为true
+    template<typename F>
+    V run(const std::string &key,F fn,bool *shared=NULL){
+        m_lock.lock();
+        typename call_map::iterator it=m_calls.find(key);
+        if(it!=m_calls.end()){
+            call *c=it->second;
+            ++c->refs;
+            ++m_coalesced;
+            {
+                //等待期间工作线程被占住,通知线程池必要时扩容
+                blocking_guard guard;
+                while(!c->done) m_cond.wait(m_lock.get());
+            }
+            V result=c->result;
+            release(c);
+            m_lock.unlock();
+            if(shared) *shared=true;
+            return result;
+        }
+        call *c=new call;
+        c->done=false;
+        c->refs=1;
+        m_calls.insert(std::make_pair(key,c));
+        ++m_leaders;
+        m_lock.unlock();
+
+        V result=fn();
+
+        m_lock.lock();
+        c->result=result;
+        c->done=true;
+        m_calls.erase(key);
+        release(c);
+        m_cond.broadcast();
+        m_lock.unlock();
+        if(shared) *shared=false;
+        return result;
+    }
+
+    //统计信息:真正执行的次数和被合并掉的次数
+    unsigned long long leaders() const { return m_leaders; }
+    unsigned long long coalesced() const { return m_coalesced; }
+
+private:
+    struct call{
+        bool done;
+        int refs;       //发起者和等待者各持有一份,最后一个释放
+        V result;
+    };
+    typedef std::unordered_map<std::string,call*> call_map;
+
+    //调用者需持有m_lock
+    void release(call *c){
+        if(--c->refs==0) delete c;
+    }
+
+private:
+    locker m_lock;
+    cond m_cond;
+    call_map m_calls;                   //进行中的调用
+    unsigned long long m_leaders;
+    unsigned long long m_coalesced;
+};
+
+#endif
@@ -33,7 +33,7 @@ public:
     ~block_queue(){
         pthread_mutex_lock(m_mutex);
         if(m_array!=NULL){
-            delete m_array;
+            delete [] m_array;
         }
         pthread_mutex_unlock(m_mutex);
 
@@ -145,7 +145,7 @@ public:
         while(m_size<=0){
             //重新抢到互斥锁时，pthread_cond_wait返回为0
             if(pthread_cond_wait(m_cond,m_mutex)){
-                pthread_mutex_unlock(mutex);
+                pthread_mutex_unlock(m_mutex);
                 return false;
             }
         }
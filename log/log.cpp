@@ -40,7 +40,7 @@ bool Log::init(const char*file_name,int log_buf_size,int split_lines,int max_que
     //输出内容的长度
     m_log_buf_size=log_buf_size;
     m_buf=new char[m_log_buf_size];
-    memset(m_buf,'\0',sizeof(m_buf));
+    memset(m_buf,'\0',m_log_buf_size);
     
     m_split_lines=split_lines;
 
@@ -99,7 +99,7 @@ void Log::write_log(int level,const char* format,...){
         break;
     case 3:
         strcpy(s,"[erro]:");
-    
+        break;
     default:
         strcpy(s,"[info]:");
         break;
@@ -139,7 +139,8 @@ void Log::write_log(int level,const char* format,...){
     //将传入的format参数赋值给valst,便于格式化输出
     va_start(valst,format);
 
-    string log_str;
+    //每个线程复用同一个string的容量,稳定后写日志不再分配内存
+    static thread_local string log_str;
     pthread_mutex_lock(m_mutex);
 
     //写入内容格式：时间 + 内容
@@ -153,7 +154,7 @@ void Log::write_log(int level,const char* format,...){
     m_buf[n+m]='\n';
     m_buf[n+m+1]='\0';
 
-    log_str=m_buf;
+    log_str.assign(m_buf,n+m+1);
     pthread_mutex_unlock(m_mutex);
 
     //若m_is_async为true表示不同步，默认为同步
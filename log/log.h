@@ -26,6 +26,7 @@ public:
     //异步写日志公有方法
     static void *flush_log_thread(void *args){
         Log::get_instance()->async_write_log();
+        return NULL;
     }
 
     //将输出内容按照标准格式整理
@@ -48,6 +49,7 @@ private:
             fputs(single_log.c_str(),m_fp);
             pthread_mutex_unlock(m_mutex);
         }
+        return NULL;
     }
 
 private:
@@ -6,31 +6,531 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
 #include <cassert>
+#include <vector>
 #include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 #include "./lock/locker.h"
 #include "./threadpool/threadpool.h"
 #include "./timer/lst_timer.h"
 #include "./http/http_conn.h"
+#include "./http/reactor_queue.h"
+#include "./http/user_db.h"
+#include "./http/user_log.h"
 #include "./log/log.h"
+#include "./process/master.h"
+#include "./process/shared_stats.h"
 #include "./CGImysql/sql_connection_pool.h"
 
 #define MAX_FD 65536           //最大文件描述符
 #define MAX_EVENT_NUMBER 10000 //最大事件数
-#define TIMESLOT 5             //最小超时单位
+#define TIMEOUT 15000          //连接空闲超时,毫秒
+#define SESSION_SWEEP 1000     //会话表过期清理的间隔,毫秒
+#define WS_PING 10000          //WebSocket连接的ping间隔,毫秒,小于TIMEOUT,回应pong的连接不会超时
+#define STATS_PUBLISH 1000     //多进程模式下工作进程发布统计的间隔,毫秒
+#define DRAIN_TIMEOUT 15000    //优雅退出时等待已有连接结束的最长时间,毫秒
 
 #define SYNSQL //同步数据库校验
 
 #define SYNLOG //同步写日志
 
+#define INLINE_FASTPATH //命中静态缓存的小请求直接在I/O线程上处理
+
 //#define ET   //边缘触发非阻塞
 #define LT   //水平触发阻塞
 
-extern int addfd(int epollfd,int fd,bool one_shot);
-extern int remove(int epollfd,int fd);
+extern void addfd(int epollfd,int fd,bool one_shot);
+extern void removefd(int epollfd,int fd);
 extern int setnonblocking(int fd);
+extern const char *doc_root;
 
 //设置定时器相关参数
-static int pipefd[2];
-static sort_timer_lst timer_lst;
\ No newline at end of file
+//定时器由timerfd驱动,注册在epoll中,不再使用SIGALRM和管道
+static int epollfd=0;
+static sort_timer_lst timer_lst;
+//定时器关闭连接时要释放连接上的WebSocket状态
+static http_conn *users=NULL;
+
+//设置信号函数
+void addsig(int sig,void(handler)(int),bool restart=true){
+    struct sigaction sa;
+    memset(&sa,'\0',sizeof(sa));
+    sa.sa_handler=handler;
+    if(restart){
+        sa.sa_flags|=SA_RESTART;
+    }
+    sigfillset(&sa.sa_mask);
+    assert(sigaction(sig,&sa,NULL)!=-1);
+}
+
+//定时器回调函数,删除非活动连接在socket上的注册事件,并关闭
+void cb_func(client_data *user_data){
+    assert(user_data);
+    users[user_data->sockfd].release();
+    epoll_ctl(epollfd,EPOLL_CTL_DEL,user_data->sockfd,0);
+    close(user_data->sockfd);
+    http_conn::m_user_count--;
+    LOG_INFO("close fd %d", user_data->sockfd);
+    Log::get_instance()->flush();
+}
+
+void show_error(int connfd,const char* info){
+    printf("%s",info);
+    send(connfd,info,strlen(info),0);
+    close(connfd);
+}
+
+//为新连接创建定时器并加入链表
+static void add_conn_timer(client_data *users_timer,int connfd,const sockaddr_in &client_address){
+    users_timer[connfd].address=client_address;
+    users_timer[connfd].sockfd=connfd;
+    util_timer* timer=new util_timer;
+    timer->user_data=&users_timer[connfd];
+    timer->cb_func=cb_func;
+    timer->expire=timer_now_ms()+TIMEOUT;
+    users_timer[connfd].timer=timer;
+    timer_lst.add_timer(timer);
+}
+
+//连接上有数据传输,将定时器往后延迟
+static void adjust_conn_timer(util_timer* timer){
+    if(timer){
+        timer->expire=timer_now_ms()+TIMEOUT;
+        timer_lst.adjust_timer(timer);
+    }
+}
+
+//关闭连接并移除其定时器
+static void close_conn_timer(client_data *users_timer,int sockfd){
+    util_timer* timer=users_timer[sockfd].timer;
+    if(timer){
+        timer->cb_func(&users_timer[sockfd]);
+        timer_lst.del_timer(timer);
+        users_timer[sockfd].timer=NULL;
+    }
+}
+
+//会话表的过期清理挂在连接定时器的链表上,由同一个timerfd驱动,每次到期后重新加入
+static void sweep_sessions(client_data *);
+static void add_sweep_timer(){
+    util_timer* timer=new util_timer;
+    timer->user_data=NULL;
+    timer->cb_func=sweep_sessions;
+    timer->expire=timer_now_ms()+SESSION_SWEEP;
+    timer_lst.add_timer(timer);
+}
+
+static void sweep_sessions(client_data *){
+    session_store::get_instance()->expire();
+    add_sweep_timer();
+}
+
+//WebSocket的ping同样挂在定时器链表上
+static void ping_websockets(client_data *);
+static void add_ping_timer(){
+    util_timer* timer=new util_timer;
+    timer->user_data=NULL;
+    timer->cb_func=ping_websockets;
+    timer->expire=timer_now_ms()+WS_PING;
+    timer_lst.add_timer(timer);
+}
+
+static void ping_websockets(client_data *){
+    ws_hub::get_instance()->ping();
+    add_ping_timer();
+}
+
+//工作进程的统计同样由定时器每秒写入共享内存
+static void publish_stats(client_data *);
+static void add_stats_timer(){
+    util_timer* timer=new util_timer;
+    timer->user_data=NULL;
+    timer->cb_func=publish_stats;
+    timer->expire=timer_now_ms()+STATS_PUBLISH;
+    timer_lst.add_timer(timer);
+}
+
+static void publish_stats(client_data *){
+    worker_counters c;
+    http_conn::collect_stats(c);
+    shared_stats::get_instance()->publish(c);
+    add_stats_timer();
+}
+
+//记录被拒绝的请求,每1000次输出一次,避免过载时日志本身成为负担
+static void log_shed(threadpool<http_conn> *pool){
+    admission_control &ac=pool->admission();
+    if(ac.shed()%1000==1){
+        LOG_WARN("overload: shed %llu admitted %llu limit %d decreases %llu",
+                 ac.shed(),ac.admitted(),ac.limit(),ac.decreases());
+    }
+}
+
+//创建监听socket,失败时返回-1;平滑升级时直接使用旧主进程传下来的同一端口的socket
+static int open_listener(int port){
+    int fd=master_process::inherited_listener(port);
+    if(fd>=0) return fd;
+    fd=socket(PF_INET,SOCK_STREAM,0);
+    if(fd<0) return -1;
+
+    struct sockaddr_in address;
+    bzero(&address,sizeof(address));
+    address.sin_family=AF_INET;
+    address.sin_addr.s_addr=htonl(INADDR_ANY);
+    address.sin_port=htons(port);
+
+    int flag=1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&flag,sizeof(flag));
+    if(bind(fd,(struct sockaddr*)&address,sizeof(address))<0||listen(fd,5)<0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//多进程模式下每个工作进程的epoll都注册了同一个监听socket,EPOLLEXCLUSIVE让一个新连接只唤醒其中一个
+static void add_listener(int fd,bool exclusive){
+    if(!exclusive){
+        addfd(epollfd,fd,false);
+        return;
+    }
+    epoll_event event;
+    event.data.fd=fd;
+    event.events=EPOLLIN|EPOLLET|EPOLLEXCLUSIVE;
+    epoll_ctl(epollfd,EPOLL_CTL_ADD,fd,&event);
+    setnonblocking(fd);
+}
+
+//优雅退出时工作进程不再接受新连接,其他进程手里的同一个监听socket不受影响
+static void stop_listening(int &fd){
+    if(fd<0) return;
+    epoll_ctl(epollfd,EPOLL_CTL_DEL,fd,0);
+    close(fd);
+    fd=-1;
+}
+
+int main(int argc,char* argv[]){
+    //-u指定本地用户日志文件时不连接MySQL;-s同时在另一个端口上提供HTTPS,-c/-k为PEM格式的证书链和私钥;
+    //-w以多进程模式运行,由主进程管理指定数量的工作进程,0(默认)为单进程
+    const char *user_log_path=NULL;
+    const char *cert_path=NULL;
+    const char *key_path=NULL;
+    int tls_port=0;
+    int workers=0;
+    bool bad_option=false;
+    int opt;
+    while((opt=getopt(argc,argv,"+u:s:c:k:w:"))!=-1){
+        if(opt=='u') user_log_path=optarg;
+        else if(opt=='s') tls_port=atoi(optarg);
+        else if(opt=='c') cert_path=optarg;
+        else if(opt=='k') key_path=optarg;
+        else if(opt=='w') workers=atoi(optarg);
+        else bad_option=true;
+    }
+    if(tls_port>0&&(!cert_path||!key_path)) bad_option=true;
+    if(workers<0||workers>shared_stats::MAX_WORKERS) bad_option=true;
+    if(bad_option||optind>=argc){
+        printf("usage: %s [-u user_log] [-s https_port -c cert -k key] [-w workers] port_number [static_pack]\n",basename(argv[0]));
+        return 1;
+    }
+
+    //异步日志的写线程不会随fork进入工作进程,多进程模式下只能同步写
+#ifdef ASYNLOG
+    Log::get_instance()->init("ServerLog",2000,800000,workers>0?0:8); //异步日志模型
+#endif
+
+#ifdef SYNLOG
+    Log::get_instance()->init("ServerLog",2000,800000,0); //同步日志模型
+#endif
+
+    int port=atoi(argv[optind]);
+    const char *pack_path=optind+1<argc?argv[optind+1]:NULL;
+
+    //忽略SIGPIPE信号
+    addsig(SIGPIPE,SIG_IGN);
+
+    if(tls_port>0&&!tls_context::get_instance()->init(cert_path,key_path)){
+        printf("cannot load certificate %s or key %s\n",cert_path,key_path);
+        return 1;
+    }
+
+    //监听socket在fork前创建,所有工作进程共用
+    int listenfd=open_listener(port);
+    assert(listenfd>=0);
+    //HTTPS监听socket,未启用时为-1
+    int tlsfd=-1;
+    if(tls_port>0){
+        tlsfd=open_listener(tls_port);
+        assert(tlsfd>=0);
+    }
+    master_process::close_inherited();
+
+    //多进程模式:会话表和统计放进共享内存后fork,主进程在run中一直运行到退出,
+    //下面的初始化(线程池、缓存、用户表等)在每个工作进程中各做一次
+    if(workers>0){
+        if(!session_store::get_instance()->share()||!shared_stats::get_instance()->init(workers)){
+            printf("cannot map shared memory\n");
+            return 1;
+        }
+        std::vector<int> listeners(1,listenfd);
+        if(tlsfd>=0) listeners.push_back(tlsfd);
+        master_process master(workers,listeners,argv);
+        if(master.run()<0){
+            close(listenfd);
+            if(tlsfd>=0) close(tlsfd);
+            return 0;
+        }
+    }
+
+    //选择用户存储:本地日志文件,或者创建数据库连接池;多进程模式下各工作进程都追加同一个日志文件
+    user_store *store=user_db::get_instance();
+    if(user_log_path){
+        if(!user_log::get_instance()->open(user_log_path,workers>0)){
+            printf("cannot open user log %s\n",user_log_path);
+            return 1;
+        }
+        store=user_log::get_instance();
+    }
+    else{
+        connection_pool *connPool=connection_pool::GetInstance();
+        connPool->init("localhost","root","root","qgydb",3306,8);
+    }
+
+    //创建线程池
+    threadpool<http_conn> *pool=NULL;
+    try{
+        pool=new threadpool<http_conn>;
+    }
+    catch(...){
+        return 1;
+    }
+
+    //冷文件的预读交给专门的I/O线程,不占用工作线程和主线程
+    if(!file_loader::get_instance()->init(4)){
+        return 1;
+    }
+
+    //资源包模式:整个包只mmap一次,静态文件不再访问doc_root
+    if(pack_path){
+        if(!static_pack::get_instance()->open(pack_path)){
+            printf("cannot load static pack %s\n",pack_path);
+            return 1;
+        }
+        LOG_INFO("static pack %s: %d assets",pack_path,(int)static_pack::get_instance()->count());
+    }
+    //建立doc_root的文件过滤器,不存在的路径直接404;建立失败时照常stat
+    else if(!path_filter::get_instance()->init(doc_root)){
+        LOG_WARN("%s","cannot index doc_root, 404s will stat");
+    }
+
+    //含{{user}}等占位符的页面编译成模板,资源包模式下同样优先于包内的同名文件
+    int templates=template_cache::get_instance()->init(doc_root);
+    if(templates>0){
+        LOG_INFO("compiled %d page templates",templates);
+    }
+
+    users=new http_conn[MAX_FD];
+    assert(users);
+
+    //把全部用户读入内存表
+    if(!http_conn::init_users(store)){
+        return 1;
+    }
+
+    //创建内核事件表
+    epoll_event events[MAX_EVENT_NUMBER];
+    epollfd=epoll_create(5);
+    assert(epollfd!=-1);
+
+    add_listener(listenfd,workers>0);
+    if(tlsfd>=0) add_listener(tlsfd,workers>0);
+    http_conn::m_epollfd=epollfd;
+    http_conn::m_pool=pool;
+
+    //timerfd与监听socket一样注册在epoll中,可读时处理到期的定时器
+    int timerfd=timer_lst.create_timerfd();
+    assert(timerfd>=0);
+    addfd(epollfd,timerfd,false);
+    add_sweep_timer();
+    add_ping_timer();
+
+    //其他线程通过eventfd把协程恢复等回调交给主线程
+    int resumefd=reactor_queue::get_instance()->fd();
+    assert(resumefd>=0);
+    addfd(epollfd,resumefd,false);
+
+    //工作进程在事件循环中通过signalfd处理主进程转发的SIGTERM(立即退出)和SIGQUIT(优雅退出)
+    int sigfd=-1;
+    if(workers>0){
+        sigset_t mask;
+        master_process::worker_signals(&mask);
+        sigfd=signalfd(-1,&mask,SFD_NONBLOCK|SFD_CLOEXEC);
+        assert(sigfd>=0);
+        addfd(epollfd,sigfd,false);
+        add_stats_timer();
+    }
+
+    client_data *users_timer=new client_data[MAX_FD];
+
+    bool stop_server=false;
+    //优雅退出的截止时间,0表示没有在退出;会话清理定时器每秒唤醒一次事件循环检查
+    long long drain_deadline=0;
+
+    while(!stop_server){
+        int number=epoll_wait(epollfd,events,MAX_EVENT_NUMBER,-1);
+        if(number<0&&errno!=EINTR){
+            LOG_ERROR("%s","epoll failure");
+            break;
+        }
+
+        for(int i=0;i<number;i++){
+            int sockfd=events[i].data.fd;
+
+            //处理新到的客户连接,监听socket注册为边缘触发,需要一次接受完
+            if(sockfd==listenfd||sockfd==tlsfd){
+                while(true){
+                    struct sockaddr_in client_address;
+                    socklen_t client_addrlength=sizeof(client_address);
+                    int connfd=accept(sockfd,(struct sockaddr*)&client_address,&client_addrlength);
+                    if(connfd<0){
+                        if(errno!=EAGAIN&&errno!=EWOULDBLOCK){
+                            LOG_ERROR("%s:errno is:%d","accept error",errno);
+                        }
+                        break;
+                    }
+                    if(http_conn::m_user_count>=MAX_FD){
+                        show_error(connfd,"Internal server busy");
+                        LOG_ERROR("%s","Internal server busy");
+                        break;
+                    }
+                    //线程池已饱和,新连接直接回应503,不再为其分配定时器和读取请求;HTTPS连接握手前无法回应,直接关闭
+                    if(pool->saturated()){
+                        if(sockfd==listenfd) http_conn::reject(connfd);
+                        close(connfd);
+                        log_shed(pool);
+                        continue;
+                    }
+                    users[connfd].init(connfd,client_address);
+                    add_conn_timer(users_timer,connfd,client_address);
+                    if(sockfd==tlsfd&&!users[connfd].start_tls()){
+                        close_conn_timer(users_timer,connfd);
+                    }
+                }
+            }
+            //定时器到期,关闭超时的非活动连接
+            else if(sockfd==timerfd){
+                timer_lst.tick();
+            }
+            //在主线程上恢复完成等待的协程
+            else if(sockfd==resumefd){
+                reactor_queue::get_instance()->drain();
+            }
+            else if(sockfd==sigfd){
+                struct signalfd_siginfo info;
+                while(read(sigfd,&info,sizeof(info))==(ssize_t)sizeof(info)){
+                    if(info.ssi_signo!=SIGQUIT){
+                        stop_server=true;
+                    }
+                    else if(drain_deadline==0){
+                        drain_deadline=timer_now_ms()+DRAIN_TIMEOUT;
+                    }
+                }
+            }
+            //服务器端关闭连接,移除对应的定时器
+            else if(events[i].events&(EPOLLRDHUP|EPOLLHUP|EPOLLERR)){
+                users[sockfd].resume_reader(false);
+                close_conn_timer(users_timer,sockfd);
+            }
+            //WebSocket连接的读写都在主线程上完成
+            else if(users[sockfd].is_websocket()){
+                if(users[sockfd].ws_event(events[i].events)){
+                    adjust_conn_timer(users_timer[sockfd].timer);
+                }
+                else{
+                    close_conn_timer(users_timer,sockfd);
+                }
+            }
+            //HTTPS连接的握手在线程池中推进,可读可写都交给它
+            else if(users[sockfd].tls_handshaking()){
+                if(pool->append(users+sockfd)){
+                    adjust_conn_timer(users_timer[sockfd].timer);
+                }
+                else{
+                    close_conn_timer(users_timer,sockfd);
+                    log_shed(pool);
+                }
+            }
+            //处理客户连接上接收到的数据
+            else if(events[i].events&EPOLLIN){
+                util_timer *timer=users_timer[sockfd].timer;
+                bool readable=users[sockfd].read_once();
+                //有协程在等待这个连接上的数据时交给它
+                if(users[sockfd].resume_reader(readable)){
+                    if(readable) adjust_conn_timer(timer);
+                    else close_conn_timer(users_timer,sockfd);
+                }
+                else if(readable){
+                    LOG_INFO("deal with the client(%s)",inet_ntoa(users[sockfd].get_address()->sin_addr));
+                    Log::get_instance()->flush();
+#ifdef INLINE_FASTPATH
+                    //先在I/O线程上尝试处理,只有需要阻塞的请求才进入线程池
+                    http_conn::INLINE_RESULT result=users[sockfd].process_inline();
+                    if(result==http_conn::INLINE_DONE){
+                        adjust_conn_timer(timer);
+                        continue;
+                    }
+                    if(result==http_conn::INLINE_CLOSE){
+                        close_conn_timer(users_timer,sockfd);
+                        continue;
+                    }
+#endif
+                    //若监测到读事件,将该事件放入请求队列,过载被拒绝时回应503并关闭
+                    if(pool->append(users+sockfd)){
+                        adjust_conn_timer(timer);
+                    }
+                    else{
+                        if(!users[sockfd].is_tls()) http_conn::reject(sockfd);
+                        close_conn_timer(users_timer,sockfd);
+                        log_shed(pool);
+                    }
+                }
+                else{
+                    close_conn_timer(users_timer,sockfd);
+                }
+            }
+            else if(events[i].events&EPOLLOUT){
+                util_timer *timer=users_timer[sockfd].timer;
+                if(users[sockfd].write()){
+                    LOG_INFO("send data to the client(%s)",inet_ntoa(users[sockfd].get_address()->sin_addr));
+                    Log::get_instance()->flush();
+                    adjust_conn_timer(timer);
+                }
+                else{
+                    close_conn_timer(users_timer,sockfd);
+                }
+            }
+        }
+        //这一批事件处理完再关闭监听socket,批中后面的事件可能还属于它
+        if(drain_deadline>0&&listenfd>=0){
+            LOG_INFO("worker %d: draining %d connections",(int)getpid(),http_conn::m_user_count);
+            stop_listening(listenfd);
+            stop_listening(tlsfd);
+        }
+        //已有的连接都已关闭,或者等到了截止时间
+        if(drain_deadline>0&&(http_conn::m_user_count==0||timer_now_ms()>=drain_deadline)){
+            stop_server=true;
+        }
+    }
+
+    close(epollfd);
+    if(listenfd>=0) close(listenfd);
+    if(tlsfd>=0) close(tlsfd);
+    if(sigfd>=0) close(sigfd);
+    delete[] users;
+    delete[] users_timer;
+    delete pool;
+    return 0;
+}
@@ -0,0 +1,310 @@
+#include "master.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "shared_stats.h"
+#include "../log/log.h"
+
+using namespace std;
+
+const char *master_process::LISTENERS_ENV = "TINYWEBSERVER_LISTENERS";
+
+static void parse_inherited();
+static pid_t s_old_master = 0;
+
+master_process::master_process(int workers, const vector<int> &listeners, char **argv)
+    : m_workers(workers), m_listeners(listeners), m_argv(argv),
+      m_pids(workers, 0), m_started(workers, 0), m_respawn(workers, 0),
+      m_upgrade(0), m_old_master(0), m_stopping(0)
+{
+    sigemptyset(&m_saved);
+    parse_inherited();
+    m_old_master = s_old_master;
+}
+
+long long master_process::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void master_process::worker_signals(sigset_t *set)
+{
+    sigemptyset(set);
+    sigaddset(set, SIGTERM);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGQUIT);
+}
+
+//信号全部屏蔽,由sigtimedwait同步取出,每秒至少醒来一次处理到期的重启和统计合计
+int master_process::run()
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &set, &m_saved);
+
+    LOG_INFO("master %d: starting %d workers", (int)getpid(), m_workers);
+    for (int i = 0; i < m_workers; ++i)
+    {
+        if (spawn(i) == 0)
+            return i;
+    }
+
+    while (true)
+    {
+        struct timespec timeout = {1, 0};
+        int sig = sigtimedwait(&set, NULL, &timeout);
+        if (sig == SIGTERM || sig == SIGINT || sig == SIGQUIT)
+        {
+            //优雅退出的过程中还可以用SIGTERM要求立即退出,反过来不行
+            if (m_stopping != SIGTERM)
+                m_stopping = sig == SIGQUIT ? SIGQUIT : SIGTERM;
+            LOG_INFO("master %d: signal %d, stopping workers", (int)getpid(), sig);
+            signal_workers(m_stopping);
+        }
+        else if (sig == SIGUSR2)
+            upgrade();
+
+        reap();
+        Log::get_instance()->flush();
+        if (m_stopping)
+        {
+            bool running = false;
+            for (int i = 0; i < m_workers; ++i)
+                running = running || m_pids[i] != 0;
+            if (!running)
+                break;
+            continue;
+        }
+
+        long long now = now_ms();
+        for (int i = 0; i < m_workers; ++i)
+        {
+            if (m_pids[i] == 0 && m_respawn[i] != 0 && m_respawn[i] <= now && spawn(i) == 0)
+                return i;
+        }
+        if (m_old_master)
+            take_over(now);
+        shared_stats::get_instance()->aggregate();
+    }
+
+    LOG_INFO("master %d: all workers exited", (int)getpid());
+    Log::get_instance()->flush();
+    return -1;
+}
+
+//fork前先把日志缓冲写出,否则子进程会再写一遍
+pid_t master_process::spawn(int slot)
+{
+    pid_t master = getpid();
+    Log::get_instance()->flush();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        LOG_ERROR("master: fork worker %d failed, errno %d", slot, errno);
+        m_respawn[slot] = now_ms() + 1000;
+        return -1;
+    }
+    if (pid == 0)
+    {
+        //主进程意外退出时工作进程收到SIGQUIT,处理完已有的连接后退出;
+        //prctl之前主进程就已经退出的话收不到这个信号,直接退出
+        prctl(PR_SET_PDEATHSIG, SIGQUIT);
+        if (getppid() != master)
+            _exit(0);
+        sigset_t set;
+        worker_signals(&set);
+        for (int sig = 1; sig < NSIG; ++sig)
+        {
+            if (sigismember(&m_saved, sig) == 1)
+                sigaddset(&set, sig);
+        }
+        sigprocmask(SIG_SETMASK, &set, NULL);
+        shared_stats::get_instance()->attach(slot);
+        return 0;
+    }
+    m_pids[slot] = pid;
+    m_started[slot] = now_ms();
+    m_respawn[slot] = 0;
+    shared_stats::get_instance()->started(slot, pid);
+    LOG_INFO("master: worker %d started, pid %d", slot, (int)pid);
+    return pid;
+}
+
+void master_process::reap()
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        int code = WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status);
+        const char *how = WIFSIGNALED(status) ? "signal" : "status";
+        //新的主进程接管后会一直运行到旧主进程退出,在此之前退出说明升级失败
+        if (pid == m_upgrade)
+        {
+            LOG_WARN("master: new master %d exited with %s %d, upgrade failed", (int)pid, how, code);
+            m_upgrade = 0;
+            continue;
+        }
+        for (int i = 0; i < m_workers; ++i)
+        {
+            if (m_pids[i] != pid)
+                continue;
+            m_pids[i] = 0;
+            shared_stats::get_instance()->retire(i);
+            if (m_stopping)
+                break;
+            LOG_WARN("master: worker %d (pid %d) exited with %s %d, restarting", i, (int)pid, how, code);
+            long long now = now_ms();
+            m_respawn[i] = now - m_started[i] < 1000 ? now + 1000 : now;
+            break;
+        }
+    }
+}
+
+//升级起来的新主进程:工作进程都运行满1秒(没有刚起来就崩溃)后通知旧主进程优雅退出.
+//旧主进程已经不是父进程时说明它先退出了,pid可能已被复用,不再发信号
+void master_process::take_over(long long now)
+{
+    for (int i = 0; i < m_workers; ++i)
+    {
+        if (m_pids[i] == 0 || now - m_started[i] < 1000)
+            return;
+    }
+    if (getppid() == m_old_master)
+    {
+        LOG_INFO("master %d: workers up, sending SIGQUIT to old master %d", (int)getpid(), (int)m_old_master);
+        kill(m_old_master, SIGQUIT);
+    }
+    m_old_master = 0;
+}
+
+void master_process::signal_workers(int sig)
+{
+    for (int i = 0; i < m_workers; ++i)
+    {
+        if (m_pids[i] != 0)
+            kill(m_pids[i], sig);
+    }
+}
+
+//新程序是旧主进程的子进程,继承监听socket和命令行;它的工作进程起来之后两代同时接受连接,
+//直到新主进程向旧主进程发SIGQUIT结束旧的一代(见take_over).exec失败或新的工作进程一直起不来时
+//旧的一代照常运行,新进程退出时reap里记录升级失败
+void master_process::upgrade()
+{
+    if (m_upgrade != 0 || m_stopping)
+    {
+        LOG_WARN("master %d: upgrade ignored", (int)getpid());
+        return;
+    }
+    string fds;
+    for (size_t i = 0; i < m_listeners.size(); ++i)
+    {
+        if (i > 0)
+            fds += ';';
+        fds += to_string(m_listeners[i]);
+    }
+    Log::get_instance()->flush();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        LOG_ERROR("master: fork for upgrade failed, errno %d", errno);
+        return;
+    }
+    if (pid == 0)
+    {
+        for (size_t i = 0; i < m_listeners.size(); ++i)
+        {
+            int flags = fcntl(m_listeners[i], F_GETFD);
+            if (flags >= 0)
+                fcntl(m_listeners[i], F_SETFD, flags & ~FD_CLOEXEC);
+        }
+        setenv(LISTENERS_ENV, fds.c_str(), 1);
+        sigprocmask(SIG_SETMASK, &m_saved, NULL);
+        execvp(m_argv[0], m_argv);
+        _exit(127);
+    }
+    m_upgrade = pid;
+    LOG_INFO("master %d: upgrading, new master %d", (int)getpid(), (int)pid);
+}
+
+//环境变量只解析一次,解析后删除,不再传给之后exec的程序
+static vector<int> s_inherited;
+
+static void parse_inherited()
+{
+    static bool parsed = false;
+    if (parsed)
+        return;
+    parsed = true;
+    const char *env = getenv(master_process::LISTENERS_ENV);
+    if (!env)
+        return;
+    //环境变量只由升级时的旧主进程设置,它就是父进程
+    pid_t parent = getppid();
+    s_old_master = parent > 1 ? parent : 0;
+    const char *p = env;
+    while (*p)
+    {
+        char *end;
+        long fd = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        if (fd >= 0)
+            s_inherited.push_back((int)fd);
+        if (*end != ';')
+            break;
+        p = end + 1;
+    }
+    unsetenv(master_process::LISTENERS_ENV);
+}
+
+int master_process::inherited_listener(int port)
+{
+    parse_inherited();
+    for (size_t i = 0; i < s_inherited.size(); ++i)
+    {
+        int fd = s_inherited[i];
+        if (fd < 0)
+            continue;
+        struct sockaddr_in address;
+        socklen_t len = sizeof(address);
+        int listening = 0;
+        socklen_t optlen = sizeof(listening);
+        if (getsockname(fd, (struct sockaddr *)&address, &len) < 0 || address.sin_family != AF_INET ||
+            getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen) < 0 || !listening)
+            continue;
+        if (ntohs(address.sin_port) == port)
+        {
+            s_inherited[i] = -1;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+void master_process::close_inherited()
+{
+    parse_inherited();
+    for (size_t i = 0; i < s_inherited.size(); ++i)
+    {
+        if (s_inherited[i] >= 0)
+            close(s_inherited[i]);
+    }
+    s_inherited.clear();
+}
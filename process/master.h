@@ -0,0 +1,57 @@
+#ifndef MASTER_H
+#define MASTER_H
+
+#include <signal.h>
+#include <sys/types.h>
+#include <vector>
+
+//多进程模式的主进程:监听socket在fork前创建,所有工作进程共用,各自运行完整的事件循环和线程池.
+//主进程不处理连接,只负责管理工作进程:
+//  工作进程退出后重新fork一个,启动不到1秒就退出的等1秒再起,避免崩溃时反复fork
+//  SIGTERM/SIGINT  通知工作进程立即退出,全部退出后主进程退出
+//  SIGQUIT         通知工作进程优雅退出:关闭监听socket,处理完已有的连接再退出
+//  SIGUSR2         平滑升级:fork并exec磁盘上新的程序,监听socket通过环境变量传给它,
+//                  新的主进程等自己的工作进程都运行满1秒后向旧主进程发SIGQUIT,
+//                  升级过程中监听socket一直在接受连接
+//每秒把各工作进程发布的统计加成合计,见shared_stats
+class master_process
+{
+public:
+    //升级时传递监听socket的环境变量,值为以';'分隔的描述符
+    static const char *LISTENERS_ENV;
+
+    master_process(int workers, const std::vector<int> &listeners, char **argv);
+
+    //主进程在这里一直运行到退出,返回-1;在fork出的工作进程中返回它的编号(0到workers-1)
+    int run();
+
+    //工作进程由signalfd处理的信号,fork后保持屏蔽
+    static void worker_signals(sigset_t *set);
+
+    //旧主进程传下来的、绑定在port上的监听socket,没有时返回-1
+    static int inherited_listener(int port);
+    //关闭传下来但没有用到的监听socket(新程序不再监听那个端口)
+    static void close_inherited();
+
+private:
+    pid_t spawn(int slot);
+    void reap();
+    void signal_workers(int sig);
+    void upgrade();
+    void take_over(long long now);
+    static long long now_ms();
+
+private:
+    int m_workers;
+    std::vector<int> m_listeners;
+    char **m_argv;
+    std::vector<pid_t> m_pids;              //每个槽位上的工作进程,0表示没有
+    std::vector<long long> m_started;       //工作进程的启动时间
+    std::vector<long long> m_respawn;       //等待重新fork的时间,0表示不需要
+    pid_t m_upgrade;                        //升级时fork出的新主进程
+    pid_t m_old_master;                     //本进程是升级起来的新主进程时为旧主进程,接管后为0
+    int m_stopping;                         //收到的退出信号,0表示照常运行
+    sigset_t m_saved;                       //run之前的信号屏蔽字,exec新程序前恢复
+};
+
+#endif
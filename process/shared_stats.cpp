@@ -0,0 +1,125 @@
+#include "shared_stats.h"
+#include <string.h>
+#include <sys/mman.h>
+
+bool shared_stats::init(int workers)
+{
+    if (m_region || workers <= 0 || workers > MAX_WORKERS)
+        return false;
+    //匿名映射的内容全为0,序号、pid和计数都不用再初始化
+    void *addr = mmap(0, sizeof(region), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return false;
+    m_region = (region *)addr;
+    m_region->workers = workers;
+    memset(&m_retired, 0, sizeof(m_retired));
+    return true;
+}
+
+//写者在写到一半时被杀掉会留下奇数的序号,下一次写入从偶数重新开始
+void shared_stats::store(slot &s, const worker_counters &c)
+{
+    unsigned seq = s.seq.load(std::memory_order_relaxed) & ~1u;
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&s.counters, &c, sizeof(c));
+    s.seq.store(seq + 2, std::memory_order_release);
+}
+
+//同样因为写者可能死在写入中间,重读有次数上限,超过后接受这份可能不完整的计数
+void shared_stats::load(const slot &s, worker_counters &c)
+{
+    for (int tries = 0; tries < 1000; ++tries)
+    {
+        unsigned seq = s.seq.load(std::memory_order_acquire);
+        memcpy(&c, &s.counters, sizeof(c));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!(seq & 1) && s.seq.load(std::memory_order_relaxed) == seq)
+            return;
+    }
+}
+
+void shared_stats::started(int slot, pid_t pid)
+{
+    if (!m_region || slot < 0 || slot >= m_region->workers)
+        return;
+    m_region->slots[slot].pid.store(pid, std::memory_order_relaxed);
+    m_region->slots[slot].restarts.fetch_add(1, std::memory_order_relaxed);
+}
+
+//连接数是当前值,不计入基数
+void shared_stats::retire(int slot)
+{
+    if (!m_region || slot < 0 || slot >= m_region->workers)
+        return;
+    struct slot &s = m_region->slots[slot];
+    worker_counters c;
+    load(s, c);
+    m_retired.file_hits += c.file_hits;
+    m_retired.file_misses += c.file_misses;
+    m_retired.encode_hits += c.encode_hits;
+    m_retired.encode_misses += c.encode_misses;
+    m_retired.avoided += c.avoided;
+    m_retired.tls_handshakes += c.tls_handshakes;
+    m_retired.tls_resumed += c.tls_resumed;
+    m_retired.h2_sessions += c.h2_sessions;
+    m_retired.h2_streams += c.h2_streams;
+    memset(&c, 0, sizeof(c));
+    store(s, c);
+    s.pid.store(0, std::memory_order_relaxed);
+}
+
+void shared_stats::aggregate()
+{
+    if (!m_region)
+        return;
+    worker_counters sum = m_retired;
+    for (int i = 0; i < m_region->workers; ++i)
+    {
+        worker_counters c;
+        load(m_region->slots[i], c);
+        sum.connections += c.connections;
+        sum.file_hits += c.file_hits;
+        sum.file_misses += c.file_misses;
+        sum.encode_hits += c.encode_hits;
+        sum.encode_misses += c.encode_misses;
+        sum.avoided += c.avoided;
+        sum.websockets += c.websockets;
+        sum.tls_handshakes += c.tls_handshakes;
+        sum.tls_resumed += c.tls_resumed;
+        sum.h2_sessions += c.h2_sessions;
+        sum.h2_streams += c.h2_streams;
+    }
+    store(m_region->total, sum);
+}
+
+void shared_stats::publish(const worker_counters &c)
+{
+    if (m_region && m_self >= 0)
+        store(m_region->slots[m_self], c);
+}
+
+bool shared_stats::read(int slot, worker_counters &c, pid_t *pid, unsigned *restarts) const
+{
+    if (!m_region || slot < 0 || slot >= m_region->workers)
+        return false;
+    const struct slot &s = m_region->slots[slot];
+    load(s, c);
+    if (pid)
+        *pid = s.pid.load(std::memory_order_relaxed);
+    //第一次启动不算重启
+    if (restarts)
+    {
+        unsigned n = s.restarts.load(std::memory_order_relaxed);
+        *restarts = n > 0 ? n - 1 : 0;
+    }
+    return true;
+}
+
+bool shared_stats::total(worker_counters &c) const
+{
+    if (!m_region)
+        return false;
+    load(m_region->total, c);
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef SHARED_STATS_H
+#define SHARED_STATS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <atomic>
+
+//一个工作进程的统计计数,除connections外都是从进程启动起累计的
+struct worker_counters
+{
+    long long connections;
+    unsigned long long file_hits;
+    unsigned long long file_misses;
+    unsigned long long encode_hits;
+    unsigned long long encode_misses;
+    unsigned long long avoided;             //不stat直接404的请求
+    unsigned long long websockets;
+    unsigned long long tls_handshakes;
+    unsigned long long tls_resumed;
+    unsigned long long h2_sessions;
+    unsigned long long h2_streams;
+};
+
+//多进程模式下的统计:主进程在fork前映射一块MAP_SHARED的匿名内存,每个工作进程一个槽位.
+//工作进程每秒把自己的计数写进槽位,主进程每秒把各槽位加起来写进合计,
+//状态页在任一工作进程上都能看到全部进程的数字.
+//每个槽位只有一个写者,用序号(seqlock)保证读者拿到的是一次完整的写入:
+//写之前序号变为奇数,写完变为偶数,读者读到奇数或前后序号不同就重读
+class shared_stats
+{
+public:
+    static const int MAX_WORKERS = 64;
+
+    static shared_stats *get_instance()
+    {
+        static shared_stats instance;
+        return &instance;
+    }
+
+    //主进程在fork前调用
+    bool init(int workers);
+    bool enabled() const { return m_region != NULL; }
+    int workers() const { return m_region ? m_region->workers : 0; }
+
+    //主进程:slot上的工作进程已启动,重启的次数加一;工作进程退出时把它的累计计数并入合计的基数,槽位清零
+    void started(int slot, pid_t pid);
+    void retire(int slot);
+    //主进程:重新计算合计
+    void aggregate();
+
+    //工作进程:fork后记下自己的槽位,之后publish写入
+    void attach(int slot) { m_self = slot; }
+    int self() const { return m_self; }
+    void publish(const worker_counters &c);
+
+    //读取一个工作进程或合计的计数,pid为0表示该槽位上没有运行的进程
+    bool read(int slot, worker_counters &c, pid_t *pid = 0, unsigned *restarts = 0) const;
+    bool total(worker_counters &c) const;
+
+private:
+    shared_stats() : m_region(0), m_self(-1) {}
+    ~shared_stats() {}
+
+    struct slot
+    {
+        std::atomic<unsigned> seq;
+        std::atomic<int> pid;
+        std::atomic<unsigned> restarts;
+        worker_counters counters;
+    };
+    struct region
+    {
+        int workers;
+        slot total;
+        slot slots[MAX_WORKERS];
+    };
+
+    static void store(slot &s, const worker_counters &c);
+    static void load(const slot &s, worker_counters &c);
+
+private:
+    region *m_region;
+    int m_self;
+    worker_counters m_retired;              //主进程:已退出的工作进程的累计计数
+};
+
+#endif
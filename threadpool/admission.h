@@ -0,0 +1,94 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <time.h>
+#include <atomic>
+#include "../lock/locker.h"
+
+//过载控制:按请求在队列中的排队时间(sojourn time)自适应调整允许的并发上限.
+//思路来自CoDel:排队时间偶尔超过目标值是正常的突发,只有在一整个观察窗口内
+//排队时间都没有降到目标值以下,才说明形成了"站立队列",此时把并发上限乘性减小;
+//排队时间恢复正常后每个窗口加性增大,直到配置的最大值.
+//超过上限的请求由调用者直接用预先生成的503拒绝,保证被接纳请求的p99稳定
+class admission_control{
+public:
+    //target_us:可接受的排队时间,interval_us:观察窗口
+    admission_control(int max_limit,int min_limit=8,long long target_us=5000,long long interval_us=100000)
+    :m_max_limit(max_limit),m_min_limit(min_limit<max_limit?min_limit:max_limit),
+     m_target_us(target_us),m_interval_us(interval_us),
+     m_limit(max_limit),m_first_above(0),m_last_increase(0),
+     m_admitted(0),m_shed(0),m_decreases(0)
+    {
+    }
+
+    static long long now_us(){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        return (long long)ts.tv_sec*1000000+ts.tv_nsec/1000;
+    }
+
+    //load为排队中和处理中的请求总数,返回是否接纳新请求
+    bool admit(int load){
+        if(load<m_limit.load(std::memory_order_relaxed)){
+            m_admitted.fetch_add(1,std::memory_order_relaxed);
+            return true;
+        }
+        m_shed.fetch_add(1,std::memory_order_relaxed);
+        return false;
+    }
+
+    //不计数的查询,用于决定是否还要接受新连接
+    bool saturated(int load) const{
+        return load>=m_limit.load(std::memory_order_relaxed);
+    }
+
+    //工作线程取出请求时调用,sojourn_us为该请求的排队时间,queue_empty表示取出后队列已空
+    void on_dequeue(long long sojourn_us,bool queue_empty){
+        long long now=now_us();
+        m_lock.lock();
+        if(sojourn_us<m_target_us||queue_empty){
+            m_first_above=0;
+            //排队时间正常,每个窗口加性增大上限
+            if(now-m_last_increase>=m_interval_us){
+                int limit=m_limit.load(std::memory_order_relaxed);
+                int step=limit/10>0?limit/10:1;
+                m_limit.store(limit+step<m_max_limit?limit+step:m_max_limit,std::memory_order_relaxed);
+                m_last_increase=now;
+            }
+        }
+        else if(m_first_above==0){
+            m_first_above=now+m_interval_us;
+        }
+        else if(now>=m_first_above){
+            //整个窗口内排队时间都超标,乘性减小上限,并开始下一个观察窗口
+            int limit=m_limit.load(std::memory_order_relaxed)*3/4;
+            m_limit.store(limit>m_min_limit?limit:m_min_limit,std::memory_order_relaxed);
+            m_first_above=now+m_interval_us;
+            m_last_increase=now;
+            m_decreases.fetch_add(1,std::memory_order_relaxed);
+        }
+        m_lock.unlock();
+    }
+
+    //统计信息
+    int limit() const { return m_limit.load(std::memory_order_relaxed); }
+    unsigned long long admitted() const { return m_admitted.load(std::memory_order_relaxed); }
+    unsigned long long shed() const { return m_shed.load(std::memory_order_relaxed); }
+    unsigned long long decreases() const { return m_decreases.load(std::memory_order_relaxed); }
+    void count_shed() { m_shed.fetch_add(1,std::memory_order_relaxed); }
+
+private:
+    const int m_max_limit;                      //并发上限的最大值,即线程池允许的最大请求数
+    const int m_min_limit;                      //并发上限的最小值
+    const long long m_target_us;                //目标排队时间
+    const long long m_interval_us;              //观察窗口
+    std::atomic<int> m_limit;                   //当前并发上限
+    long long m_first_above;                    //排队时间持续超标到这个时刻就减小上限,0表示未超标
+    long long m_last_increase;                  //上次增大上限的时刻
+    locker m_lock;                              //保护m_first_above和m_last_increase
+    std::atomic<unsigned long long> m_admitted; //接纳的请求数
+    std::atomic<unsigned long long> m_shed;     //拒绝的请求和连接数
+    std::atomic<unsigned long long> m_decreases;//减小上限的次数
+};
+
+#endif
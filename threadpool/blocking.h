@@ -0,0 +1,38 @@
+#ifndef BLOCKING_H
+#define BLOCKING_H
+
+#include <stddef.h>
+
+//工作线程的阻塞区间标记.线程池让每个工作线程记住自己所属的线程池,
+//任务代码在执行数据库查询等可能长时间阻塞的操作时用blocking_guard包起来,
+//线程池据此知道有多少线程被阻塞,必要时临时增加线程,避免队列里的请求饿死
+class blocking_monitor{
+public:
+    virtual ~blocking_monitor() {}
+    virtual void enter_blocking() = 0;
+    virtual void leave_blocking() = 0;
+
+    //当前线程所属的线程池,非工作线程为NULL
+    static blocking_monitor *&current(){
+        static thread_local blocking_monitor *monitor=NULL;
+        return monitor;
+    }
+};
+
+class blocking_guard{
+public:
+    blocking_guard():m_monitor(blocking_monitor::current()){
+        if(m_monitor) m_monitor->enter_blocking();
+    }
+    ~blocking_guard(){
+        if(m_monitor) m_monitor->leave_blocking();
+    }
+
+private:
+    blocking_guard(const blocking_guard&);
+    blocking_guard& operator=(const blocking_guard&);
+
+    blocking_monitor *m_monitor;
+};
+
+#endif
@@ -1,85 +1,180 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H 
 
-#include<list>
+#include<vector>
 #include<cstdio>
+#include<cerrno>
 #include<exception>
 #include<pthread.h>
 #include"../lock/locker.h"
+#include"admission.h"
+#include"blocking.h"
 
+//线程数在[thread_number,max_thread_number]之间动态调整:
+//没有空闲线程且队列积压,或工作线程都阻塞在数据库等操作上时增加线程;
+//线程空闲超过idle_timeout_ms后退出,直到回落到thread_number
 template<typename T>
-class threadpool{
+class threadpool:public blocking_monitor{
 public:
-    threadpool(int thread_number=8,int max_requests=1000);
+    //max_thread_number为0时取thread_number的4倍
+    threadpool(int thread_number=8,int max_requests=1000,int max_thread_number=0,int idle_timeout_ms=60000);
     ~threadpool();
 
+    //请求入队,队列已满或过载控制拒绝时返回false,由调用者回应503
     bool append(T* request);
 
+    //当前负载是否已达并发上限,调用者可据此暂停接受新连接
+    bool saturated();
+
+    admission_control &admission() { return m_admission; }
+
+    //工作线程通过blocking_guard标记阻塞区间
+    void enter_blocking();
+    void leave_blocking();
+
+    //统计信息
+    int live_threads() { return m_live; }
+    int idle_threads() { return m_idle; }
+    int blocking_threads() { return m_blocking; }
+
 private:
+    //队列中的请求及其入队时刻
+    struct task{
+        T* request;
+        long long enqueue_us;
+    };
+
     static void *worker(void *arg);
     void run();
+    bool spawn();
+    void maybe_grow();
 
 private:
-    int m_thread_number;        //线程池中的线程数
+    int m_thread_number;        //线程池中常驻的最少线程数
+    int m_max_thread_number;    //线程数上限
+    int m_idle_timeout_ms;      //超过常驻数的线程空闲多久后退出
     int m_max_requests;         //请求队列中允许的最大请求数
-    pthread_t *m_threads;       //描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue; //请求队列
-    locker m_queuelocker;       //保护请求队列的互斥锁
+    int m_live;                 //当前线程数
+    int m_idle;                 //正在等待任务的线程数
+    int m_blocking;             //处于阻塞区间的线程数
+    std::vector<task> m_workqueue;//请求队列,容量固定为max_requests的环形缓冲区,入队出队不分配内存
+    int m_front;                //队头下标
+    int m_queued;               //队列中的请求数
+    int m_in_flight;            //正在被工作线程处理的请求数
+    admission_control m_admission; //按排队时间自适应的准入控制
+    locker m_queuelocker;       //保护请求队列和以上计数的互斥锁
     sem m_queuestat;            //是否有任务需要处理
     bool m_stop;                //是否结束线程
 };
 
 template<typename T>
-threadpool<T>::threadpool(int thread_number=8,int max_requests=1000)
-:m_thread_number(thread_number),m_max_requests(max_requests),m_stop(false),m_threads(NULL)
+threadpool<T>::threadpool(int thread_number,int max_requests,int max_thread_number,int idle_timeout_ms)
+:m_thread_number(thread_number),
+ m_max_thread_number(max_thread_number>0?max_thread_number:thread_number*4),
+ m_idle_timeout_ms(idle_timeout_ms),m_max_requests(max_requests),
+ m_live(0),m_idle(0),m_blocking(0),m_front(0),m_queued(0),
+ m_in_flight(0),m_admission(max_requests),m_stop(false)
 {
-    if((thread_number<=0)||(max_requests<=0)){
-        throw std::exception();
-    }
-    
-    m_threads=new pthread_t[m_thread_number];
-    if(!m_threads){
+    if((thread_number<=0)||(max_requests<=0)||(m_max_thread_number<thread_number)){
         throw std::exception();
     }
-    
+    m_workqueue.resize(max_requests);
+
+    m_queuelocker.lock();
     for(int i=0;i<thread_number;++i){
-        printf("create the %dth thread\n",i);
-        if(pthread_create(m_threads[i],NULL,worker,this)!=0){
-            delete [] m_threads;
-            throw std::exception();
-        }
-        if(pthread_detach(m_threads[i])){
-            delete [] m_threads;
+        if(!spawn()){
+            m_queuelocker.unlock();
             throw std::exception();
         }
     }
+    m_queuelocker.unlock();
 }
 
 template<typename T>
 threadpool<T>::~threadpool(){
-    delete [] m_threads;
     m_stop=true;
 }
 
+//创建一个分离的工作线程,调用者需持有m_queuelocker
+template<typename T>
+bool threadpool<T>::spawn(){
+    pthread_t tid;
+    printf("create the %dth thread\n",m_live);
+    if(pthread_create(&tid,NULL,worker,this)!=0){
+        return false;
+    }
+    if(pthread_detach(tid)){
+        return false;
+    }
+    ++m_live;
+    return true;
+}
+
+//没有空闲线程,且队列积压超过可运行线程数的两倍或者所有线程都被阻塞时扩容
+//调用者需持有m_queuelocker
+template<typename T>
+void threadpool<T>::maybe_grow(){
+    if(m_idle>0||m_live>=m_max_thread_number||m_queued==0) return;
+    int runnable=m_live-m_blocking;
+    if(runnable<=0||m_queued>2*runnable){
+        spawn();
+    }
+}
+
 template<typename T>
 bool threadpool<T>::append(T* request){
     m_queuelocker.lock();
 
-    if(m_workqueue.size()>m_max_requests){
+    int load=m_queued+m_in_flight;
+    if(m_queued>=m_max_requests){
+        m_admission.count_shed();
+        m_queuelocker.unlock();
+        return false;
+    }
+    if(!m_admission.admit(load)){
         m_queuelocker.unlock();
         return false;
     }
 
-    m_workqueue.push_back(request);
+    task &t=m_workqueue[(m_front+m_queued)%m_max_requests];
+    t.request=request;
+    t.enqueue_us=admission_control::now_us();
+    ++m_queued;
+    maybe_grow();
     //书上将下面这步放在锁外,这步确实加不加锁都是可以的,可以理解为加锁的时间越短越好,但这里我先把它放进锁中
     m_queuestat.post();
     m_queuelocker.unlock();
     return true;
 }
 
+template<typename T>
+bool threadpool<T>::saturated(){
+    m_queuelocker.lock();
+    bool ret=m_admission.saturated(m_queued+m_in_flight);
+    m_queuelocker.unlock();
+    return ret;
+}
+
+//进入阻塞区间,若因此没有线程能处理积压的请求则立即扩容
+template<typename T>
+void threadpool<T>::enter_blocking(){
+    m_queuelocker.lock();
+    ++m_blocking;
+    maybe_grow();
+    m_queuelocker.unlock();
+}
+
+template<typename T>
+void threadpool<T>::leave_blocking(){
+    m_queuelocker.lock();
+    --m_blocking;
+    m_queuelocker.unlock();
+}
+
 template<typename T>
 void* threadpool<T>::worker(void *arg){
     threadpool* ptr=(threadpool*)arg;
+    blocking_monitor::current()=ptr;
     ptr->run();
     return ptr;
 }
@@ -88,19 +183,49 @@ template<typename T>
 void threadpool<T>::run(){
     while (!m_stop)
     {
+        //先等待信号量,有任务时再加锁取出,避免持锁阻塞
         m_queuelocker.lock();
+        ++m_idle;
+        m_queuelocker.unlock();
+
+        bool got=m_queuestat.timedwait(m_idle_timeout_ms);
+        int err=errno;
 
-        if(m_workqueue.empty()){
+        m_queuelocker.lock();
+        --m_idle;
+        if(!got){
+            //空闲超时,多出常驻数的线程退出
+            if(err==ETIMEDOUT&&m_live>m_thread_number){
+                --m_live;
+                m_queuelocker.unlock();
+                return;
+            }
             m_queuelocker.unlock();
-            return false;
+            continue;
         }
 
-        T* a=m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuestat.wait();
+        if(m_queued==0){
+            m_queuelocker.unlock();
+            continue;
+        }
+
+        task t=m_workqueue[m_front];
+        m_front=(m_front+1)%m_max_requests;
+        --m_queued;
+        bool empty=m_queued==0;
+        ++m_in_flight;
+        m_queuelocker.unlock();
+
+        //把排队时间反馈给准入控制
+        m_admission.on_dequeue(admission_control::now_us()-t.enqueue_us,empty);
+        if(t.request){
+            t.request->process();
+        }
+
+        m_queuelocker.lock();
+        --m_in_flight;
         m_queuelocker.unlock();
-        if(!a) continue;
     }
 }
 
-#endif
\ No newline at end of file
+#endif
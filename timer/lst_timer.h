@@ -2,8 +2,20 @@
 #define LST_TIMER
 
 #include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/timerfd.h>
 #include "../log/log.h"
 
+//单调时钟的当前毫秒数,定时器的超时时刻都以它为基准,不受系统时间调整影响
+inline long long timer_now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
 class util_timer;
 //连接资源
 struct client_data
@@ -21,19 +33,19 @@ public:
     util_timer():prev(NULL),next(NULL){}
 
 public:
-    //超时时间
-    time_t expire;
+    //超时时刻,timer_now_ms()的毫秒数
+    long long expire;
     //回调函数
     void (*cb_func)(client_data*);
     //连接资源
-    client_data *uesr_data;
+    client_data *user_data;
     util_timer *prev;
     util_timer *next;
 };
 
 class sort_timer_lst{
 public:
-    sort_timer_lst():head(NULL),tail(NULL){}
+    sort_timer_lst():head(NULL),tail(NULL),m_timerfd(-1),m_armed(0){}
     ~sort_timer_lst(){
         util_timer *tmp=head;
         while(tmp){
@@ -41,14 +53,29 @@ public:
             delete tmp;
             tmp=head;
         }
+        if(m_timerfd>=0){
+            close(m_timerfd);
+        }
     }
 
-    void add_timer(ulil_timer *timer){
+    //创建与该链表绑定的timerfd,由调用者注册到所在的epoll中.
+    //之后链表每次变化都会把timerfd设为最早的超时时刻,timerfd可读时调用tick()
+    int create_timerfd(){
+        if(m_timerfd<0){
+            m_timerfd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+        }
+        return m_timerfd;
+    }
+
+    int timerfd() const { return m_timerfd; }
+
+    void add_timer(util_timer *timer){
         if(!timer){
             return;
         }
         if(!head){
             head=tail=timer;
+            rearm();
             return;
         }
 
@@ -57,10 +84,11 @@ public:
             timer->next=head;
             head->prev=timer;
             head=timer;
+            rearm();
             return;
         }
 
-        //其他情况
+        //其他情况,头部不变,无需重设timerfd
         add_timer(timer,head);
     }
 
@@ -74,10 +102,11 @@ public:
 
 
         //被调整的定时器是链表的头部结点,将定时器取出,重新插入
+        //头部的超时时刻只会推后,已设置的timerfd提前醒来一次即可,无需立即重设
         if(timer==head){
             head=head->next;
             head->prev=NULL;
-            timer-next=NULL;
+            timer->next=NULL;
             add_timer(timer,head);
         }
         //被调整的定时器在链表的内部,将定时器取出,重新插入
@@ -89,7 +118,7 @@ public:
     }
 
     //删除定时器
-    void del_timer(ultil_timer *timer){
+    void del_timer(util_timer *timer){
         if(!timer) return;
 
         //链表中只有一个定时器,需要删除该定时器
@@ -113,6 +142,7 @@ public:
             tail=tail->prev;
             tail->next=NULL;
             delete timer;
+            return;
         }
 
         //在链表内部
@@ -121,12 +151,21 @@ public:
         delete timer;
     }
 
-    //定时处理函数
+    //定时处理函数,timerfd可读时调用
     void tick(){
-        if(!head) return;
+        //读出timerfd的到期次数,否则水平触发下会一直可读
+        if(m_timerfd>=0){
+            uint64_t expirations;
+            ssize_t ret=read(m_timerfd,&expirations,sizeof(expirations));
+            (void)ret;
+            m_armed=0;
+        }
+        if(!head){
+            return;
+        }
 
         //获取当前时间
-        time_t cur=time();
+        long long cur=timer_now_ms();
         util_timer* tmp=head;
 
         while(tmp){
@@ -137,16 +176,32 @@ public:
             tmp->cb_func(tmp->user_data);
 
             //将到期定时器移除并重置头结点
-            head=tmp-next;
+            head=tmp->next;
             if(head){
                 head->prev=NULL;
             }
             delete tmp;
             tmp=head;
         }
+        rearm();
     }
 
 private:
+    //将timerfd设为链表头的超时时刻.删除或推后头部时不必重设,多醒来一次由tick()处理
+    void rearm(){
+        if(m_timerfd<0||!head) return;
+        if(m_armed!=0&&m_armed<=head->expire) return;
+
+        struct itimerspec its;
+        memset(&its,0,sizeof(its));
+        its.it_value.tv_sec=head->expire/1000;
+        its.it_value.tv_nsec=(head->expire%1000)*1000000;
+        //绝对时刻为0会被当作停止定时器
+        if(its.it_value.tv_sec==0&&its.it_value.tv_nsec==0) its.it_value.tv_nsec=1;
+        timerfd_settime(m_timerfd,TFD_TIMER_ABSTIME,&its,NULL);
+        m_armed=head->expire;
+    }
+
     void add_timer(util_timer* timer,util_timer *lst_head){
         util_timer* prev=lst_head;
         util_timer* tmp=prev->next;
@@ -168,7 +223,7 @@ private:
         if(!tmp){
             prev->next=timer;
             timer->prev=prev;
-            timer->mext=NULL;
+            timer->next=NULL;
             tail=timer;
         }
     }
@@ -176,6 +231,8 @@ private:
 private:
     util_timer* head;
     util_timer* tail;
-}
+    int m_timerfd;          //绑定的timerfd,-1表示未使用
+    long long m_armed;      //timerfd当前设置的到期时刻,0表示未设置或已到期
+};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,281 @@
+//静态资源打包工具:把doc_root整个打成一个资源包,服务器启动时mmap一次即可提供全部静态文件
+//
+//编译: g++ -O2 -std=c++14 -pthread -I. tools/packer.cpp http/content_cache.cpp http/file_cache.cpp -lz -lbrotlienc -o packer
+//用法: ./packer <doc_root> <output.pack>
+//      ./server 9006 output.pack
+//
+//输出先写到<output.pack>.tmp再rename覆盖,正在使用旧包的服务器不受影响,重启后才加载新包.
+//手工替换资源包时也必须这样(cp到临时文件再mv),不能直接覆盖写原文件
+//
+//每个文件生成原文、gzip、brotli三种变体(压缩不划算或类型不可压缩时省略),
+//响应体按页对齐,报头和ETag预先拼好,索引按url哈希排序.
+//doc_root中已有的.gz/.br预压缩文件直接作为对应变体,不再单独成为资源
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../http/pack_format.h"
+#include "../http/content_cache.h"
+#include "../http/file_cache.h"
+#include "../http/mime.h"
+
+using namespace std;
+
+struct asset
+{
+    string url;
+    string body[pack::VARIANT_COUNT];   //空表示没有该变体,原文除外
+    const mime_type *mime;
+    uint64_t hash;
+};
+
+static bool ends_with(const string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+//目录层数上限,和path_filter扫描doc_root时相同
+static const int MAX_DEPTH = 32;
+
+//目录的符号链接照常跟随,服务器按路径打开文件时也会跟随;
+//ancestors是当前路径上各层目录的(设备,inode),链接指回其中之一就成环,不再深入
+static void scan(const string &root, const string &rel, vector<string> &files,
+                 vector<pair<dev_t, ino_t> > &ancestors)
+{
+    string dir = root + rel;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+    {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        string path = rel + "/" + e->d_name;
+        struct stat st;
+        if (stat((root + path).c_str(), &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+        {
+            pair<dev_t, ino_t> id(st.st_dev, st.st_ino);
+            if (find(ancestors.begin(), ancestors.end(), id) != ancestors.end())
+            {
+                fprintf(stderr, "skip %s: symlink loop\n", path.c_str());
+                continue;
+            }
+            if ((int)ancestors.size() > MAX_DEPTH)
+            {
+                fprintf(stderr, "skip %s: deeper than %d levels\n", path.c_str(), MAX_DEPTH);
+                continue;
+            }
+            ancestors.push_back(id);
+            scan(root, path, files, ancestors);
+            ancestors.pop_back();
+        }
+        else if (S_ISREG(st.st_mode) && (st.st_mode & S_IROTH))
+            files.push_back(path);
+    }
+    closedir(d);
+}
+
+static bool read_all(const string &path, string &out)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0)
+        return false;
+    return file_cache::read_file(path.c_str(), st.st_size, out);
+}
+
+//预先拼好除状态行和Connection以外的报头
+static string make_header(const asset &a, int encoding, const string &etag)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Content-Length:%llu\r\n", (unsigned long long)a.body[encoding].size());
+    string h = buf;
+    h.append(a.mime->header, a.mime->header_len);
+    if (encoding != ENCODING_IDENTITY)
+        h += string("Content-Encoding:") + content_cache::encoding_name((CONTENT_ENCODING)encoding) + "\r\n";
+    if (a.mime->compressible)
+        h += "Vary:Accept-Encoding\r\n";
+    h += "ETag:" + etag + "\r\n";
+    return h;
+}
+
+//不同编码是不同的表示,强ETag要区分
+static string make_etag(const asset &a, int encoding)
+{
+    static const char *suffix[] = {"", "-gz", "-br"};
+    char buf[48];
+    uint64_t h = pack::hash(a.body[ENCODING_IDENTITY].data(), a.body[ENCODING_IDENTITY].size());
+    snprintf(buf, sizeof(buf), "\"%016llx%s\"", (unsigned long long)h, suffix[encoding]);
+    return buf;
+}
+
+static uint64_t align_up(uint64_t n)
+{
+    return (n + pack::ALIGN - 1) & ~(pack::ALIGN - 1);
+}
+
+static bool write_at(FILE *fp, uint64_t offset, const void *data, size_t len)
+{
+    return fseeko(fp, offset, SEEK_SET) == 0 && fwrite(data, 1, len, fp) == len;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <doc_root> <output.pack>\n", argv[0]);
+        return 1;
+    }
+    string root = argv[1];
+    while (root.size() > 1 && root[root.size() - 1] == '/')
+        root.erase(root.size() - 1);
+
+    vector<string> files;
+    vector<pair<dev_t, ino_t> > ancestors;
+    struct stat st;
+    if (stat(root.c_str(), &st) < 0 || !S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "%s is not a directory\n", root.c_str());
+        return 1;
+    }
+    ancestors.push_back(make_pair(st.st_dev, st.st_ino));
+    scan(root, "", files, ancestors);
+    sort(files.begin(), files.end());
+
+    vector<asset> assets;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const string &url = files[i];
+        //原文件存在的.gz/.br作为它的变体
+        if ((ends_with(url, ".gz") || ends_with(url, ".br")) &&
+            binary_search(files.begin(), files.end(), url.substr(0, url.size() - 3)))
+            continue;
+
+        asset a;
+        a.url = url;
+        a.mime = mime::lookup(url.c_str());
+        a.hash = pack::hash(url.data(), url.size());
+        if (!read_all(root + url, a.body[ENCODING_IDENTITY]))
+        {
+            fprintf(stderr, "cannot read %s\n", url.c_str());
+            return 1;
+        }
+        const string &origin = a.body[ENCODING_IDENTITY];
+        static const char *suffix[] = {"", ".gz", ".br"};
+        for (int e = ENCODING_GZIP; e <= ENCODING_BR; ++e)
+        {
+            if (!a.mime->compressible || origin.empty())
+                continue;
+            string &out = a.body[e];
+            if (!binary_search(files.begin(), files.end(), url + suffix[e]) || !read_all(root + url + suffix[e], out))
+            {
+                if (!content_cache::compress((CONTENT_ENCODING)e, origin.data(), origin.size(), out))
+                    out.clear();
+            }
+            if (out.size() >= origin.size())
+                out.clear();
+        }
+        assets.push_back(a);
+    }
+
+    //索引按哈希排序,服务器二分查找
+    sort(assets.begin(), assets.end(), [](const asset &x, const asset &y) {
+        return x.hash != y.hash ? x.hash < y.hash : x.url < y.url;
+    });
+
+    //布局:文件头、索引、字符串区,响应体从下一页开始
+    vector<pack::entry> entries(assets.size());
+    memset(entries.data(), 0, entries.size() * sizeof(pack::entry));
+    uint64_t entries_offset = sizeof(pack::header);
+    string strings;
+    uint64_t strings_offset = entries_offset + entries.size() * sizeof(pack::entry);
+    for (size_t i = 0; i < assets.size(); ++i)
+    {
+        const asset &a = assets[i];
+        pack::entry &e = entries[i];
+        e.hash = a.hash;
+        e.url_offset = strings_offset + strings.size();
+        e.url_len = a.url.size();
+        strings += a.url;
+        for (int v = 0; v < pack::VARIANT_COUNT; ++v)
+        {
+            if (v != ENCODING_IDENTITY && a.body[v].empty())
+                continue;
+            string etag = make_etag(a, v);
+            string header = make_header(a, v, etag);
+            e.variants[v].header_offset = strings_offset + strings.size();
+            e.variants[v].header_len = header.size();
+            strings += header;
+            e.variants[v].etag_offset = strings_offset + strings.size();
+            e.variants[v].etag_len = etag.size();
+            strings += etag;
+        }
+    }
+    if (strings_offset + strings.size() > UINT32_MAX)
+    {
+        fprintf(stderr, "index too large\n");
+        return 1;
+    }
+
+    uint64_t offset = align_up(strings_offset + strings.size());
+    for (size_t i = 0; i < assets.size(); ++i)
+    {
+        for (int v = 0; v < pack::VARIANT_COUNT; ++v)
+        {
+            const string &body = assets[i].body[v];
+            if (v != ENCODING_IDENTITY && body.empty())
+                continue;
+            entries[i].variants[v].body_offset = offset;
+            entries[i].variants[v].body_len = body.size();
+            offset = align_up(offset + body.size());
+        }
+    }
+
+    pack::header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, pack::MAGIC, sizeof(h.magic));
+    h.version = pack::VERSION;
+    h.count = assets.size();
+    h.entries_offset = entries_offset;
+    h.file_size = offset;
+
+    //先写到<output>.tmp,落盘后再rename覆盖:运行中的服务器以MAP_SHARED映射着旧包,
+    //原地截断重写会让它访问到已不存在的页而收到SIGBUS;rename后旧映射仍指向旧inode
+    string tmp = string(argv[2]) + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", tmp.c_str());
+        return 1;
+    }
+    bool ok = write_at(fp, 0, &h, sizeof(h)) &&
+              write_at(fp, entries_offset, entries.data(), entries.size() * sizeof(pack::entry)) &&
+              write_at(fp, strings_offset, strings.data(), strings.size());
+    for (size_t i = 0; ok && i < assets.size(); ++i)
+    {
+        for (int v = 0; ok && v < pack::VARIANT_COUNT; ++v)
+        {
+            const pack::variant &var = entries[i].variants[v];
+            if (var.header_len)
+                ok = write_at(fp, var.body_offset, assets[i].body[v].data(), var.body_len);
+        }
+    }
+    //末尾补齐到页边界
+    ok = ok && fflush(fp) == 0 && ftruncate(fileno(fp), offset) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0 || !ok || rename(tmp.c_str(), argv[2]) != 0)
+    {
+        fprintf(stderr, "write %s failed\n", argv[2]);
+        unlink(tmp.c_str());
+        return 1;
+    }
+    printf("packed %zu assets, %llu bytes\n", assets.size(), (unsigned long long)offset);
+    return 0;
+}